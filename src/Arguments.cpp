@@ -7,6 +7,7 @@
 
 #include <cxxopts.hpp>
 
+#include "trace.h"
 #include "video.hpp"
 
 namespace fds
@@ -27,10 +28,34 @@ namespace fds
             ("d,device", "cv video device path", device_value)
             ("g,gen-object-templates", "generate object templates",
              cxxopts::value<bool>()->default_value("false"))
+            ("headless", "track without any windows as fast as possible until the video ends",
+             cxxopts::value<bool>()->default_value("false"))
+            ("initial-pose", "initial pose as tx,ty,tz,alpha,beta,gamma in mm and degrees",
+             cxxopts::value<std::vector<float>>())
+            ("pin-threads", "pin each tracking thread to its own core",
+             cxxopts::value<bool>()->default_value("false"))
+            ("poses", "file the poses are written to in headless mode",
+             cxxopts::value<std::string>()->default_value("poses.csv"))
             ("q,quality-threshold", "quality threshold before object lost",
              cxxopts::value<float>()->default_value("0.55"))
+            ("r,renderer", "rendering backend, either gl or cpu",
+             cxxopts::value<std::string>()->default_value("gl"))
+            ("recording-policy", "when the recording queue is full either block, drop or spill",
+             cxxopts::value<std::string>()->default_value("block"))
+            ("recording-queue", "number of frames queued for recording",
+             cxxopts::value<std::size_t>()->default_value("8"))
+            ("recording-threads", "number of threads writing recordings",
+             cxxopts::value<std::size_t>()->default_value("2"))
+            ("relocalization-threads", "number of threads searching lost objects in the background, 0 searches within the frame",
+             cxxopts::value<std::size_t>()->default_value("0"))
+            ("template-cache", "directory generated object templates are cached in",
+             cxxopts::value<std::string>())
             ("t,template-distances", "template distances in mm, used to track lost objects",
              cxxopts::value<std::vector<float>>()->default_value("500,1000,1200"))
+            ("threads", "number of tracking threads, 0 uses all logical cores",
+             cxxopts::value<std::size_t>()->default_value("0"))
+            ("trace", "file a Chrome trace is written to on exit, needs a build with -Dtrace=true",
+             cxxopts::value<std::string>())
             ("v,video", "video source, either cv, file or shm",
              cxxopts::value<std::string>()->default_value("cv"))
             ("z,z-distance", "initial z-distance of object",
@@ -67,7 +92,9 @@ namespace fds
             ::exit(1);
         }
 
-        if (result.count("recording-directory") == 0)
+        this->headless = result["headless"].as<bool>();
+
+        if (!this->headless && result.count("recording-directory") == 0)
         {
             std::cerr << "A recording directory is required\n" << std::flush;
             ::exit(1);
@@ -94,6 +121,60 @@ namespace fds
             ::exit(1);
         }
 
+        auto const rendererStr = result["renderer"].as<std::string>();
+
+        if (rendererStr == "gl" || rendererStr == "cpu")
+        {
+            this->cpuRenderer = rendererStr == "cpu";
+        }
+        else
+        {
+            std::cerr << '"' << rendererStr
+                      << "\" is not a renderer, choice either gl or cpu\n"
+                      << std::flush;
+            ::exit(1);
+        }
+
+        auto const recordingPolicyStr =
+            result["recording-policy"].as<std::string>();
+
+        if (recordingPolicyStr == "block")
+        {
+            this->recordingPolicy = RecordingPolicy::block;
+        }
+        else if (recordingPolicyStr == "drop")
+        {
+            this->recordingPolicy = RecordingPolicy::drop;
+        }
+        else if (recordingPolicyStr == "spill")
+        {
+            this->recordingPolicy = RecordingPolicy::spill;
+        }
+        else
+        {
+            std::cerr << '"' << recordingPolicyStr
+                      << "\" is not a recording policy, choice either block, "
+                         "drop or spill\n"
+                      << std::flush;
+            ::exit(1);
+        }
+
+        if (result.count("initial-pose") != 0)
+        {
+            auto const values = result["initial-pose"].as<std::vector<float>>();
+
+            if (values.size() != 6)
+            {
+                std::cerr << "The initial pose needs 6 values, "
+                             "tx,ty,tz,alpha,beta,gamma\n"
+                          << std::flush;
+                ::exit(1);
+            }
+
+            this->initialPose = Pose{
+                values[0], values[1], values[2], values[3], values[4], values[5]};
+        }
+
         if (!device_value->has_default() && result.count("device") == 0)
         {
             std::cerr << "No video device found, use -d/--device\n"
@@ -105,11 +186,38 @@ namespace fds
         this->generateObjectTemplates =
             result["gen-object-templates"].as<bool>();
         this->objectPath = result["object"].as<std::string>();
+        this->pinThreads = result["pin-threads"].as<bool>();
+        this->posesPath = result["poses"].as<std::string>();
         this->qualityThreshold = result["quality-threshold"].as<float>();
-        this->recordingDirectory =
-            result["recording-directory"].as<std::string>();
+        if (result.count("recording-directory") != 0)
+        {
+            this->recordingDirectory =
+                result["recording-directory"].as<std::string>();
+        }
+        this->recordingQueueCapacity =
+            result["recording-queue"].as<std::size_t>();
+        this->recordingThreads = result["recording-threads"].as<std::size_t>();
+        this->relocalizationThreads =
+            result["relocalization-threads"].as<std::size_t>();
+        if (result.count("template-cache") != 0)
+        {
+            this->templateCacheDirectory =
+                result["template-cache"].as<std::string>();
+        }
         this->templateDistances =
             result["template-distances"].as<std::vector<float>>();
+        this->threads = result["threads"].as<std::size_t>();
+        if (result.count("trace") != 0)
+        {
+            if (!Trace::isEnabled())
+            {
+                std::cerr << "Tracing is disabled in this build, configure it "
+                             "with -Dtrace=true\n"
+                          << std::flush;
+                ::exit(1);
+            }
+            this->tracePath = result["trace"].as<std::string>();
+        }
         this->zDistance = result["z-distance"].as<float>();
     }
 
@@ -124,11 +232,31 @@ namespace fds
         return this->generateObjectTemplates;
     }
 
+    auto Arguments::getHeadless() const noexcept -> bool
+    {
+        return this->headless;
+    }
+
+    auto Arguments::getInitialPose() const noexcept -> std::optional<Pose>
+    {
+        return this->initialPose;
+    }
+
     auto Arguments::getObjectPath() const noexcept -> std::filesystem::path
     {
         return this->objectPath;
     }
 
+    auto Arguments::getPinThreads() const noexcept -> bool
+    {
+        return this->pinThreads;
+    }
+
+    auto Arguments::getPosesPath() const noexcept -> std::filesystem::path
+    {
+        return this->posesPath;
+    }
+
     auto Arguments::useCVVideo() const noexcept -> bool
     {
         return this->videoSource == VideoSource::cv;
@@ -144,6 +272,11 @@ namespace fds
         return this->videoSource == VideoSource::shm;
     }
 
+    auto Arguments::useCPURenderer() const noexcept -> bool
+    {
+        return this->cpuRenderer;
+    }
+
     auto Arguments::getQualityThreshold() const noexcept -> float
     {
         return this->qualityThreshold;
@@ -154,12 +287,49 @@ namespace fds
         return this->recordingDirectory;
     }
 
+    auto Arguments::getRecordingPolicy() const noexcept -> RecordingPolicy
+    {
+        return this->recordingPolicy;
+    }
+
+    auto Arguments::getRecordingQueueCapacity() const noexcept -> std::size_t
+    {
+        return this->recordingQueueCapacity;
+    }
+
+    auto Arguments::getRecordingThreads() const noexcept -> std::size_t
+    {
+        return this->recordingThreads;
+    }
+
+    auto Arguments::getRelocalizationThreads() const noexcept -> std::size_t
+    {
+        return this->relocalizationThreads;
+    }
+
+    auto Arguments::getTemplateCacheDirectory() const noexcept
+        -> std::optional<std::filesystem::path>
+    {
+        return this->templateCacheDirectory;
+    }
+
     auto Arguments::getTemplateDistances() const noexcept
         -> const std::vector<float>
     {
         return this->templateDistances;
     }
 
+    auto Arguments::getThreads() const noexcept -> std::size_t
+    {
+        return this->threads;
+    }
+
+    auto Arguments::getTracePath() const noexcept
+        -> std::optional<std::filesystem::path>
+    {
+        return this->tracePath;
+    }
+
     auto Arguments::getZDistance() const noexcept -> float
     {
         return this->zDistance;
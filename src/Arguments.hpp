@@ -1,8 +1,11 @@
 #pragma once
+#include <cstddef>
 #include <filesystem>
 #include <optional>
 #include <vector>
 
+#include "Pose.hpp"
+#include "Recording.hpp"
 
 namespace fds
 {
@@ -12,15 +15,29 @@ namespace fds
         Arguments(int argc, char** argv) noexcept;
         auto getDevicePath() const -> std::filesystem::path;
         auto getGenerateObjectTemplates() const noexcept -> bool;
+        auto getHeadless() const noexcept -> bool;
+        auto getInitialPose() const noexcept -> std::optional<Pose>;
         auto getObjectPath() const noexcept -> std::filesystem::path;
+        auto getPinThreads() const noexcept -> bool;
+        auto getPosesPath() const noexcept -> std::filesystem::path;
         auto getRecordingDirectory() const noexcept -> std::filesystem::path;
+        auto getRecordingPolicy() const noexcept -> RecordingPolicy;
+        auto getRecordingQueueCapacity() const noexcept -> std::size_t;
+        auto getRecordingThreads() const noexcept -> std::size_t;
+        auto getRelocalizationThreads() const noexcept -> std::size_t;
         auto getQualityThreshold() const noexcept -> float;
+        auto getTemplateCacheDirectory() const noexcept
+            -> std::optional<std::filesystem::path>;
         auto getTemplateDistances() const noexcept -> const std::vector<float>;
+        auto getThreads() const noexcept -> std::size_t;
+        auto getTracePath() const noexcept
+            -> std::optional<std::filesystem::path>;
         auto getZDistance() const noexcept -> float;
         auto useCVVideo() const noexcept -> bool;
         
         auto useCVFileVideo() const noexcept -> bool;
         auto useSHMVideo() const noexcept -> bool;
+        auto useCPURenderer() const noexcept -> bool;
 
       private:
         enum class VideoSource
@@ -30,12 +47,24 @@ namespace fds
             shm,
         };
 
+        bool cpuRenderer;
         std::optional<std::filesystem::path> devicePath;
         bool generateObjectTemplates;
+        bool headless;
+        std::optional<Pose> initialPose;
         std::filesystem::path objectPath;
+        bool pinThreads;
+        std::filesystem::path posesPath;
         std::filesystem::path recordingDirectory;
+        RecordingPolicy recordingPolicy;
+        std::size_t recordingQueueCapacity;
+        std::size_t recordingThreads;
+        std::size_t relocalizationThreads;
         float qualityThreshold;
+        std::optional<std::filesystem::path> templateCacheDirectory;
         std::vector<float> templateDistances;
+        std::size_t threads;
+        std::optional<std::filesystem::path> tracePath;
         VideoSource videoSource;
         float zDistance;
     };
@@ -0,0 +1,171 @@
+#include "AsyncVideo.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace fds
+{
+    AsyncVideo::AsyncVideo(std::unique_ptr<Video> video,
+                           std::size_t const capacity,
+                           FramePolicy const policy)
+        : video{std::move(video)}, policy{policy}, ring(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument{"The frame ring needs a capacity\n"};
+        }
+
+        this->thread = std::thread{&AsyncVideo::capture, this};
+    }
+
+    AsyncVideo::~AsyncVideo()
+    {
+        {
+            auto lock = std::lock_guard<std::mutex>{this->mutex};
+            this->stopping = true;
+        }
+        this->slotAvailable.notify_all();
+
+        // a read of the decorated video may otherwise wait for a frame that
+        // never arrives, e.g. from shared memory without a producer
+        interrupt();
+        this->thread.join();
+    }
+
+    auto AsyncVideo::readFrameInto(cv::Mat& destination) -> void
+    {
+        readNextFrameInto(destination);
+    }
+
+    auto AsyncVideo::readNextFrameInto(cv::Mat& destination) -> void
+    {
+        auto lock = std::unique_lock<std::mutex>{this->mutex};
+        waitForFrame(lock);
+        popFrameInto(destination);
+        lock.unlock();
+
+        this->slotAvailable.notify_one();
+    }
+
+    auto AsyncVideo::readLatestFrameInto(cv::Mat& destination) -> void
+    {
+        auto lock = std::unique_lock<std::mutex>{this->mutex};
+        waitForFrame(lock);
+
+        auto const skipped = this->count - 1;
+        this->first = (this->first + skipped) % this->ring.size();
+        this->count = 1;
+        this->droppedFrameCount += skipped;
+
+        popFrameInto(destination);
+        lock.unlock();
+
+        this->slotAvailable.notify_one();
+    }
+
+    auto AsyncVideo::togglePause() -> void
+    {
+        // the decorated video is only accessed by the capture thread
+        auto lock = std::lock_guard<std::mutex>{this->mutex};
+        this->pauseRequested = !this->pauseRequested;
+    }
+
+    auto AsyncVideo::interrupt() -> void
+    {
+        // the capture thread then stores VideoInterrupted, which is rethrown
+        // to the readers once the captured frames are consumed
+        this->video->interrupt();
+    }
+
+    auto AsyncVideo::getDroppedFrameCount() const noexcept -> std::size_t
+    {
+        auto lock = std::lock_guard<std::mutex>{this->mutex};
+        return this->droppedFrameCount;
+    }
+
+    auto AsyncVideo::waitForFrame(std::unique_lock<std::mutex>& lock) -> void
+    {
+        this->frameAvailable.wait(
+            lock, [this]() { return this->count > 0 || this->error; });
+
+        if (this->count == 0)
+        {
+            std::rethrow_exception(this->error);
+        }
+    }
+
+    auto AsyncVideo::popFrameInto(cv::Mat& destination) -> void
+    {
+        // copy, as the slot's memory is reused for later frames
+        this->ring[this->first].copyTo(destination);
+        this->first = (this->first + 1) % this->ring.size();
+        this->count -= 1;
+    }
+
+    auto AsyncVideo::capture() -> void
+    {
+        // filled without holding the lock and then swapped into the ring,
+        // whose previous memory is in turn reused for the next frame
+        auto frame = cv::Mat{};
+
+        try
+        {
+            for (;;)
+            {
+                {
+                    auto lock = std::lock_guard<std::mutex>{this->mutex};
+                    if (this->stopping)
+                    {
+                        return;
+                    }
+                    if (this->pauseRequested)
+                    {
+                        this->video->togglePause();
+                        this->pauseRequested = false;
+                    }
+                }
+
+                this->video->readFrameInto(frame);
+
+                auto lock = std::unique_lock<std::mutex>{this->mutex};
+
+                if (this->count == this->ring.size())
+                {
+                    if (this->policy == FramePolicy::block)
+                    {
+                        this->slotAvailable.wait(lock, [this]() {
+                            return this->count < this->ring.size() ||
+                                   this->stopping;
+                        });
+                        if (this->stopping)
+                        {
+                            return;
+                        }
+                    }
+                    else
+                    {
+                        this->first = (this->first + 1) % this->ring.size();
+                        this->count -= 1;
+                        this->droppedFrameCount += 1;
+                    }
+                }
+
+                auto const last =
+                    (this->first + this->count) % this->ring.size();
+                cv::swap(this->ring[last], frame);
+                this->count += 1;
+
+                lock.unlock();
+                this->frameAvailable.notify_one();
+            }
+        }
+        catch (...)
+        {
+            {
+                auto lock = std::lock_guard<std::mutex>{this->mutex};
+                this->error = std::current_exception();
+            }
+            this->frameAvailable.notify_all();
+        }
+    }
+} // namespace fds
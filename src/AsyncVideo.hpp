@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "video.hpp"
+
+namespace fds
+{
+    // What the capture thread does when the ring is full.
+    enum class FramePolicy
+    {
+        dropOldest,
+        block,
+    };
+
+    // Decorates a Video by capturing it on a separate thread into a bounded
+    // ring of frames whose memory is reused, such that fetching, decoding and
+    // copying frames overlaps with the processing of the previous ones.
+    class AsyncVideo final : public Video
+    {
+      public:
+        AsyncVideo(std::unique_ptr<Video> video,
+                   std::size_t capacity = 3,
+                   FramePolicy policy = FramePolicy::dropOldest);
+        ~AsyncVideo() override;
+
+        // Same as readNextFrameInto.
+        auto readFrameInto(cv::Mat& destination) -> void override;
+
+        // Copies the oldest captured frame, waiting for one if the ring is
+        // empty.
+        auto readNextFrameInto(cv::Mat& destination) -> void;
+
+        // Copies the most recently captured frame, waiting for one if the
+        // ring is empty. All older frames are dropped.
+        auto readLatestFrameInto(cv::Mat& destination) -> void;
+
+        auto togglePause() -> void override;
+        auto interrupt() -> void override;
+        auto getDroppedFrameCount() const noexcept -> std::size_t;
+
+      private:
+        std::unique_ptr<Video> video;
+        FramePolicy const policy;
+
+        std::vector<cv::Mat> ring;
+        std::size_t first = 0;
+        std::size_t count = 0;
+        std::size_t droppedFrameCount = 0;
+        bool pauseRequested = false;
+        bool stopping = false;
+        std::exception_ptr error;
+
+        mutable std::mutex mutex;
+        std::condition_variable frameAvailable;
+        std::condition_variable slotAvailable;
+        std::thread thread;
+
+        auto capture() -> void;
+        auto waitForFrame(std::unique_lock<std::mutex>& lock) -> void;
+        auto popFrameInto(cv::Mat& destination) -> void;
+    };
+} // namespace fds
@@ -0,0 +1,188 @@
+#include "KernelScene.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <string>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "pose_estimator6d.h"
+#include "rendering_engine.h"
+#include "signed_distance_transform2d.h"
+#include "tclc_histograms.h"
+
+namespace fds
+{
+    namespace
+    {
+        auto const modelPaths = std::vector<std::string>{
+            "data/cat.obj",
+            "data/squirrel_demo_low.obj",
+        };
+
+        auto getBoundingBox(std::vector<cv::Point3i> const& centersIDs,
+                            int offset) -> cv::Rect
+        {
+            auto minX = INT_MAX;
+            auto minY = INT_MAX;
+            auto maxX = -1;
+            auto maxY = -1;
+            for (auto const& center : centersIDs)
+            {
+                minX = std::min(minX, center.x);
+                minY = std::min(minY, center.y);
+                maxX = std::max(maxX, center.x);
+                maxY = std::max(maxY, center.y);
+            }
+            auto const box = cv::Rect{minX - offset,
+                                      minY - offset,
+                                      maxX - minX + 2 * offset,
+                                      maxY - minY + 2 * offset};
+            return box &
+                   cv::Rect{0, 0, KernelScene::width, KernelScene::height};
+        }
+    } // namespace
+
+    auto KernelScene::getK() -> cv::Matx33f
+    {
+        return {627.746f, 0.0f, 327.113f, 0.0f, 627.746f, 242.4199f,
+                0.0f, 0.0f, 1.0f};
+    }
+
+    auto KernelScene::getNumModels() -> int
+    {
+        return static_cast<int>(modelPaths.size());
+    }
+
+    auto KernelScene::initRenderer() -> void
+    {
+        static auto initialized = false;
+
+        if (!initialized)
+        {
+            RenderingEngine::setBackend(RenderingEngine::CPU);
+            RenderingEngine::Instance()->init(
+                getK(), width, height, zNear, zFar, 4);
+            RenderingEngine::Instance()->makeCurrent();
+            initialized = true;
+        }
+    }
+
+    auto KernelScene::make(int model, int distance)
+        -> std::unique_ptr<KernelScene>
+    {
+        auto* engine = RenderingEngine::Instance();
+
+        auto scene = std::make_unique<KernelScene>();
+
+        auto distances = std::vector<float>{};
+        auto const tz = static_cast<float>(distance);
+        scene->object = std::make_unique<Object3D>(modelPaths.at(model),
+                                                   0.0f,
+                                                   0.0f,
+                                                   tz,
+                                                   11.0f,
+                                                   184.0f,
+                                                   180.0f,
+                                                   1.0f,
+                                                   0.55f,
+                                                   distances);
+        auto* object = scene->object.get();
+        object->setModelID(1);
+        object->initialize();
+
+        auto frame = cv::imread("data/frame.png");
+        if (frame.empty())
+        {
+            return nullptr;
+        }
+        cv::resize(frame, scene->frame, cv::Size{width, height});
+
+        auto& histograms = object->getTCLCHistograms();
+
+        parallel_for_(cv::Range(0, partitions),
+                      Parallel_For_convertToBins(scene->frame,
+                                                 scene->binned,
+                                                 histograms.getNumBins(),
+                                                 partitions));
+
+        engine->setLevel(0);
+        engine->renderSilhouette(object, GL_FILL);
+        scene->mask = engine->downloadFrame(RenderingEngine::MASK);
+        scene->depth = engine->downloadFrame(RenderingEngine::DEPTH);
+        engine->renderSilhouette(object, GL_FILL, true);
+        scene->depthInv = engine->downloadFrame(RenderingEngine::DEPTH);
+
+        auto projections = std::vector<cv::Point2f>{};
+        auto boundingRect = cv::Rect{};
+        engine->projectBoundingBox(object, projections, boundingRect);
+        // with a margin of 8 pixels like OptimizationEngine::compute2DROI
+        scene->roi = cv::Rect{boundingRect.x - 8,
+                              boundingRect.y - 8,
+                              boundingRect.width + 16,
+                              boundingRect.height + 16} &
+                     cv::Rect{0, 0, width, height};
+        if (scene->roi.area() == 0)
+        {
+            return nullptr;
+        }
+
+        scene->croppedDepth = scene->depth(scene->roi).clone();
+        scene->croppedDepthInv = scene->depthInv(scene->roi).clone();
+
+        auto sdt2D = SignedDistanceTransform2D{
+            maxDist, true, ExecutionContext{partitions}};
+        sdt2D.computeTransform(
+            scene->mask(scene->roi).clone(), scene->sdt, scene->xyPos);
+
+        // build the histograms from the ground truth silhouette
+        auto K = getK();
+        histograms.update(
+            scene->frame, scene->mask, scene->depth, K, zNear, zFar);
+
+        scene->centersIDs = histograms.getCentersAndIDs();
+        if (scene->centersIDs.empty())
+        {
+            return nullptr;
+        }
+
+        scene->energyROI =
+            getBoundingBox(scene->centersIDs, histograms.getRadius());
+
+        auto sdtEnergy = cv::Mat{};
+        auto xyPosEnergy = cv::Mat{};
+        sdt2D.computeTransform(scene->mask(scene->energyROI).clone(),
+                               sdtEnergy,
+                               xyPosEnergy,
+                               object->getModelID());
+        parallel_for_(cv::Range(0, partitions),
+                      Parallel_For_convertToHeaviside(
+                          sdtEnergy, scene->heaviside, partitions));
+
+        auto const numCenters = static_cast<int>(scene->centersIDs.size());
+        auto const histogramSize = histograms.getNumBins() *
+                                   histograms.getNumBins() *
+                                   histograms.getNumBins();
+        scene->notNormalizedFG =
+            cv::Mat::zeros(numCenters, histogramSize, CV_32SC1);
+        scene->notNormalizedBG =
+            cv::Mat::zeros(numCenters, histogramSize, CV_32SC1);
+        scene->sumsFB = cv::Mat::zeros(numCenters, 1, CV_32SC2);
+
+        parallel_for_(cv::Range(0, numCenters),
+                      Parallel_For_buildLocalHistograms(
+                          scene->frame,
+                          scene->mask,
+                          scene->centersIDs,
+                          histograms.getRadius(),
+                          histograms.getNumBins(),
+                          scene->notNormalizedFG,
+                          scene->notNormalizedBG,
+                          scene->sumsFB,
+                          object->getModelID(),
+                          numCenters));
+
+        return scene;
+    }
+} // namespace fds
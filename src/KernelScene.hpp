@@ -0,0 +1,68 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "object3d.h"
+
+namespace fds
+{
+    // The rendered silhouette of a model along with everything the
+    // Parallel_For_* kernels of the tracker read, prepared like during
+    // tracking at the finest pyramid level. The frame and the models are
+    // read from data/, so the scenes must be made from the root of the
+    // repository. Shared by the kernel benchmark and the kernel check.
+    struct KernelScene final
+    {
+        static constexpr auto width = 640;
+        static constexpr auto height = 512;
+        static constexpr auto zNear = 0.005f;
+        static constexpr auto zFar = 10000.0f;
+        static constexpr auto maxDist = 8.0f;
+        static constexpr auto partitions = 8;
+
+        std::unique_ptr<Object3D> object;
+
+        cv::Mat frame;
+        cv::Mat binned;
+
+        // the silhouette with the ID of the model, its depth and its inverse
+        // depth covering the whole frame
+        cv::Mat mask;
+        cv::Mat depth;
+        cv::Mat depthInv;
+
+        // the region of interest around the silhouette and the cropped depth
+        // maps, where the depth doubles as mask for a single object
+        cv::Rect roi;
+        cv::Mat croppedDepth;
+        cv::Mat croppedDepthInv;
+        cv::Mat sdt;
+        cv::Mat xyPos;
+
+        // the region around the histogram centers used for the energy
+        std::vector<cv::Point3i> centersIDs;
+        cv::Rect energyROI;
+        cv::Mat heaviside;
+
+        // the unnormalized histograms of the centers
+        cv::Mat notNormalizedFG;
+        cv::Mat notNormalizedBG;
+        cv::Mat sumsFB;
+
+        // The intrinsics the scenes are rendered with.
+        static auto getK() -> cv::Matx33f;
+
+        // The number of models scenes can be made of.
+        static auto getNumModels() -> int;
+
+        // Sets up the CPU renderer all scenes are rendered with, once.
+        static auto initRenderer() -> void;
+
+        // Renders a model at the given distance in mm, returning nullptr if
+        // the frame is missing or the model is not visible.
+        static auto make(int model, int distance)
+            -> std::unique_ptr<KernelScene>;
+    };
+} // namespace fds
@@ -1,39 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include <opencv2/core/mat.hpp>
-#include <opencv2/core/persistence.hpp>
 #include <opencv2/imgcodecs.hpp>
-#include <opencv2/imgproc.hpp>
 
 #include "Recording.hpp"
 
+namespace
+{
+    auto makeRecordingFilePath(std::filesystem::path const& recordingDirectory)
+        -> std::filesystem::path
+    {
+        std::filesystem::create_directories(recordingDirectory);
+        return recordingDirectory / "recording.rbot";
+    }
+
+    // Precedes the raw pixels of a spilled frame and its mask.
+    struct SpillHeader final
+    {
+        std::uint32_t frameNumber;
+        std::int64_t timestamp;
+        float pose[16];
+        std::int32_t maskROI[4];
+        std::int32_t rgbRows;
+        std::int32_t rgbCols;
+        std::int32_t rgbType;
+        std::int32_t maskRows;
+        std::int32_t maskCols;
+        std::int32_t maskType;
+    };
+} // namespace
+
 namespace fds
 {
     Recording::Recording(std::filesystem::path const& recordingDirectory,
                          std::filesystem::path const& modelPath,
                          cv::Matx33f const& K,
-                         float const diameter)
+                         float const diameter,
+                         std::size_t const threads,
+                         std::size_t const capacity,
+                         RecordingPolicy const policy)
         : recordingDirectory{recordingDirectory},
-          rgbDirectory{recordingDirectory / "rgb"},
-          maskDirectory{recordingDirectory / "mask"},
-          poseDirectory{recordingDirectory / "pose"}
+          file{makeRecordingFilePath(recordingDirectory),
+               K,
+               static_cast<float>(diameter * 0.001),
+               hashFile(modelPath)},
+          capacity{std::max<std::size_t>(capacity, 1)},
+          policy{policy},
+          spillPath{recordingDirectory / "spill.tmp"}
     {
         namespace fs = std::filesystem;
-        fs::create_directories(recordingDirectory);
-        fs::create_directories(rgbDirectory);
-        fs::create_directories(maskDirectory);
-        fs::create_directories(poseDirectory);
         fs::copy(modelPath,
                  recordingDirectory / "model.ply",
                  fs::copy_options::overwrite_existing);
-        auto kFile = cv::FileStorage{recordingDirectory / "camera.yml",
-                                     cv::FileStorage::WRITE};
-        kFile << "camera" << K;
-        auto diameterFile = cv::FileStorage{recordingDirectory / "diameter.yml",
-                                            cv::FileStorage::WRITE};
-        auto mmToMetres = 0.001;
-        diameterFile << "diameter" << diameter * mmToMetres;
+
+        if (policy == RecordingPolicy::spill)
+        {
+            this->spill.open(this->spillPath,
+                             std::ios::in | std::ios::out | std::ios::trunc |
+                                 std::ios::binary);
+            if (!this->spill)
+            {
+                throw std::runtime_error{"Unable to create " +
+                                         this->spillPath.string() + '\n'};
+            }
+        }
+
+        for (auto i = std::size_t{0}; i < std::max<std::size_t>(threads, 1);
+             ++i)
+        {
+            this->threads.emplace_back(&Recording::write, this);
+        }
+    }
+
+    Recording::~Recording()
+    {
+        // write all queued and spilled frames before stopping
+        {
+            auto const lock = std::lock_guard{this->mutex};
+            this->stopping = true;
+        }
+        this->jobAvailable.notify_all();
+
+        for (auto& thread : this->threads)
+        {
+            thread.join();
+        }
+
+        if (this->spill.is_open())
+        {
+            this->spill.close();
+            auto error = std::error_code{};
+            std::filesystem::remove(this->spillPath, error);
+        }
     }
 
     auto Recording::toggleRecording() noexcept -> void
@@ -51,35 +115,264 @@ namespace fds
         return frameCount;
     }
 
+    auto Recording::getStats() const -> RecordingStats
+    {
+        auto const lock = std::lock_guard{this->mutex};
+        auto stats = this->stats;
+        stats.queueDepth = this->queue.size();
+        stats.meanEncodeMilliseconds =
+            stats.writtenFrameCount == 0
+                ? 0
+                : this->totalEncodeMilliseconds / stats.writtenFrameCount;
+        return stats;
+    }
+
     auto Recording::update(cv::Mat const& rgb,
-                           cv::Mat const& depth,
+                           cv::Mat const& mask,
+                           cv::Rect const& maskROI,
                            cv::Matx44f const& pose) -> void
     {
         if (!isRecording)
         {
             return;
         }
-        auto rgbPath = makePath(rgbDirectory, ".jpg");
-        cv::imwrite(rgbPath, rgb);
 
-        auto mask = cv::Mat{depth.rows, depth.cols, depth.type()};
-        cv::threshold(depth, mask, 0, 255, cv::THRESH_BINARY);
+        auto lock = std::unique_lock{this->mutex};
 
-        auto maskPath = makePath(maskDirectory, ".png");
-        cv::imwrite(maskPath, mask);
+        if (this->error)
+        {
+            std::rethrow_exception(std::exchange(this->error, nullptr));
+        }
 
-        auto posePath = makePath(poseDirectory, ".yml");
-        auto poseFile = cv::FileStorage{posePath, cv::FileStorage::WRITE};
-        poseFile << "pose" << pose;
+        auto spilling = false;
+        if (this->queue.size() >= this->capacity)
+        {
+            switch (this->policy)
+            {
+            case RecordingPolicy::block:
+                this->slotAvailable.wait(lock, [this]() {
+                    return this->queue.size() < this->capacity;
+                });
+                break;
+            case RecordingPolicy::drop:
+                this->stats.droppedFrameCount += 1;
+                return;
+            case RecordingPolicy::spill:
+                spilling = true;
+                break;
+            }
+        }
+
+        auto job = Job{};
+        if (!this->freeJobs.empty())
+        {
+            job = std::move(this->freeJobs.back());
+            this->freeJobs.pop_back();
+        }
+        lock.unlock();
+
+        // only this thread queues jobs, so the frames are copied into the
+        // reused buffers without holding the lock
+        job.frame.frameNumber = frameCount;
+        job.frame.timestamp =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        job.frame.pose = pose;
+        job.frame.maskROI = maskROI;
+        rgb.copyTo(job.rgb);
+        mask(maskROI).copyTo(job.mask);
+
+        if (spilling)
+        {
+            // the job's buffers are reused right away, the writers only see
+            // the frame once it is completely written
+            spillJob(job);
+
+            lock.lock();
+            this->freeJobs.push_back(std::move(job));
+            this->spilledJobCount += 1;
+            this->stats.spilledFrameCount += 1;
+            lock.unlock();
+            this->jobAvailable.notify_one();
+
+            frameCount += 1;
+            return;
+        }
+
+        lock.lock();
+        this->queue.push_back(std::move(job));
+        this->stats.maxQueueDepth =
+            std::max(this->stats.maxQueueDepth, this->queue.size());
+        lock.unlock();
+        this->jobAvailable.notify_one();
 
         frameCount += 1;
     }
 
-    auto Recording::makePath(std::filesystem::path const& directory,
-                             std::string const& ext) const noexcept
-        -> std::filesystem::path
+    auto Recording::write() -> void
+    {
+        for (;;)
+        {
+            auto lock = std::unique_lock{this->mutex};
+            this->jobAvailable.wait(lock, [this]() {
+                return this->stopping || !this->queue.empty() ||
+                       this->spilledJobCount > 0;
+            });
+
+            auto job = Job{};
+            auto const spilled = this->queue.empty();
+
+            if (!spilled)
+            {
+                job = std::move(this->queue.front());
+                this->queue.pop_front();
+                lock.unlock();
+                this->slotAvailable.notify_one();
+            }
+            else if (this->spilledJobCount > 0)
+            {
+                // spilled frames are only written once the queue is empty
+                this->spilledJobCount -= 1;
+                if (!this->freeJobs.empty())
+                {
+                    job = std::move(this->freeJobs.back());
+                    this->freeJobs.pop_back();
+                }
+                lock.unlock();
+            }
+            else
+            {
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto error = std::exception_ptr{};
+            try
+            {
+                if (spilled)
+                {
+                    readSpilledJob(job);
+                    start = std::chrono::steady_clock::now();
+                }
+                writeJob(job);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            auto const encodeMilliseconds =
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+
+            lock.lock();
+            if (error)
+            {
+                if (!this->error)
+                {
+                    this->error = error;
+                }
+                this->stats.failedFrameCount += 1;
+            }
+            else
+            {
+                this->stats.writtenFrameCount += 1;
+                this->stats.maxEncodeMilliseconds = std::max(
+                    this->stats.maxEncodeMilliseconds, encodeMilliseconds);
+                this->totalEncodeMilliseconds += encodeMilliseconds;
+            }
+            this->freeJobs.push_back(std::move(job));
+        }
+    }
+
+    auto Recording::spillJob(Job const& job) -> void
+    {
+        auto header = SpillHeader{};
+        header.frameNumber = job.frame.frameNumber;
+        header.timestamp = job.frame.timestamp;
+        std::copy(job.frame.pose.val, job.frame.pose.val + 16, header.pose);
+        header.maskROI[0] = job.frame.maskROI.x;
+        header.maskROI[1] = job.frame.maskROI.y;
+        header.maskROI[2] = job.frame.maskROI.width;
+        header.maskROI[3] = job.frame.maskROI.height;
+        header.rgbRows = job.rgb.rows;
+        header.rgbCols = job.rgb.cols;
+        header.rgbType = job.rgb.type();
+        header.maskRows = job.mask.rows;
+        header.maskCols = job.mask.cols;
+        header.maskType = job.mask.type();
+
+        auto const lock = std::lock_guard{this->spillMutex};
+
+        this->spill.seekp(this->spillWriteOffset);
+        this->spill.write(reinterpret_cast<char const*>(&header),
+                          sizeof(header));
+        this->spill.write(reinterpret_cast<char const*>(job.rgb.data),
+                          job.rgb.total() * job.rgb.elemSize());
+        this->spill.write(reinterpret_cast<char const*>(job.mask.data),
+                          job.mask.total() * job.mask.elemSize());
+        this->spill.flush();
+
+        if (!this->spill)
+        {
+            throw std::runtime_error{"Unable to spill a frame to " +
+                                     this->spillPath.string() + '\n'};
+        }
+
+        this->spillWriteOffset = this->spill.tellp();
+    }
+
+    auto Recording::readSpilledJob(Job& job) -> void
     {
-        return (directory / std::to_string(frameCount)).replace_extension(ext);
+        auto const lock = std::lock_guard{this->spillMutex};
+
+        auto header = SpillHeader{};
+        this->spill.seekg(this->spillReadOffset);
+        this->spill.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+        if (this->spill)
+        {
+            job.frame.frameNumber = header.frameNumber;
+            job.frame.timestamp = header.timestamp;
+            std::copy(header.pose, header.pose + 16, job.frame.pose.val);
+            job.frame.maskROI = cv::Rect{header.maskROI[0],
+                                         header.maskROI[1],
+                                         header.maskROI[2],
+                                         header.maskROI[3]};
+            job.rgb.create(header.rgbRows, header.rgbCols, header.rgbType);
+            job.mask.create(header.maskRows, header.maskCols, header.maskType);
+
+            this->spill.read(reinterpret_cast<char*>(job.rgb.data),
+                             job.rgb.total() * job.rgb.elemSize());
+            this->spill.read(reinterpret_cast<char*>(job.mask.data),
+                             job.mask.total() * job.mask.elemSize());
+        }
+
+        if (!this->spill)
+        {
+            throw std::runtime_error{"Unable to read a spilled frame from " +
+                                     this->spillPath.string() + '\n'};
+        }
+
+        this->spillReadOffset = this->spill.tellg();
+
+        // start over at the beginning of the file once it is drained
+        if (this->spillReadOffset == this->spillWriteOffset)
+        {
+            this->spillReadOffset = 0;
+            this->spillWriteOffset = 0;
+        }
     }
 
+    auto Recording::writeJob(Job& job) -> void
+    {
+        auto& frame = job.frame;
+        frame.size = job.rgb.size();
+        cv::imencode(".jpg", job.rgb, frame.rgb);
+
+        frame.maskEncoding = encodeMask(job.mask, frame.mask);
+
+        this->file.append(frame);
+    }
 } // namespace fds
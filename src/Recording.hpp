@@ -1,35 +1,111 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <opencv2/core.hpp>
 
+#include "RecordingFile.hpp"
+
 namespace fds
 {
+    // What update does when the writer queue is full.
+    enum class RecordingPolicy
+    {
+        block,
+        drop,
+        // write the raw frame to a file in the recording directory, from which
+        // the writers read it back whenever the queue is empty, such that
+        // memory stays bounded while no frame is lost
+        spill,
+    };
+
+    struct RecordingStats final
+    {
+        std::size_t queueDepth;
+        std::size_t maxQueueDepth;
+        std::size_t writtenFrameCount;
+        // frames whose encoding or writing threw, the first error is
+        // rethrown by the next call of update()
+        std::size_t failedFrameCount;
+        std::size_t droppedFrameCount;
+        std::size_t spilledFrameCount;
+        double meanEncodeMilliseconds;
+        double maxEncodeMilliseconds;
+    };
+
+    // Records frames, masks and poses into a single recording file. The frames
+    // are encoded and appended by a pool of threads fed through a bounded
+    // queue, such that recording does not slow down tracking.
     class Recording final
     {
       public:
         explicit Recording(std::filesystem::path const& recordingDirectory,
                            std::filesystem::path const& modelPath,
                            cv::Matx33f const& K,
-                           float diameter);
+                           float diameter,
+                           std::size_t threads = 2,
+                           std::size_t capacity = 8,
+                           RecordingPolicy policy = RecordingPolicy::block);
+        ~Recording();
         auto toggleRecording() noexcept -> void;
         auto getIsRecording() const noexcept -> bool;
         auto getFrameCount() const noexcept -> int;
+        auto getStats() const -> RecordingStats;
+        // Records a frame together with the object's CV_8UC1 silhouette mask,
+        // of which only maskROI is stored.
         auto update(cv::Mat const& rgb,
                     cv::Mat const& mask,
+                    cv::Rect const& maskROI,
                     cv::Matx44f const& pose) -> void;
 
       private:
+        // A recorded frame, whose buffers are reused once it is written.
+        struct Job
+        {
+            RecordedFrame frame;
+            cv::Mat rgb;
+            cv::Mat mask;
+        };
+
         bool isRecording = false;
         int frameCount = 0;
         std::filesystem::path const recordingDirectory;
-        std::filesystem::path const rgbDirectory;
-        std::filesystem::path const maskDirectory;
-        std::filesystem::path const poseDirectory;
+        RecordingFileWriter file;
+
+        std::size_t const capacity;
+        RecordingPolicy const policy;
+        std::deque<Job> queue;
+        std::vector<Job> freeJobs;
+        RecordingStats stats = {};
+        double totalEncodeMilliseconds = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+
+        mutable std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::condition_variable slotAvailable;
+        std::vector<std::thread> threads;
+
+        // frames that did not fit into the queue, only accessed under
+        // spillMutex except for the number of pending ones
+        std::filesystem::path const spillPath;
+        std::fstream spill;
+        std::mutex spillMutex;
+        std::streamoff spillReadOffset = 0;
+        std::streamoff spillWriteOffset = 0;
+        std::size_t spilledJobCount = 0;
 
-        auto makePath(std::filesystem::path const& directory,
-                      std::string const& ext) const noexcept
-            -> std::filesystem::path;
+        auto write() -> void;
+        auto writeJob(Job& job) -> void;
+        auto spillJob(Job const& job) -> void;
+        auto readSpilledJob(Job& job) -> void;
     };
 } // namespace fds
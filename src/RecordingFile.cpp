@@ -0,0 +1,613 @@
+#include "RecordingFile.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+namespace
+{
+    constexpr char fileMagic[8] = {'R', 'B', 'O', 'T', 'R', 'E', 'C', '\0'};
+    constexpr std::uint32_t fileVersion = 1;
+    // "FRAM" and "INDX" in little endian
+    constexpr std::uint32_t frameMagic = 0x4d415246;
+    constexpr std::uint32_t indexMagic = 0x58444e49;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t headerSize;
+        float K[9];
+        float diameter;
+        std::uint64_t modelHash;
+        // 0 until the writer is closed
+        std::uint64_t indexOffset;
+    };
+
+    struct FrameHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t frameNumber;
+        std::int64_t timestamp;
+        float pose[16];
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t maskX;
+        std::int32_t maskY;
+        std::int32_t maskWidth;
+        std::int32_t maskHeight;
+        std::uint32_t maskEncoding;
+        std::uint32_t rgbSize;
+        std::uint32_t maskSize;
+        std::uint32_t reserved;
+    };
+
+    struct IndexHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t reserved;
+        std::uint64_t count;
+    };
+
+    struct IndexEntry
+    {
+        std::uint32_t frameNumber;
+        std::uint32_t reserved;
+        std::uint64_t offset;
+    };
+
+    static_assert(sizeof(FileHeader) == 72);
+    static_assert(sizeof(FrameHeader) == 120);
+    static_assert(sizeof(IndexHeader) == 16);
+    static_assert(sizeof(IndexEntry) == 16);
+
+    // records are padded such that all headers in the mapping are aligned
+    constexpr auto alignment = std::uint64_t{8};
+
+    auto padding(std::uint64_t const size) noexcept -> std::uint64_t
+    {
+        return (alignment - size % alignment) % alignment;
+    }
+
+    auto recordSize(FrameHeader const& header) noexcept -> std::uint64_t
+    {
+        auto const size = sizeof(FrameHeader) + std::uint64_t{header.rgbSize} +
+                          header.maskSize;
+        return size + padding(size);
+    }
+} // namespace
+
+namespace fds
+{
+    auto packMask(cv::Mat const& mask, std::vector<std::uint8_t>& packed)
+        -> void
+    {
+        auto const rowBytes = static_cast<std::size_t>((mask.cols + 7) / 8);
+        packed.assign(rowBytes * mask.rows, 0);
+
+        for (auto y = 0; y < mask.rows; ++y)
+        {
+            auto const row = mask.ptr<std::uint8_t>(y);
+            auto const packedRow = packed.data() + y * rowBytes;
+
+            for (auto x = 0; x < mask.cols; ++x)
+            {
+                if (row[x] != 0)
+                {
+                    packedRow[x / 8] |= 0x80 >> (x % 8);
+                }
+            }
+        }
+    }
+
+    auto unpackMask(std::uint8_t const* const packed,
+                    std::size_t const packedSize,
+                    cv::Size const size,
+                    cv::Mat& mask) -> void
+    {
+        auto const rowBytes = static_cast<std::size_t>((size.width + 7) / 8);
+        if (packedSize < rowBytes * size.height)
+        {
+            throw std::runtime_error{"Truncated mask\n"};
+        }
+
+        mask.create(size, CV_8UC1);
+
+        for (auto y = 0; y < size.height; ++y)
+        {
+            auto const row = mask.ptr<std::uint8_t>(y);
+            auto const packedRow = packed + y * rowBytes;
+
+            for (auto x = 0; x < size.width; ++x)
+            {
+                row[x] = (packedRow[x / 8] & (0x80 >> (x % 8))) != 0 ? 255 : 0;
+            }
+        }
+    }
+
+    auto runLengthEncodeMask(cv::Mat const& mask,
+                             std::vector<std::uint8_t>& encoded) -> void
+    {
+        encoded.clear();
+
+        auto const appendRun = [&](unsigned int run) {
+            while (run >= 0x80)
+            {
+                encoded.push_back(static_cast<std::uint8_t>(run | 0x80));
+                run >>= 7;
+            }
+            encoded.push_back(static_cast<std::uint8_t>(run));
+        };
+
+        for (auto y = 0; y < mask.rows; ++y)
+        {
+            auto const row = mask.ptr<std::uint8_t>(y);
+            auto isObject = false;
+            auto run = 0u;
+
+            for (auto x = 0; x < mask.cols; ++x)
+            {
+                if ((row[x] != 0) != isObject)
+                {
+                    appendRun(run);
+                    isObject = !isObject;
+                    run = 0;
+                }
+                run += 1;
+            }
+
+            if (run > 0)
+            {
+                appendRun(run);
+            }
+        }
+    }
+
+    auto runLengthDecodeMask(std::uint8_t const* const encoded,
+                             std::size_t const encodedSize,
+                             cv::Size const size,
+                             cv::Mat& mask) -> void
+    {
+        mask.create(size, CV_8UC1);
+
+        auto i = std::size_t{0};
+        auto const readRun = [&]() {
+            auto run = 0u;
+            for (auto shift = 0; shift < 32; shift += 7)
+            {
+                if (i >= encodedSize)
+                {
+                    throw std::runtime_error{"Truncated mask\n"};
+                }
+                auto const byte = encoded[i++];
+                run |= static_cast<unsigned int>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return run;
+                }
+            }
+            throw std::runtime_error{"Corrupt mask\n"};
+        };
+
+        for (auto y = 0; y < size.height; ++y)
+        {
+            auto const row = mask.ptr<std::uint8_t>(y);
+            auto value = std::uint8_t{0};
+
+            for (auto x = 0; x < size.width;)
+            {
+                auto const run = readRun();
+                if (run > static_cast<unsigned int>(size.width - x))
+                {
+                    throw std::runtime_error{"Corrupt mask\n"};
+                }
+                std::fill(row + x, row + x + run, value);
+                x += run;
+                value = ~value;
+            }
+        }
+    }
+
+    auto encodeMask(cv::Mat const& mask, std::vector<std::uint8_t>& encoded)
+        -> MaskEncoding
+    {
+        // silhouettes are mostly a few long runs per row, but fall back to a
+        // bit per pixel for very fragmented masks
+        runLengthEncodeMask(mask, encoded);
+
+        auto const packedSize =
+            static_cast<std::size_t>((mask.cols + 7) / 8) * mask.rows;
+        if (encoded.size() <= packedSize)
+        {
+            return MaskEncoding::runLength;
+        }
+
+        packMask(mask, encoded);
+        return MaskEncoding::bitPacked;
+    }
+
+    auto decodeMask(MaskEncoding const encoding,
+                    std::uint8_t const* const encoded,
+                    std::size_t const encodedSize,
+                    cv::Rect const roi,
+                    cv::Size const size,
+                    cv::Mat& mask) -> void
+    {
+        if ((roi & cv::Rect{0, 0, size.width, size.height}) != roi)
+        {
+            throw std::runtime_error{"Mask outside of the frame\n"};
+        }
+
+        mask = cv::Mat::zeros(size.height, size.width, CV_8UC1);
+        if (roi.area() == 0)
+        {
+            return;
+        }
+
+        auto maskROI = mask(roi);
+
+        switch (encoding)
+        {
+        case MaskEncoding::bitPacked:
+            unpackMask(encoded, encodedSize, roi.size(), maskROI);
+            break;
+        case MaskEncoding::runLength:
+            runLengthDecodeMask(encoded, encodedSize, roi.size(), maskROI);
+            break;
+        default:
+            throw std::runtime_error{"Unknown mask encoding\n"};
+        }
+    }
+
+    RecordingFileWriter::RecordingFileWriter(
+        std::filesystem::path const& path,
+        cv::Matx33f const& K,
+        float const diameter,
+        std::uint64_t const modelHash)
+    {
+        this->file.exceptions(std::ios::failbit | std::ios::badbit);
+        this->file.open(path,
+                        std::ios::binary | std::ios::out | std::ios::trunc);
+
+        auto header = FileHeader{};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = fileVersion;
+        header.headerSize = sizeof(FileHeader);
+        std::copy(K.val, K.val + 9, header.K);
+        header.diameter = diameter;
+        header.modelHash = modelHash;
+        header.indexOffset = 0;
+
+        this->file.write(reinterpret_cast<char const*>(&header),
+                         sizeof(header));
+        this->end = sizeof(header);
+    }
+
+    RecordingFileWriter::~RecordingFileWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+            // without an index the file is still readable by scanning it
+        }
+    }
+
+    auto RecordingFileWriter::append(RecordedFrame const& frame) -> void
+    {
+        auto header = FrameHeader{};
+        header.magic = frameMagic;
+        header.frameNumber = frame.frameNumber;
+        header.timestamp = frame.timestamp;
+        std::copy(frame.pose.val, frame.pose.val + 16, header.pose);
+        header.width = frame.size.width;
+        header.height = frame.size.height;
+        header.maskX = frame.maskROI.x;
+        header.maskY = frame.maskROI.y;
+        header.maskWidth = frame.maskROI.width;
+        header.maskHeight = frame.maskROI.height;
+        header.maskEncoding = static_cast<std::uint32_t>(frame.maskEncoding);
+        header.rgbSize = static_cast<std::uint32_t>(frame.rgb.size());
+        header.maskSize = static_cast<std::uint32_t>(frame.mask.size());
+
+        auto const size = recordSize(header);
+        constexpr char zeros[alignment] = {};
+
+        auto const lock = std::lock_guard{this->mutex};
+
+        if (!this->file.is_open())
+        {
+            throw std::logic_error{"Recording file already closed\n"};
+        }
+
+        this->file.write(reinterpret_cast<char const*>(&header),
+                         sizeof(header));
+        this->file.write(reinterpret_cast<char const*>(frame.rgb.data()),
+                         frame.rgb.size());
+        this->file.write(reinterpret_cast<char const*>(frame.mask.data()),
+                         frame.mask.size());
+        this->file.write(zeros,
+                         size - sizeof(header) - frame.rgb.size() -
+                             frame.mask.size());
+
+        this->index.emplace_back(frame.frameNumber, this->end);
+        this->end += size;
+    }
+
+    auto RecordingFileWriter::close() -> void
+    {
+        auto const lock = std::lock_guard{this->mutex};
+
+        if (!this->file.is_open())
+        {
+            return;
+        }
+
+        std::sort(this->index.begin(), this->index.end());
+
+        auto const indexHeader = IndexHeader{indexMagic, 0, this->index.size()};
+        this->file.write(reinterpret_cast<char const*>(&indexHeader),
+                         sizeof(indexHeader));
+
+        for (auto const& [frameNumber, offset] : this->index)
+        {
+            auto const entry = IndexEntry{frameNumber, 0, offset};
+            this->file.write(reinterpret_cast<char const*>(&entry),
+                             sizeof(entry));
+        }
+
+        // the index is only referenced once it is completely written
+        this->file.flush();
+        this->file.seekp(offsetof(FileHeader, indexOffset));
+        this->file.write(reinterpret_cast<char const*>(&this->end),
+                         sizeof(this->end));
+        this->file.close();
+    }
+
+    RecordingFileReader::RecordingFileReader(std::filesystem::path const& path)
+    {
+        auto const fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            throw std::runtime_error{"Unable to open recording file\n"};
+        }
+
+        struct stat status;
+        if (::fstat(fd, &status) == -1 ||
+            static_cast<std::size_t>(status.st_size) < sizeof(FileHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error{"Not a recording file\n"};
+        }
+
+        this->size = status.st_size;
+        auto const mapping =
+            ::mmap(nullptr, this->size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error{"Unable to map recording file\n"};
+        }
+        this->data = static_cast<std::uint8_t const*>(mapping);
+
+        auto header = FileHeader{};
+        std::memcpy(&header, this->data, sizeof(header));
+
+        if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+            header.version != fileVersion)
+        {
+            ::munmap(mapping, this->size);
+            throw std::runtime_error{"Not a recording file\n"};
+        }
+
+        auto indexHeader = IndexHeader{};
+        if (header.indexOffset != 0 &&
+            header.indexOffset + sizeof(indexHeader) <= this->size)
+        {
+            std::memcpy(&indexHeader,
+                        this->data + header.indexOffset,
+                        sizeof(indexHeader));
+        }
+
+        if (indexHeader.magic == indexMagic &&
+            indexHeader.count <=
+                (this->size - header.indexOffset - sizeof(indexHeader)) /
+                    sizeof(IndexEntry))
+        {
+            auto const entries = this->data + header.indexOffset +
+                                 sizeof(indexHeader);
+            this->offsets.resize(indexHeader.count);
+
+            for (auto i = std::size_t{0}; i < indexHeader.count; ++i)
+            {
+                auto entry = IndexEntry{};
+                std::memcpy(&entry,
+                            entries + i * sizeof(entry),
+                            sizeof(entry));
+                this->offsets[i] = entry.offset;
+            }
+        }
+        else
+        {
+            // the writer has not been closed, recover all complete records
+            auto index = std::vector<std::pair<std::uint32_t, std::uint64_t>>{};
+            auto offset = std::uint64_t{header.headerSize};
+
+            while (offset + sizeof(FrameHeader) <= this->size)
+            {
+                auto frameHeader = FrameHeader{};
+                std::memcpy(&frameHeader,
+                            this->data + offset,
+                            sizeof(frameHeader));
+
+                if (frameHeader.magic != frameMagic ||
+                    offset + recordSize(frameHeader) > this->size)
+                {
+                    break;
+                }
+
+                index.emplace_back(frameHeader.frameNumber, offset);
+                offset += recordSize(frameHeader);
+            }
+
+            std::sort(index.begin(), index.end());
+            for (auto const& entry : index)
+            {
+                this->offsets.push_back(entry.second);
+            }
+        }
+    }
+
+    RecordingFileReader::~RecordingFileReader()
+    {
+        ::munmap(const_cast<std::uint8_t*>(this->data), this->size);
+    }
+
+    auto RecordingFileReader::getK() const noexcept -> cv::Matx33f
+    {
+        auto header = FileHeader{};
+        std::memcpy(&header, this->data, sizeof(header));
+        return cv::Matx33f{header.K};
+    }
+
+    auto RecordingFileReader::getDiameter() const noexcept -> float
+    {
+        auto header = FileHeader{};
+        std::memcpy(&header, this->data, sizeof(header));
+        return header.diameter;
+    }
+
+    auto RecordingFileReader::getModelHash() const noexcept -> std::uint64_t
+    {
+        auto header = FileHeader{};
+        std::memcpy(&header, this->data, sizeof(header));
+        return header.modelHash;
+    }
+
+    auto RecordingFileReader::getFrameCount() const noexcept -> std::size_t
+    {
+        return this->offsets.size();
+    }
+
+    auto RecordingFileReader::getRecord(std::size_t const i) const
+        -> std::uint8_t const*
+    {
+        if (i >= this->offsets.size())
+        {
+            throw std::out_of_range{"No such frame in recording\n"};
+        }
+
+        auto const offset = this->offsets[i];
+        auto header = FrameHeader{};
+        if (offset + sizeof(header) > this->size)
+        {
+            throw std::runtime_error{"Corrupt recording index\n"};
+        }
+
+        auto const record = this->data + offset;
+        std::memcpy(&header, record, sizeof(header));
+
+        if (header.magic != frameMagic ||
+            offset + recordSize(header) > this->size)
+        {
+            throw std::runtime_error{"Corrupt recording index\n"};
+        }
+
+        return record;
+    }
+
+    auto RecordingFileReader::readFrame(std::size_t const i) const
+        -> DecodedFrame
+    {
+        auto const record = getRecord(i);
+        auto header = FrameHeader{};
+        std::memcpy(&header, record, sizeof(header));
+
+        auto frame = DecodedFrame{};
+        frame.frameNumber = header.frameNumber;
+        frame.timestamp = header.timestamp;
+        frame.pose = cv::Matx44f{header.pose};
+
+        // decode straight from the mapping, without copying the record
+        auto const rgb = record + sizeof(header);
+        frame.rgb = cv::imdecode(
+            cv::Mat{1,
+                    static_cast<int>(header.rgbSize),
+                    CV_8UC1,
+                    const_cast<std::uint8_t*>(rgb)},
+            cv::IMREAD_COLOR);
+
+        decodeMask(static_cast<MaskEncoding>(header.maskEncoding),
+                   rgb + header.rgbSize,
+                   header.maskSize,
+                   cv::Rect{header.maskX,
+                            header.maskY,
+                            header.maskWidth,
+                            header.maskHeight},
+                   cv::Size{header.width, header.height},
+                   frame.mask);
+
+        return frame;
+    }
+
+    auto RecordingFileReader::readRecord(std::size_t const i) const
+        -> RecordedFrame
+    {
+        auto const record = getRecord(i);
+        auto header = FrameHeader{};
+        std::memcpy(&header, record, sizeof(header));
+
+        auto frame = RecordedFrame{};
+        frame.frameNumber = header.frameNumber;
+        frame.timestamp = header.timestamp;
+        frame.pose = cv::Matx44f{header.pose};
+        frame.size = cv::Size{header.width, header.height};
+
+        auto const rgb = record + sizeof(header);
+        frame.rgb.assign(rgb, rgb + header.rgbSize);
+
+        frame.maskEncoding = static_cast<MaskEncoding>(header.maskEncoding);
+        frame.maskROI = cv::Rect{
+            header.maskX, header.maskY, header.maskWidth, header.maskHeight};
+        auto const mask = rgb + header.rgbSize;
+        frame.mask.assign(mask, mask + header.maskSize);
+
+        return frame;
+    }
+
+    auto hashFile(std::filesystem::path const& path) -> std::uint64_t
+    {
+        auto file = std::ifstream{path, std::ios::binary};
+        if (!file)
+        {
+            throw std::runtime_error{"Unable to open " + path.string() + '\n'};
+        }
+
+        auto hash = std::uint64_t{14695981039346656037ull};
+        char buffer[1 << 16];
+
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        {
+            for (auto i = std::streamsize{0}; i < file.gcount(); ++i)
+            {
+                hash ^= static_cast<std::uint8_t>(buffer[i]);
+                hash *= 1099511628211ull;
+            }
+        }
+
+        return hash;
+    }
+} // namespace fds
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace fds
+{
+    // Encodings of the mask of a recorded frame.
+    enum class MaskEncoding : std::uint32_t
+    {
+        // one bit per pixel, most significant bit first, rows padded to
+        // whole bytes
+        bitPacked = 1,
+        // per row alternating lengths of background and object runs as LEB128
+        // varints, starting with a possibly empty background run
+        runLength = 2,
+    };
+
+    // A frame as stored in a recording file, the mask covers maskROI of the
+    // frame and is empty elsewhere.
+    struct RecordedFrame final
+    {
+        std::uint32_t frameNumber;
+        // steady clock nanoseconds
+        std::int64_t timestamp;
+        cv::Matx44f pose;
+        cv::Size size;
+        // JPEG encoded
+        std::vector<std::uint8_t> rgb;
+        MaskEncoding maskEncoding;
+        cv::Rect maskROI;
+        std::vector<std::uint8_t> mask;
+    };
+
+    // A frame read back from a recording file, the mask is as large as the
+    // image and 255 wherever the object is.
+    struct DecodedFrame final
+    {
+        std::uint32_t frameNumber;
+        std::int64_t timestamp;
+        cv::Matx44f pose;
+        cv::Mat rgb;
+        cv::Mat mask;
+    };
+
+    auto packMask(cv::Mat const& mask, std::vector<std::uint8_t>& packed)
+        -> void;
+    auto unpackMask(std::uint8_t const* packed,
+                    std::size_t packedSize,
+                    cv::Size size,
+                    cv::Mat& mask) -> void;
+    auto runLengthEncodeMask(cv::Mat const& mask,
+                             std::vector<std::uint8_t>& encoded) -> void;
+    auto runLengthDecodeMask(std::uint8_t const* encoded,
+                             std::size_t encodedSize,
+                             cv::Size size,
+                             cv::Mat& mask) -> void;
+
+    // Encodes the nonzero pixels of a CV_8UC1 mask with whichever encoding is
+    // more compact.
+    auto encodeMask(cv::Mat const& mask, std::vector<std::uint8_t>& encoded)
+        -> MaskEncoding;
+
+    // Decodes a mask covering roi into a CV_8UC1 mask of the given size, which
+    // is 255 wherever the object is.
+    auto decodeMask(MaskEncoding encoding,
+                    std::uint8_t const* encoded,
+                    std::size_t encodedSize,
+                    cv::Rect roi,
+                    cv::Size size,
+                    cv::Mat& mask) -> void;
+
+    // Appends frames to a single recording file. The file starts with a
+    // header holding the camera matrix, the object diameter in metres and a
+    // hash of the model, followed by one record per frame, and ends with an
+    // index of the records once the writer is closed. All values are stored
+    // in host byte order.
+    class RecordingFileWriter final
+    {
+      public:
+        RecordingFileWriter(std::filesystem::path const& path,
+                            cv::Matx33f const& K,
+                            float diameter,
+                            std::uint64_t modelHash);
+        RecordingFileWriter(RecordingFileWriter const&) = delete;
+        auto operator=(RecordingFileWriter const&)
+            -> RecordingFileWriter& = delete;
+        ~RecordingFileWriter();
+
+        // Thread safe, frames may be appended in any order.
+        auto append(RecordedFrame const& frame) -> void;
+
+        // Writes the index, frames can no longer be appended afterwards.
+        auto close() -> void;
+
+      private:
+        std::ofstream file;
+        std::uint64_t end = 0;
+        std::vector<std::pair<std::uint32_t, std::uint64_t>> index;
+        std::mutex mutex;
+    };
+
+    // Reads a recording file with random access through a memory mapping.
+    // Files whose writer has not been closed are indexed by scanning their
+    // records.
+    class RecordingFileReader final
+    {
+      public:
+        explicit RecordingFileReader(std::filesystem::path const& path);
+        RecordingFileReader(RecordingFileReader const&) = delete;
+        auto operator=(RecordingFileReader const&)
+            -> RecordingFileReader& = delete;
+        ~RecordingFileReader();
+
+        auto getK() const noexcept -> cv::Matx33f;
+        auto getDiameter() const noexcept -> float;
+        auto getModelHash() const noexcept -> std::uint64_t;
+        auto getFrameCount() const noexcept -> std::size_t;
+
+        // Returns the i-th frame ordered by frame number, decoding the image
+        // and the mask directly from the mapped file.
+        auto readFrame(std::size_t i) const -> DecodedFrame;
+
+        // Returns the i-th frame ordered by frame number as stored.
+        auto readRecord(std::size_t i) const -> RecordedFrame;
+
+      private:
+        auto getRecord(std::size_t i) const -> std::uint8_t const*;
+
+        std::uint8_t const* data = nullptr;
+        std::size_t size = 0;
+        std::vector<std::uint64_t> offsets;
+    };
+
+    // 64 bit FNV-1a hash of a file's contents.
+    auto hashFile(std::filesystem::path const& path) -> std::uint64_t;
+} // namespace fds
@@ -0,0 +1,392 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "cpu_rasterizer.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+// signed distances of a point in clip coordinates to the six frustum planes
+static inline double planeDistance(const Vec4d& p, int plane)
+{
+    switch (plane)
+    {
+        case 0:
+            return p[3] + p[0];
+        case 1:
+            return p[3] - p[0];
+        case 2:
+            return p[3] + p[1];
+        case 3:
+            return p[3] - p[1];
+        case 4:
+            return p[3] + p[2];
+        default:
+            return p[3] - p[2];
+    }
+}
+
+static inline int outCode(const Vec4d& p)
+{
+    int code = 0;
+    for (int plane = 0; plane < 6; plane++)
+    {
+        if (planeDistance(p, plane) < 0)
+            code |= 1 << plane;
+    }
+    return code;
+}
+
+static inline int64_t floorDiv(int64_t a, int64_t b)
+{
+    return Parallel_For_rasterizeTriangles::floorDiv(a, b);
+}
+
+CPURasterizer::CPURasterizer(int threads)
+{
+    this->threads = threads;
+
+    invertDepth = false;
+}
+
+void CPURasterizer::clear(const Size& size, bool invertDepth)
+{
+    this->size = size;
+    this->invertDepth = invertDepth;
+
+    depthBuffer.create(size, CV_32FC1);
+    colorBuffer.create(size, CV_8UC4);
+
+    drawCalls.clear();
+
+    rasterizedROI = Rect();
+}
+
+void CPURasterizer::drawMesh(const vector<Vec3f>& vertices,
+                             const vector<unsigned int>& indices,
+                             const Matx44f& modelViewMatrix,
+                             const Matx44f& projectionMatrix,
+                             const Vec3f& color,
+                             Shading shading)
+{
+    DrawCall drawCall;
+    drawCall.vertices = &vertices;
+    drawCall.indices = &indices;
+    drawCall.modelViewProjectionMatrix =
+        Matx44d(projectionMatrix) * Matx44d(modelViewMatrix);
+    drawCall.normalMatrix = modelViewMatrix.get_minor<3, 3>(0, 0).inv().t();
+    drawCall.color = color;
+    drawCall.shading = shading;
+
+    drawCalls.push_back(drawCall);
+
+    rasterizedROI = Rect();
+}
+
+uint32_t CPURasterizer::packColor(const Vec3f& color)
+{
+    // the same rounding as for the 8 bit color attachment in OpenGL
+    Vec4b rgba(saturate_cast<uchar>(color[0] * 255.0f),
+               saturate_cast<uchar>(color[1] * 255.0f),
+               saturate_cast<uchar>(color[2] * 255.0f),
+               255);
+
+    uint32_t packed;
+    memcpy(&packed, rgba.val, sizeof(packed));
+
+    return packed;
+}
+
+void CPURasterizer::setupTriangle(const Vec4d clip[3],
+                                  uint32_t color,
+                                  const Size& size,
+                                  const Rect& roi,
+                                  float depthSign,
+                                  vector<Triangle>& triangles)
+{
+    int c0 = outCode(clip[0]);
+    int c1 = outCode(clip[1]);
+    int c2 = outCode(clip[2]);
+
+    // all corners are outside of the same frustum plane
+    if (c0 & c1 & c2)
+        return;
+
+    // clip the triangle against all planes it intersects
+    Vec4d polygon[2][9];
+    int n = 3;
+    int in = 0;
+
+    polygon[0][0] = clip[0];
+    polygon[0][1] = clip[1];
+    polygon[0][2] = clip[2];
+
+    int codes = c0 | c1 | c2;
+    for (int plane = 0; plane < 6; plane++)
+    {
+        if (!(codes & (1 << plane)))
+            continue;
+
+        const Vec4d* src = polygon[in];
+        Vec4d* dst = polygon[1 - in];
+        int m = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            const Vec4d& a = src[i];
+            const Vec4d& b = src[(i + 1) % n];
+
+            double da = planeDistance(a, plane);
+            double db = planeDistance(b, plane);
+
+            if (da >= 0)
+                dst[m++] = a;
+            if ((da >= 0) != (db >= 0))
+                dst[m++] = a + (b - a) * (da / (da - db));
+        }
+
+        n = m;
+        in = 1 - in;
+
+        if (n < 3)
+            return;
+    }
+
+    // transform into window coordinates with 8 bit sub-pixel precision and
+    // window depths wrt the depth range [1, 0]
+    int64_t x[9], y[9];
+    double d[9];
+
+    for (int i = 0; i < n; i++)
+    {
+        const Vec4d& p = polygon[in][i];
+
+        double invW = 1.0 / p[3];
+
+        x[i] = llround((p[0] * invW + 1.0) * 0.5 * size.width * 256.0);
+        y[i] = llround((p[1] * invW + 1.0) * 0.5 * size.height * 256.0);
+        d[i] = (p[3] - p[2]) * 0.5 * invW;
+    }
+
+    // triangulate the clipped polygon as a fan
+    for (int k = 1; k + 1 < n; k++)
+    {
+        int v[3] = {0, k, k + 1};
+
+        int64_t area = (x[v[1]] - x[v[0]]) * (y[v[2]] - y[v[0]]) -
+                       (x[v[2]] - x[v[0]]) * (y[v[1]] - y[v[0]]);
+
+        if (area == 0)
+            continue;
+
+        // orient all triangles counter-clockwise
+        if (area < 0)
+            swap(v[1], v[2]);
+
+        int64_t xMin = min(x[v[0]], min(x[v[1]], x[v[2]]));
+        int64_t xMax = max(x[v[0]], max(x[v[1]], x[v[2]]));
+        int64_t yMin = min(y[v[0]], min(y[v[1]], y[v[2]]));
+        int64_t yMax = max(y[v[0]], max(y[v[1]], y[v[2]]));
+
+        // the pixels whose centers lie within the bounding box
+        Triangle t;
+        t.xMin = (int)max((int64_t)roi.x, -floorDiv(128 - xMin, 256));
+        t.xMax = (int)min((int64_t)roi.x + roi.width - 1,
+                          floorDiv(xMax - 128, 256));
+        t.yMin = (int)max((int64_t)roi.y, -floorDiv(128 - yMin, 256));
+        t.yMax = (int)min((int64_t)roi.y + roi.height - 1,
+                          floorDiv(yMax - 128, 256));
+
+        if (t.xMin > t.xMax || t.yMin > t.yMax)
+            continue;
+
+        for (int e = 0; e < 3; e++)
+        {
+            int a = v[e];
+            int b = v[(e + 1) % 3];
+
+            t.A[e] = y[a] - y[b];
+            t.B[e] = x[b] - x[a];
+            t.C[e] = -(t.A[e] * x[a] + t.B[e] * y[a]);
+
+            // pixel centers exactly on an edge are only covered by the
+            // triangle on its left or top side, so that shared edges are
+            // rasterized exactly once
+            if (!(t.A[e] > 0 || (t.A[e] == 0 && t.B[e] < 0)))
+                t.C[e] -= 1;
+        }
+
+        // the plane of window depths wrt the snapped corners in pixels
+        double x0 = x[v[0]] / 256.0, y0 = y[v[0]] / 256.0, d0 = d[v[0]];
+        double x1 = x[v[1]] / 256.0 - x0, y1 = y[v[1]] / 256.0 - y0;
+        double x2 = x[v[2]] / 256.0 - x0, y2 = y[v[2]] / 256.0 - y0;
+        double d1 = d[v[1]] - d0, d2 = d[v[2]] - d0;
+
+        double det = x1 * y2 - x2 * y1;
+        double depthDx = (d1 * y2 - d2 * y1) / det;
+        double depthDy = (x1 * d2 - x2 * d1) / det;
+
+        double depth = d0 + depthDx * (t.xMin + 0.5 - x0) +
+                       depthDy * (t.yMin + 0.5 - y0);
+
+        t.depth = (float)(depthSign * depth);
+        t.depthDx = (float)(depthSign * depthDx);
+        t.depthDy = (float)(depthSign * depthDy);
+
+        t.color = color;
+
+        triangles.push_back(t);
+    }
+}
+
+void CPURasterizer::rasterize(const Rect& roi)
+{
+    Rect r = roi & Rect(0, 0, size.width, size.height);
+
+    // the region has already been rasterized since the last change
+    if (r.area() == 0 || (r & rasterizedROI) == r)
+        return;
+
+    float depthSign = invertDepth ? -1.0f : 1.0f;
+
+    triangleLists.resize(drawCalls.size() * threads);
+
+    for (size_t i = 0; i < drawCalls.size(); i++)
+    {
+        const DrawCall& drawCall = drawCalls[i];
+
+        parallel_for_(
+            cv::Range(0, threads),
+            Parallel_For_transformVertices(*drawCall.vertices,
+                                           clipVertices,
+                                           drawCall.modelViewProjectionMatrix,
+                                           threads));
+
+        vector<Triangle>* lists = &triangleLists[i * threads];
+        for (int t = 0; t < threads; t++)
+        {
+            lists[t].clear();
+        }
+
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_setupTriangles(*drawCall.vertices,
+                                                  *drawCall.indices,
+                                                  clipVertices,
+                                                  drawCall.normalMatrix,
+                                                  drawCall.color,
+                                                  drawCall.shading,
+                                                  size,
+                                                  r,
+                                                  depthSign,
+                                                  lists,
+                                                  threads));
+    }
+
+    // the clear depth is 0 and 1 for the inverted depth test
+    float clearDepth = invertDepth ? -1.0f : 0.0f;
+
+    parallel_for_(cv::Range(0, threads),
+                  Parallel_For_rasterizeTriangles(depthBuffer,
+                                                  colorBuffer,
+                                                  triangleLists,
+                                                  r,
+                                                  clearDepth,
+                                                  threads));
+
+    rasterizedROI = r;
+}
+
+void CPURasterizer::readMask(const Rect& roi, Mat& dst)
+{
+    rasterize(roi);
+
+    for (int y = 0; y < roi.height; y++)
+    {
+        const Vec4b* colorRow = colorBuffer.ptr<Vec4b>(roi.y + y) + roi.x;
+        uchar* dstRow = dst.ptr<uchar>(y);
+
+        for (int x = 0; x < roi.width; x++)
+        {
+            dstRow[x] = colorRow[x][0];
+        }
+    }
+}
+
+void CPURasterizer::readColor(const Rect& roi, Mat& dst)
+{
+    rasterize(roi);
+
+    bool normalized = dst.depth() == CV_32F;
+
+    for (int y = 0; y < roi.height; y++)
+    {
+        const Vec4b* colorRow = colorBuffer.ptr<Vec4b>(roi.y + y) + roi.x;
+
+        for (int x = 0; x < roi.width; x++)
+        {
+            const Vec4b& c = colorRow[x];
+            if (normalized)
+            {
+                dst.at<Vec3f>(y, x) =
+                    Vec3f(c[0] / 255.0f, c[1] / 255.0f, c[2] / 255.0f);
+            }
+            else
+            {
+                dst.at<Vec3b>(y, x) = Vec3b(c[0], c[1], c[2]);
+            }
+        }
+    }
+}
+
+void CPURasterizer::readDepth(const Rect& roi, Mat& dst)
+{
+    rasterize(roi);
+
+    float depthSign = invertDepth ? -1.0f : 1.0f;
+
+    for (int y = 0; y < roi.height; y++)
+    {
+        const float* depthRow = depthBuffer.ptr<float>(roi.y + y) + roi.x;
+        float* dstRow = dst.ptr<float>(y);
+
+        for (int x = 0; x < roi.width; x++)
+        {
+            dstRow[x] = depthSign * depthRow[x];
+        }
+    }
+}
@@ -0,0 +1,556 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CPU_RASTERIZER_H
+#define CPU_RASTERIZER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "trace.h"
+
+/**
+ *  This class implements a multi-threaded software rasterizer for triangle
+ *  meshes that serves as an alternative to the OpenGL-based rendering on
+ *  machines without a GPU. It follows the conventions of the OpenGL pipeline
+ *  of the RenderingEngine, i.e. the same clipping, pixel centers, color
+ *  quantization and window space depth values (with an inverted depth range),
+ *  such that the resulting masks and depth maps can be used interchangeably.
+ *  Drawn meshes are only recorded and get rasterized lazily within the region
+ *  of interest of the first read access, so that only the pixels that are
+ *  actually needed are computed. This region is split into row tiles that are
+ *  rasterized in parallel, where each tile traverses the triangles in drawing
+ *  order and fills horizontal spans that are computed exactly from edge
+ *  functions in 8 bit sub-pixel fixed point.
+ */
+class CPURasterizer
+{
+  public:
+    enum Shading
+    {
+        CONSTANT,
+        SHADED,
+        NORMALS
+    };
+
+    /**
+     *  A triangle in window coordinates, clipped to the view frustum and
+     * ready to be rasterized within a region of interest.
+     */
+    struct Triangle
+    {
+        // edge functions A * x + B * y + C >= 0 in sub-pixel coordinates
+        int64_t A[3], B[3], C[3];
+
+        // the covered pixel bounding box within the region of interest
+        int xMin, xMax, yMin, yMax;
+
+        // the depth plane relative to the center of pixel (xMin, yMin)
+        float depth, depthDx, depthDy;
+
+        // the RGBA color packed in memory order
+        uint32_t color;
+    };
+
+    /**
+     *  Constructor of a rasterizer with empty frame buffers.
+     *
+     *  @param  threads The number of row tiles rasterized in parallel
+     * (default = 8).
+     */
+    CPURasterizer(int threads = 8);
+
+    /**
+     *  Starts a new frame of a given size by discarding all recorded meshes.
+     * The buffers are cleared lazily once a region of them is read.
+     *
+     *  @param  size The size of the frame in pixels.
+     *  @param  invertDepth Whether the depth test is inverted, such that the
+     * farthest surfaces are kept, as in RenderingEngine::renderSilhouette().
+     */
+    void clear(const cv::Size& size, bool invertDepth);
+
+    /**
+     *  Records a triangle mesh to be rasterized into the current frame. The
+     * vertex and index data are referenced and must not be modified until
+     * the frame has been read.
+     *
+     *  @param  vertices The vertices of the mesh in model coordinates.
+     *  @param  indices Three vertex indices per triangle.
+     *  @param  modelViewMatrix The OpenGL model view matrix of the mesh.
+     *  @param  projectionMatrix The OpenGL projection matrix.
+     *  @param  color The RGB color of the mesh with intensities in [0, 1].
+     *  @param  shading Whether the color is constant, shaded with a light at
+     * the camera or replaced by the face normals (default = CONSTANT).
+     */
+    void drawMesh(const std::vector<cv::Vec3f>& vertices,
+                  const std::vector<unsigned int>& indices,
+                  const cv::Matx44f& modelViewMatrix,
+                  const cv::Matx44f& projectionMatrix,
+                  const cv::Vec3f& color,
+                  Shading shading = CONSTANT);
+
+    /**
+     *  Rasterizes the current frame within a region of interest if necessary
+     * and copies the red channel of its colors into a single channel image.
+     *
+     *  @param  roi The region of interest within the frame.
+     *  @param  dst The CV_8UC1 image of the size of the region to copy into.
+     */
+    void readMask(const cv::Rect& roi, cv::Mat& dst);
+
+    /**
+     *  Rasterizes the current frame within a region of interest if necessary
+     * and copies its RGB colors into an image.
+     *
+     *  @param  roi The region of interest within the frame.
+     *  @param  dst The CV_8UC3 or CV_32FC3 image of the size of the region to
+     * copy into, float intensities are normalized to [0, 1].
+     */
+    void readColor(const cv::Rect& roi, cv::Mat& dst);
+
+    /**
+     *  Rasterizes the current frame within a region of interest if necessary
+     * and copies its window space depth values into an image.
+     *
+     *  @param  roi The region of interest within the frame.
+     *  @param  dst The CV_32FC1 image of the size of the region to copy into.
+     */
+    void readDepth(const cv::Rect& roi, cv::Mat& dst);
+
+    /**
+     *  Clips a triangle given in homogeneous clip coordinates against the
+     * view frustum and appends the resulting triangles that cover any pixels
+     * within the region of interest to a list.
+     *
+     *  @param  clip The clip coordinates of the three corners.
+     *  @param  color The packed RGBA color of the triangle.
+     *  @param  size The size of the frame in pixels.
+     *  @param  roi The region of interest within the frame.
+     *  @param  depthSign 1 for the regular and -1 for the inverted depth test.
+     *  @param  triangles The list the triangles are appended to.
+     */
+    static void setupTriangle(const cv::Vec4d clip[3],
+                              uint32_t color,
+                              const cv::Size& size,
+                              const cv::Rect& roi,
+                              float depthSign,
+                              std::vector<Triangle>& triangles);
+
+    /**
+     *  Packs an RGB color with intensities in [0, 1] into an opaque RGBA
+     * color in memory order, quantized like an OpenGL color attachment.
+     *
+     *  @param  color The RGB color.
+     *
+     *  @return  The packed color.
+     */
+    static uint32_t packColor(const cv::Vec3f& color);
+
+  private:
+    struct DrawCall
+    {
+        const std::vector<cv::Vec3f>* vertices;
+        const std::vector<unsigned int>* indices;
+        cv::Matx44d modelViewProjectionMatrix;
+        cv::Matx33f normalMatrix;
+        cv::Vec3f color;
+        Shading shading;
+    };
+
+    int threads;
+
+    cv::Size size;
+
+    bool invertDepth;
+
+    std::vector<DrawCall> drawCalls;
+
+    // the region of the buffers that is up to date with the drawn meshes
+    cv::Rect rasterizedROI;
+
+    // the depth buffer stores the depth values multiplied by the sign of the
+    // depth test, such that closer fragments always have greater values
+    cv::Mat depthBuffer;
+    cv::Mat colorBuffer;
+
+    std::vector<cv::Vec4d> clipVertices;
+
+    // one list per draw call and thread to retain the drawing order
+    std::vector<std::vector<Triangle>> triangleLists;
+
+    void rasterize(const cv::Rect& roi);
+};
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, the vertices of a mesh are
+ *  transformed into homogeneous clip coordinates.
+ */
+class Parallel_For_transformVertices : public cv::ParallelLoopBody
+{
+  private:
+    const cv::Vec3f* verticesData;
+
+    cv::Vec4d* clipData;
+
+    int numVertices;
+
+    cv::Matx44d _modelViewProjectionMatrix;
+
+    int _threads;
+
+  public:
+    Parallel_For_transformVertices(const std::vector<cv::Vec3f>& vertices,
+                                   std::vector<cv::Vec4d>& clipVertices,
+                                   const cv::Matx44d& modelViewProjectionMatrix,
+                                   int threads)
+    {
+        clipVertices.resize(vertices.size());
+
+        verticesData = vertices.data();
+        clipData = clipVertices.data();
+
+        numVertices = (int)vertices.size();
+
+        _modelViewProjectionMatrix = modelViewProjectionMatrix;
+
+        _threads = threads;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_transformVertices");
+
+        int range = numVertices / _threads;
+
+        int iEnd = r.end * range;
+        if (r.end == _threads)
+        {
+            iEnd = numVertices;
+        }
+
+        const cv::Matx44d& M = _modelViewProjectionMatrix;
+
+        for (int i = r.start * range; i < iEnd; i++)
+        {
+            const cv::Vec3f& v = verticesData[i];
+
+            clipData[i] = cv::Vec4d(
+                M(0, 0) * v[0] + M(0, 1) * v[1] + M(0, 2) * v[2] + M(0, 3),
+                M(1, 0) * v[0] + M(1, 1) * v[1] + M(1, 2) * v[2] + M(1, 3),
+                M(2, 0) * v[0] + M(2, 1) * v[1] + M(2, 2) * v[2] + M(2, 3),
+                M(3, 0) * v[0] + M(3, 1) * v[1] + M(3, 2) * v[2] + M(3, 3));
+        }
+    }
+};
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, the triangles of a mesh
+ *  are shaded, clipped and set up for rasterization within a region of
+ *  interest, with a separate output list per thread.
+ */
+class Parallel_For_setupTriangles : public cv::ParallelLoopBody
+{
+  private:
+    const cv::Vec3f* verticesData;
+
+    const unsigned int* indicesData;
+
+    const cv::Vec4d* clipData;
+
+    int numTriangles;
+
+    cv::Matx33f _normalMatrix;
+
+    cv::Vec3f _color;
+
+    CPURasterizer::Shading _shading;
+
+    cv::Size _size;
+
+    cv::Rect _roi;
+
+    float _depthSign;
+
+    std::vector<CPURasterizer::Triangle>* _triangleLists;
+
+    int _threads;
+
+  public:
+    Parallel_For_setupTriangles(const std::vector<cv::Vec3f>& vertices,
+                                const std::vector<unsigned int>& indices,
+                                const std::vector<cv::Vec4d>& clipVertices,
+                                const cv::Matx33f& normalMatrix,
+                                const cv::Vec3f& color,
+                                CPURasterizer::Shading shading,
+                                const cv::Size& size,
+                                const cv::Rect& roi,
+                                float depthSign,
+                                std::vector<CPURasterizer::Triangle>* lists,
+                                int threads)
+    {
+        verticesData = vertices.data();
+        indicesData = indices.data();
+        clipData = clipVertices.data();
+
+        numTriangles = (int)indices.size() / 3;
+
+        _normalMatrix = normalMatrix;
+        _color = color;
+        _shading = shading;
+
+        _size = size;
+        _roi = roi;
+
+        _depthSign = depthSign;
+
+        _triangleLists = lists;
+
+        _threads = threads;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_setupTriangles");
+
+        int range = numTriangles / _threads;
+
+        cv::Vec4d clip[3];
+
+        for (int t = r.start; t < r.end; t++)
+        {
+            std::vector<CPURasterizer::Triangle>& triangles =
+                _triangleLists[t];
+
+            int iEnd = (t + 1) * range;
+            if (t + 1 == _threads)
+            {
+                iEnd = numTriangles;
+            }
+
+            for (int i = t * range; i < iEnd; i++)
+            {
+                const unsigned int* idx = indicesData + 3 * i;
+
+                clip[0] = clipData[idx[0]];
+                clip[1] = clipData[idx[1]];
+                clip[2] = clipData[idx[2]];
+
+                uint32_t color = shadeTriangle(idx);
+
+                CPURasterizer::setupTriangle(
+                    clip, color, _size, _roi, _depthSign, triangles);
+            }
+        }
+    }
+
+  private:
+    uint32_t shadeTriangle(const unsigned int* idx) const
+    {
+        if (_shading == CPURasterizer::CONSTANT)
+        {
+            return CPURasterizer::packColor(_color);
+        }
+
+        // flat shading wrt the face normal turned towards the camera
+        const cv::Vec3f& v0 = verticesData[idx[0]];
+        cv::Vec3f e1 = verticesData[idx[1]] - v0;
+        cv::Vec3f e2 = verticesData[idx[2]] - v0;
+
+        cv::Vec3f n = _normalMatrix * e1.cross(e2);
+
+        float l = (float)cv::norm(n);
+        n = (l > 0) ? n / l : cv::Vec3f(0, 0, 1);
+        if (n[2] < 0)
+        {
+            n = -n;
+        }
+
+        if (_shading == CPURasterizer::SHADED)
+        {
+            return CPURasterizer::packColor(_color * (0.2f + 0.8f * n[2]));
+        }
+        return CPURasterizer::packColor((n + cv::Vec3f(1, 1, 1)) * 0.5f);
+    }
+};
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, a tile of rows of the
+ *  region of interest is cleared and all triangles overlapping it are
+ *  rasterized into the color and depth buffer in drawing order.
+ */
+class Parallel_For_rasterizeTriangles : public cv::ParallelLoopBody
+{
+  private:
+    float* depthData;
+    uint32_t* colorData;
+
+    int width;
+
+    const std::vector<CPURasterizer::Triangle>* _triangleLists;
+
+    int numLists;
+
+    cv::Rect _roi;
+
+    float _clearDepth;
+
+    int _threads;
+
+  public:
+    Parallel_For_rasterizeTriangles(
+        cv::Mat& depthBuffer,
+        cv::Mat& colorBuffer,
+        const std::vector<std::vector<CPURasterizer::Triangle>>& triangleLists,
+        const cv::Rect& roi,
+        float clearDepth,
+        int threads)
+    {
+        depthData = depthBuffer.ptr<float>();
+        colorData = colorBuffer.ptr<uint32_t>();
+
+        width = depthBuffer.cols;
+
+        _triangleLists = triangleLists.data();
+        numLists = (int)triangleLists.size();
+
+        _roi = roi;
+
+        _clearDepth = clearDepth;
+
+        _threads = threads;
+    }
+
+    static int64_t floorDiv(int64_t a, int64_t b)
+    {
+        int64_t q = a / b;
+        return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_rasterizeTriangles");
+
+        int range = _roi.height / _threads;
+
+        int yStart = _roi.y + r.start * range;
+        int yEnd = _roi.y + r.end * range;
+        if (r.end == _threads)
+        {
+            yEnd = _roi.y + _roi.height;
+        }
+
+        // clear the tile with the background color (0, 0, 0, 1)
+        uint32_t clearColor = CPURasterizer::packColor(cv::Vec3f(0, 0, 0));
+
+        for (int y = yStart; y < yEnd; y++)
+        {
+            float* depthRow = depthData + y * width;
+            uint32_t* colorRow = colorData + y * width;
+
+            for (int x = _roi.x; x < _roi.x + _roi.width; x++)
+            {
+                depthRow[x] = _clearDepth;
+                colorRow[x] = clearColor;
+            }
+        }
+
+        for (int l = 0; l < numLists; l++)
+        {
+            const std::vector<CPURasterizer::Triangle>& triangles =
+                _triangleLists[l];
+
+            for (size_t i = 0; i < triangles.size(); i++)
+            {
+                const CPURasterizer::Triangle& t = triangles[i];
+
+                if (t.yMax < yStart || t.yMin >= yEnd)
+                    continue;
+
+                int y0 = std::max(t.yMin, yStart);
+                int y1 = std::min(t.yMax, yEnd - 1);
+
+                int64_t X = (int64_t)t.xMin * 256 + 128;
+
+                for (int y = y0; y <= y1; y++)
+                {
+                    int64_t Y = (int64_t)y * 256 + 128;
+
+                    // intersect the bounding box with the half-planes of
+                    // all three edges to obtain the exactly covered span
+                    int64_t xl = t.xMin;
+                    int64_t xr = t.xMax;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        int64_t w = t.A[e] * X + t.B[e] * Y + t.C[e];
+                        int64_t step = t.A[e] * 256;
+
+                        if (step > 0)
+                            xl = std::max(xl, t.xMin - floorDiv(w, step));
+                        else if (step < 0)
+                            xr = std::min(xr, t.xMin + floorDiv(w, -step));
+                        else if (w < 0)
+                            xr = xl - 1;
+                    }
+
+                    float* depthRow = depthData + y * width;
+                    uint32_t* colorRow = colorData + y * width;
+
+                    float depthY = t.depth + t.depthDy * (y - t.yMin);
+                    float depthX = depthY + t.depthDx * (xl - t.xMin);
+
+                    for (int x = (int)xl; x <= (int)xr; x++)
+                    {
+                        float depth = depthX + t.depthDx * (x - (int)xl);
+
+                        if (depth > depthRow[x])
+                        {
+                            depthRow[x] = depth;
+                            colorRow[x] = t.color;
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif // CPU_RASTERIZER_H
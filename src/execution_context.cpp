@@ -0,0 +1,123 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "execution_context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+static void pinCurrentThread(int core)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % getNumberOfCPUs(), &cpus);
+
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)core;
+#endif
+}
+
+ExecutionContext::ExecutionContext(int numThreads,
+                                   bool pinThreads,
+                                   int numRelocalizationThreads)
+{
+    this->numThreads = numThreads > 0 ? numThreads : getNumberOfCPUs();
+    this->pinThreads = pinThreads;
+    this->numRelocalizationThreads = std::max(numRelocalizationThreads, 0);
+}
+
+int ExecutionContext::getNumThreads() const
+{
+    return numThreads;
+}
+
+bool ExecutionContext::getPinThreads() const
+{
+    return pinThreads;
+}
+
+int ExecutionContext::getNumRelocalizationThreads() const
+{
+    return numRelocalizationThreads;
+}
+
+int ExecutionContext::getNumPartitions(int size, int minSize) const
+{
+    return std::max(1, std::min(numThreads, size / std::max(1, minSize)));
+}
+
+void ExecutionContext::apply() const
+{
+    setNumThreads(numThreads);
+
+    if (pinThreads)
+    {
+        atomic<int> numArrived(0);
+
+        parallel_for_(cv::Range(0, numThreads),
+                      Parallel_For_pinThreads(&numArrived, numThreads));
+    }
+}
+
+void Parallel_For_pinThreads::operator()(const cv::Range& r) const
+{
+    for (int i = r.start; i < r.end; i++)
+    {
+        _numArrived->fetch_add(1);
+
+        chrono::steady_clock::time_point timeout =
+            chrono::steady_clock::now() + chrono::milliseconds(100);
+
+        while (_numArrived->load() < _threads &&
+               chrono::steady_clock::now() < timeout)
+        {
+            this_thread::yield();
+        }
+
+        pinCurrentThread(i);
+    }
+}
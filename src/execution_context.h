@@ -0,0 +1,146 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef EXECUTION_CONTEXT_H
+#define EXECUTION_CONTEXT_H
+
+#include <atomic>
+
+#include <opencv2/core.hpp>
+
+/**
+ *  This class describes how the tracker runs in parallel, i.e. the number of
+ *  threads of OpenCV's thread pool and whether they are pinned to cores. It
+ *  sizes the partitions of the parallel loops from the number of threads and
+ *  the amount of work instead of always splitting it eight-fold. It also
+ *  tells whether lost objects are relocalized in the background by threads
+ *  of their own.
+ */
+class ExecutionContext
+{
+  public:
+    /**
+     *  Constructor of a context with a given number of threads.
+     *
+     *  @param  numThreads The number of threads that run the parallel loops,
+     * including the calling one (default = 0, i.e. one per logical CPU).
+     *  @param  pinThreads Whether the threads are pinned to cores of their
+     * own when the context is applied (default = false).
+     *  @param  numRelocalizationThreads The number of background threads that
+     * search the templates of lost objects (default = 0, i.e. lost objects are
+     * relocalized within the frame by the threads above).
+     */
+    explicit ExecutionContext(int numThreads = 0,
+                              bool pinThreads = false,
+                              int numRelocalizationThreads = 0);
+
+    /**
+     *  Returns the number of threads that run the parallel loops.
+     *
+     *  @return The number of threads.
+     */
+    int getNumThreads() const;
+
+    /**
+     *  Tells whether the threads are pinned to cores when applying the
+     * context.
+     *
+     *  @return True if the threads are pinned and false otherwise.
+     */
+    bool getPinThreads() const;
+
+    /**
+     *  Returns the number of background threads relocalizing lost objects.
+     *
+     *  @return The number of threads, zero if relocalization is synchronous.
+     */
+    int getNumRelocalizationThreads() const;
+
+    /**
+     *  Returns the number of partitions a parallel loop over the given amount
+     * of work, e.g. image rows, is split into. This is one partition per
+     * thread unless this would result in partitions smaller than minSize.
+     *
+     *  @param  size The amount of work, e.g. the number of rows.
+     *  @param  minSize The smallest amount of work per partition
+     * (default = 16).
+     *  @return The number of partitions, which is at least one.
+     */
+    int getNumPartitions(int size, int minSize = 16) const;
+
+    /**
+     *  Sizes OpenCV's thread pool accordingly and, if enabled, pins every
+     * thread of the pool as well as the calling thread to a core of its own
+     * on a best effort basis. It should be called by the thread that will
+     * estimate the poses.
+     */
+    void apply() const;
+
+  private:
+    int numThreads;
+
+    bool pinThreads;
+
+    int numRelocalizationThreads;
+};
+
+/**
+ *  This class is used to pin all threads of OpenCV's thread pool to cores.
+ *  Every partition waits until all of them are running at the same time, such
+ *  that no two partitions are run by the same thread, and then pins its
+ *  thread to the core of its index. If the pool has fewer threads than
+ *  partitions, the waiting times out and a thread may get pinned more than
+ *  once.
+ */
+class Parallel_For_pinThreads : public cv::ParallelLoopBody
+{
+  private:
+    std::atomic<int>* _numArrived;
+
+    int _threads;
+
+  public:
+    Parallel_For_pinThreads(std::atomic<int>* numArrived, int threads)
+    {
+        _numArrived = numArrived;
+
+        _threads = threads;
+    }
+
+    virtual void operator()(const cv::Range& r) const;
+};
+
+#endif // EXECUTION_CONTEXT_H
@@ -0,0 +1,93 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_arena.h"
+
+using namespace std;
+using namespace cv;
+
+FrameArena::FrameArena()
+{
+    numReallocations = 0;
+}
+
+Mat FrameArena::getMat(int slot, const Size& size, int type)
+{
+    size_t bytes = (size_t)size.area() * CV_ELEM_SIZE(type);
+
+    return Mat(size, type, getBytes(slot, bytes));
+}
+
+uchar* FrameArena::getBytes(int slot, size_t size)
+{
+    if (slot >= (int)buffers.size())
+    {
+        buffers.resize(slot + 1);
+        numReallocations++;
+    }
+
+    Mat& buffer = buffers[slot];
+
+    if (buffer.total() < size)
+    {
+        // grow geometrically to reach the high-water mark in few steps
+        size_t capacity = std::max(size, buffer.total() + buffer.total() / 2);
+
+        buffer.create(1, (int)capacity, CV_8UC1);
+        numReallocations++;
+    }
+
+    return buffer.data;
+}
+
+void FrameArena::reset()
+{
+    numReallocations = 0;
+}
+
+int FrameArena::getNumReallocations()
+{
+    return numReallocations;
+}
+
+size_t FrameArena::getCapacity()
+{
+    size_t capacity = 0;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        capacity += buffers[i].total();
+    }
+    return capacity;
+}
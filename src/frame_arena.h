@@ -0,0 +1,111 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ *  This class implements a simple arena of scratch buffers that are reused
+ *  between frames. Each buffer is identified by a slot index and grows to the
+ *  largest size that has been requested for it so far, such that after a few
+ *  frames no further heap allocations are performed. The number of
+ *  reallocations is counted per frame in order to verify this.
+ */
+class FrameArena
+{
+  public:
+    FrameArena();
+
+    /**
+     *  Returns a continuous matrix of the requested size and type that uses
+     * the memory of the specified slot. The memory is only reallocated if it
+     * is too small for the matrix. Its content is undefined.
+     *
+     *  @param  slot The index of the buffer slot to be used.
+     *  @param  size The size of the matrix.
+     *  @param  type The OpenCV type of the matrix.
+     *  @return A matrix header to the buffer of the slot.
+     */
+    cv::Mat getMat(int slot, const cv::Size& size, int type);
+
+    /**
+     *  Returns a buffer of at least the requested number of elements that
+     * uses the memory of the specified slot. The memory is only reallocated
+     * if it is too small. Its content is undefined.
+     *
+     *  @param  slot The index of the buffer slot to be used.
+     *  @param  count The number of elements of the buffer.
+     *  @return A pointer to the buffer of the slot.
+     */
+    template <typename T> T* getBuffer(int slot, size_t count)
+    {
+        return (T*)getBytes(slot, count * sizeof(T));
+    }
+
+    /**
+     *  Marks the beginning of a new frame. All buffers are kept, only the
+     * reallocation counter is restarted.
+     */
+    void reset();
+
+    /**
+     *  Returns the number of times a slot had to be (re)allocated since the
+     * last call of reset(). Memory allocated outside of the arena is not
+     * counted.
+     *
+     *  @return The number of buffer reallocations in the current frame.
+     */
+    int getNumReallocations();
+
+    /**
+     *  Returns the overall size of all buffers in bytes.
+     *
+     *  @return The memory held by the arena.
+     */
+    size_t getCapacity();
+
+  private:
+    std::vector<cv::Mat> buffers;
+
+    int numReallocations;
+
+    uchar* getBytes(int slot, size_t size);
+};
+
+#endif // FRAME_ARENA_H
@@ -0,0 +1,712 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jacobian_accumulator.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+// the SIMD kernels are only available on x86, other architectures evaluate
+// every pixel with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+
+// the AVX2 kernels are compiled for their target only, the rest of the binary
+// does not require a CPU with AVX2 support
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+    // constants of the Cephes single precision atan and log approximations
+    const float ATAN_T3P8 = 2.414213562373095f;
+    const float ATAN_TP8 = 0.4142135623730950f;
+    const float ATAN_P0 = 8.05374449538e-2f;
+    const float ATAN_P1 = -1.38776856032e-1f;
+    const float ATAN_P2 = 1.99777106478e-1f;
+    const float ATAN_P3 = -3.33329491539e-1f;
+
+    const float LOG_SQRTHF = 0.707106781186547524f;
+    const float LOG_P[9] = {7.0376836292e-2f,
+                            -1.1514610310e-1f,
+                            1.1676998740e-1f,
+                            -1.2420140846e-1f,
+                            1.4249322787e-1f,
+                            -1.6668057665e-1f,
+                            2.0000714765e-1f,
+                            -2.4999993993e-1f,
+                            3.3333331174e-1f};
+    const float LOG_Q1 = -2.12194440e-4f;
+    const float LOG_Q2 = 0.693359375f;
+
+    /**
+     *  Selects b where the mask is set and a otherwise (SSE2 only).
+     */
+    inline __m128 select_ps(__m128 a, __m128 b, __m128 mask)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+    }
+
+    /**
+     *  Computes the arc tangent of four floats.
+     */
+    inline __m128 atan_ps(__m128 x)
+    {
+        __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 sign = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        __m128 one = _mm_set1_ps(1.0f);
+
+        __m128 isLarge = _mm_cmpgt_ps(x, _mm_set1_ps(ATAN_T3P8));
+        __m128 isMedium = _mm_andnot_ps(
+            isLarge, _mm_cmpgt_ps(x, _mm_set1_ps(ATAN_TP8)));
+
+        // reduce the argument to [0, tan(pi/8)]
+        __m128 xr = select_ps(
+            x, _mm_div_ps(_mm_sub_ps(x, one), _mm_add_ps(x, one)), isMedium);
+        xr = select_ps(xr, _mm_div_ps(_mm_set1_ps(-1.0f), x), isLarge);
+
+        __m128 y = _mm_and_ps(isMedium, _mm_set1_ps(float(CV_PI / 4.0)));
+        y = select_ps(y, _mm_set1_ps(float(CV_PI / 2.0)), isLarge);
+
+        __m128 z = _mm_mul_ps(xr, xr);
+        __m128 p = _mm_set1_ps(ATAN_P0);
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_P1));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_P2));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_P3));
+        p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), xr), xr);
+
+        return _mm_xor_ps(_mm_add_ps(y, p), sign);
+    }
+
+    /**
+     *  Computes the natural logarithm of four positive floats.
+     */
+    inline __m128 log_ps(__m128 x)
+    {
+        __m128 one = _mm_set1_ps(1.0f);
+
+        x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000)));
+
+        // split into exponent and mantissa in [0.5, 1)
+        __m128i emm0 = _mm_srli_epi32(_mm_castps_si128(x), 23);
+        emm0 = _mm_sub_epi32(emm0, _mm_set1_epi32(0x7f));
+        __m128 e = _mm_add_ps(_mm_cvtepi32_ps(emm0), one);
+
+        x = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(~0x7f800000)));
+        x = _mm_or_ps(x, _mm_set1_ps(0.5f));
+
+        __m128 mask = _mm_cmplt_ps(x, _mm_set1_ps(LOG_SQRTHF));
+        __m128 tmp = _mm_and_ps(x, mask);
+        x = _mm_sub_ps(x, one);
+        e = _mm_sub_ps(e, _mm_and_ps(one, mask));
+        x = _mm_add_ps(x, tmp);
+
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 y = _mm_set1_ps(LOG_P[0]);
+        for (int n = 1; n < 9; n++)
+        {
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG_P[n]));
+        }
+        y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+        y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(LOG_Q1)));
+        y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+
+        x = _mm_add_ps(x, y);
+        return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(LOG_Q2)));
+    }
+
+    /**
+     *  Computes the arc tangent of eight floats.
+     */
+    TARGET_AVX2 inline __m256 atan256_ps(__m256 x)
+    {
+        __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+        __m256 sign = _mm256_and_ps(x, signMask);
+        x = _mm256_andnot_ps(signMask, x);
+
+        __m256 one = _mm256_set1_ps(1.0f);
+
+        __m256 isLarge =
+            _mm256_cmp_ps(x, _mm256_set1_ps(ATAN_T3P8), _CMP_GT_OQ);
+        __m256 isMedium = _mm256_andnot_ps(
+            isLarge, _mm256_cmp_ps(x, _mm256_set1_ps(ATAN_TP8), _CMP_GT_OQ));
+
+        // reduce the argument to [0, tan(pi/8)]
+        __m256 xr = _mm256_blendv_ps(
+            x,
+            _mm256_div_ps(_mm256_sub_ps(x, one), _mm256_add_ps(x, one)),
+            isMedium);
+        xr = _mm256_blendv_ps(
+            xr, _mm256_div_ps(_mm256_set1_ps(-1.0f), x), isLarge);
+
+        __m256 y = _mm256_and_ps(isMedium, _mm256_set1_ps(float(CV_PI / 4.0)));
+        y = _mm256_blendv_ps(y, _mm256_set1_ps(float(CV_PI / 2.0)), isLarge);
+
+        __m256 z = _mm256_mul_ps(xr, xr);
+        __m256 p = _mm256_set1_ps(ATAN_P0);
+        p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ATAN_P1));
+        p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ATAN_P2));
+        p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(ATAN_P3));
+        p = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, z), xr), xr);
+
+        return _mm256_xor_ps(_mm256_add_ps(y, p), sign);
+    }
+
+    /**
+     *  Computes the natural logarithm of eight positive floats.
+     */
+    TARGET_AVX2 inline __m256 log256_ps(__m256 x)
+    {
+        __m256 one = _mm256_set1_ps(1.0f);
+
+        x = _mm256_max_ps(x,
+                          _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000)));
+
+        // split into exponent and mantissa in [0.5, 1)
+        __m256i emm0 = _mm256_srli_epi32(_mm256_castps_si256(x), 23);
+        emm0 = _mm256_sub_epi32(emm0, _mm256_set1_epi32(0x7f));
+        __m256 e = _mm256_add_ps(_mm256_cvtepi32_ps(emm0), one);
+
+        x = _mm256_and_ps(x,
+                          _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000)));
+        x = _mm256_or_ps(x, _mm256_set1_ps(0.5f));
+
+        __m256 mask = _mm256_cmp_ps(x, _mm256_set1_ps(LOG_SQRTHF), _CMP_LT_OQ);
+        __m256 tmp = _mm256_and_ps(x, mask);
+        x = _mm256_sub_ps(x, one);
+        e = _mm256_sub_ps(e, _mm256_and_ps(one, mask));
+        x = _mm256_add_ps(x, tmp);
+
+        __m256 z = _mm256_mul_ps(x, x);
+
+        __m256 y = _mm256_set1_ps(LOG_P[0]);
+        for (int n = 1; n < 9; n++)
+        {
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(LOG_P[n]));
+        }
+        y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+
+        y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(LOG_Q1)));
+        y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+
+        x = _mm256_add_ps(x, y);
+        return _mm256_add_ps(x, _mm256_mul_ps(e, _mm256_set1_ps(LOG_Q2)));
+    }
+
+    /**
+     *  The per batch constants shared by the SSE and AVX2 kernels.
+     */
+    struct JacobianConstants
+    {
+        float fx, fy;
+        float K_inv[4];
+        float zNear, zFar;
+    };
+
+    // the rows of a batch are ordered dist, pYF, pYB, x, y, depth, depthInv,
+    // DsdtDx, DsdtDy
+
+    /**
+     *  Evaluates four pixels of a batch starting at the given lane with SSE
+     * and adds their terms to the corresponding per lane sums.
+     */
+    void accumulateSSE(const float (*batch)[8],
+                       int lane,
+                       const JacobianConstants& c,
+                       float (*JTLanes)[8],
+                       float (*wJTJLanes)[8])
+    {
+        __m128 dist = _mm_load_ps(&batch[0][lane]);
+        __m128 pYF = _mm_load_ps(&batch[1][lane]);
+        __m128 pYB = _mm_load_ps(&batch[2][lane]);
+        __m128 x = _mm_load_ps(&batch[3][lane]);
+        __m128 y = _mm_load_ps(&batch[4][lane]);
+        __m128 DsdtDx = _mm_load_ps(&batch[7][lane]);
+        __m128 DsdtDy = _mm_load_ps(&batch[8][lane]);
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 invPi = _mm_set1_ps(1.0f / float(CV_PI));
+
+        float s = 1.2f;
+        float s2 = s * s;
+
+        // the smoothed Heaviside and dirac delta values
+        __m128 heaviside = _mm_add_ps(
+            _mm_mul_ps(invPi,
+                       _mm_sub_ps(_mm_setzero_ps(),
+                                  atan_ps(_mm_mul_ps(dist, _mm_set1_ps(s))))),
+            _mm_set1_ps(0.5f));
+
+        __m128 dirac = _mm_mul_ps(
+            invPi,
+            _mm_div_ps(_mm_set1_ps(s),
+                       _mm_add_ps(_mm_mul_ps(_mm_mul_ps(dist, _mm_set1_ps(s2)),
+                                             dist),
+                                  one)));
+
+        __m128 pDiff = _mm_sub_ps(pYF, pYB);
+
+        __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(heaviside, pDiff), pYB),
+                              _mm_set1_ps(0.000001f));
+
+        __m128 DlogeDe = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), pDiff), e);
+        __m128 constant_deriv = _mm_mul_ps(DlogeDe, dirac);
+
+        __m128 c2 = _mm_mul_ps(constant_deriv, constant_deriv);
+        __m128 w = _mm_div_ps(_mm_set1_ps(-1.0f), log_ps(e));
+        __m128 wc2 = _mm_mul_ps(w, c2);
+
+        __m128 fx = _mm_set1_ps(c.fx);
+        __m128 fy = _mm_set1_ps(c.fy);
+
+        __m128 DsdtDxFx = _mm_mul_ps(DsdtDx, fx);
+        __m128 DsdtDyFy = _mm_mul_ps(DsdtDy, fy);
+
+        __m128 xn = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c.K_inv[0]), x),
+                               _mm_set1_ps(c.K_inv[1]));
+        __m128 yn = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c.K_inv[2]), y),
+                               _mm_set1_ps(c.K_inv[3]));
+
+        __m128 zNum = _mm_set1_ps(2.0f * c.zNear * c.zFar);
+        __m128 zSum = _mm_set1_ps(c.zFar + c.zNear);
+        __m128 zDiff = _mm_set1_ps(c.zFar - c.zNear);
+
+        // the depth and the inverse depth buffer
+        for (int d = 5; d <= 6; d++)
+        {
+            __m128 depth = _mm_load_ps(&batch[d][lane]);
+
+            __m128 D = _mm_div_ps(
+                zNum,
+                _mm_sub_ps(zSum,
+                           _mm_mul_ps(_mm_sub_ps(_mm_add_ps(depth, depth), one),
+                                      zDiff)));
+
+            __m128 X_c = _mm_mul_ps(D, xn);
+            __m128 Y_c = _mm_mul_ps(D, yn);
+            __m128 Z_c = D;
+
+            __m128 Z_c2 = _mm_mul_ps(Z_c, Z_c);
+
+            __m128 XY_c = _mm_mul_ps(X_c, Y_c);
+
+            __m128 J[6];
+            J[0] = _mm_sub_ps(
+                _mm_mul_ps(
+                    DsdtDy,
+                    _mm_sub_ps(
+                        _mm_div_ps(
+                            _mm_sub_ps(_mm_setzero_ps(),
+                                       _mm_mul_ps(fy, _mm_mul_ps(Y_c, Y_c))),
+                            Z_c2),
+                        fy)),
+                _mm_div_ps(_mm_mul_ps(DsdtDxFx, XY_c), Z_c2));
+            J[1] = _mm_add_ps(
+                _mm_mul_ps(
+                    DsdtDx,
+                    _mm_add_ps(
+                        _mm_div_ps(_mm_mul_ps(fx, _mm_mul_ps(X_c, X_c)), Z_c2),
+                        fx)),
+                _mm_div_ps(_mm_mul_ps(DsdtDyFy, XY_c), Z_c2));
+            J[2] = _mm_sub_ps(_mm_div_ps(_mm_mul_ps(DsdtDyFy, X_c), Z_c),
+                              _mm_div_ps(_mm_mul_ps(DsdtDxFx, Y_c), Z_c));
+            J[3] = _mm_div_ps(DsdtDxFx, Z_c);
+            J[4] = _mm_div_ps(DsdtDyFy, Z_c);
+            J[5] = _mm_sub_ps(
+                _mm_sub_ps(_mm_setzero_ps(),
+                           _mm_div_ps(_mm_mul_ps(DsdtDyFy, Y_c), Z_c2)),
+                _mm_div_ps(_mm_mul_ps(DsdtDxFx, X_c), Z_c2));
+
+            // add the per pixel gradient and Hessian approximation
+            int k = 0;
+            for (int n = 0; n < 6; n++)
+            {
+                __m128 JTn = _mm_load_ps(&JTLanes[n][lane]);
+                JTn = _mm_add_ps(JTn, _mm_mul_ps(constant_deriv, J[n]));
+                _mm_store_ps(&JTLanes[n][lane], JTn);
+
+                __m128 wJn = _mm_mul_ps(wc2, J[n]);
+                for (int m = n; m < 6; m++, k++)
+                {
+                    __m128 wJTJk = _mm_load_ps(&wJTJLanes[k][lane]);
+                    wJTJk = _mm_add_ps(wJTJk, _mm_mul_ps(wJn, J[m]));
+                    _mm_store_ps(&wJTJLanes[k][lane], wJTJk);
+                }
+            }
+        }
+    }
+
+    /**
+     *  Evaluates all eight pixels of a batch with AVX2 and adds their terms
+     * to the per lane sums.
+     */
+    TARGET_AVX2 void accumulateAVX2(const float (*batch)[8],
+                                    const JacobianConstants& c,
+                                    float (*JTLanes)[8],
+                                    float (*wJTJLanes)[8])
+    {
+        __m256 zero = _mm256_setzero_ps();
+
+        __m256 dist = _mm256_load_ps(batch[0]);
+        __m256 pYF = _mm256_load_ps(batch[1]);
+        __m256 pYB = _mm256_load_ps(batch[2]);
+        __m256 x = _mm256_load_ps(batch[3]);
+        __m256 y = _mm256_load_ps(batch[4]);
+        __m256 DsdtDx = _mm256_load_ps(batch[7]);
+        __m256 DsdtDy = _mm256_load_ps(batch[8]);
+
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 invPi = _mm256_set1_ps(1.0f / float(CV_PI));
+
+        float s = 1.2f;
+        float s2 = s * s;
+
+        // the smoothed Heaviside and dirac delta values
+        __m256 heaviside = _mm256_add_ps(
+            _mm256_mul_ps(
+                invPi,
+                _mm256_sub_ps(zero,
+                              atan256_ps(_mm256_mul_ps(dist,
+                                                       _mm256_set1_ps(s))))),
+            _mm256_set1_ps(0.5f));
+
+        __m256 dirac = _mm256_mul_ps(
+            invPi,
+            _mm256_div_ps(
+                _mm256_set1_ps(s),
+                _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_mul_ps(dist, _mm256_set1_ps(s2)),
+                                  dist),
+                    one)));
+
+        __m256 pDiff = _mm256_sub_ps(pYF, pYB);
+
+        __m256 e = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(heaviside, pDiff), pYB),
+            _mm256_set1_ps(0.000001f));
+
+        __m256 DlogeDe = _mm256_div_ps(_mm256_sub_ps(zero, pDiff), e);
+        __m256 constant_deriv = _mm256_mul_ps(DlogeDe, dirac);
+
+        __m256 c2 = _mm256_mul_ps(constant_deriv, constant_deriv);
+        __m256 w = _mm256_div_ps(_mm256_set1_ps(-1.0f), log256_ps(e));
+        __m256 wc2 = _mm256_mul_ps(w, c2);
+
+        __m256 fx = _mm256_set1_ps(c.fx);
+        __m256 fy = _mm256_set1_ps(c.fy);
+
+        __m256 DsdtDxFx = _mm256_mul_ps(DsdtDx, fx);
+        __m256 DsdtDyFy = _mm256_mul_ps(DsdtDy, fy);
+
+        __m256 xn = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c.K_inv[0]), x),
+                                  _mm256_set1_ps(c.K_inv[1]));
+        __m256 yn = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c.K_inv[2]), y),
+                                  _mm256_set1_ps(c.K_inv[3]));
+
+        __m256 zNum = _mm256_set1_ps(2.0f * c.zNear * c.zFar);
+        __m256 zSum = _mm256_set1_ps(c.zFar + c.zNear);
+        __m256 zDiff = _mm256_set1_ps(c.zFar - c.zNear);
+
+        // the depth and the inverse depth buffer
+        for (int d = 5; d <= 6; d++)
+        {
+            __m256 depth = _mm256_load_ps(batch[d]);
+
+            __m256 D = _mm256_div_ps(
+                zNum,
+                _mm256_sub_ps(
+                    zSum,
+                    _mm256_mul_ps(
+                        _mm256_sub_ps(_mm256_add_ps(depth, depth), one),
+                        zDiff)));
+
+            __m256 X_c = _mm256_mul_ps(D, xn);
+            __m256 Y_c = _mm256_mul_ps(D, yn);
+            __m256 Z_c = D;
+
+            __m256 Z_c2 = _mm256_mul_ps(Z_c, Z_c);
+
+            __m256 XY_c = _mm256_mul_ps(X_c, Y_c);
+
+            __m256 J[6];
+            J[0] = _mm256_sub_ps(
+                _mm256_mul_ps(
+                    DsdtDy,
+                    _mm256_sub_ps(
+                        _mm256_div_ps(
+                            _mm256_sub_ps(
+                                zero,
+                                _mm256_mul_ps(fy, _mm256_mul_ps(Y_c, Y_c))),
+                            Z_c2),
+                        fy)),
+                _mm256_div_ps(_mm256_mul_ps(DsdtDxFx, XY_c), Z_c2));
+            J[1] = _mm256_add_ps(
+                _mm256_mul_ps(
+                    DsdtDx,
+                    _mm256_add_ps(
+                        _mm256_div_ps(
+                            _mm256_mul_ps(fx, _mm256_mul_ps(X_c, X_c)), Z_c2),
+                        fx)),
+                _mm256_div_ps(_mm256_mul_ps(DsdtDyFy, XY_c), Z_c2));
+            J[2] =
+                _mm256_sub_ps(_mm256_div_ps(_mm256_mul_ps(DsdtDyFy, X_c), Z_c),
+                              _mm256_div_ps(_mm256_mul_ps(DsdtDxFx, Y_c), Z_c));
+            J[3] = _mm256_div_ps(DsdtDxFx, Z_c);
+            J[4] = _mm256_div_ps(DsdtDyFy, Z_c);
+            J[5] = _mm256_sub_ps(
+                _mm256_sub_ps(
+                    zero, _mm256_div_ps(_mm256_mul_ps(DsdtDyFy, Y_c), Z_c2)),
+                _mm256_div_ps(_mm256_mul_ps(DsdtDxFx, X_c), Z_c2));
+
+            // add the per pixel gradient and Hessian approximation
+            int k = 0;
+            for (int n = 0; n < 6; n++)
+            {
+                __m256 JTn = _mm256_load_ps(JTLanes[n]);
+                JTn = _mm256_add_ps(JTn, _mm256_mul_ps(constant_deriv, J[n]));
+                _mm256_store_ps(JTLanes[n], JTn);
+
+                __m256 wJn = _mm256_mul_ps(wc2, J[n]);
+                for (int m = n; m < 6; m++, k++)
+                {
+                    __m256 wJTJk = _mm256_load_ps(wJTJLanes[k]);
+                    wJTJk = _mm256_add_ps(wJTJk, _mm256_mul_ps(wJn, J[m]));
+                    _mm256_store_ps(wJTJLanes[k], wJTJk);
+                }
+            }
+        }
+    }
+} // namespace
+
+#endif
+
+JacobianAccumulator::JacobianAccumulator(const Matx33f& K,
+                                         float zNear,
+                                         float zFar,
+                                         InstructionSet instructionSet)
+{
+    Matx33f K_invMat = K.inv();
+
+    K_inv[0] = K_invMat(0, 0);
+    K_inv[1] = K_invMat(0, 2);
+    K_inv[2] = K_invMat(1, 1);
+    K_inv[3] = K_invMat(1, 2);
+
+    fx = K(0, 0);
+    fy = K(1, 1);
+
+    this->zNear = zNear;
+    this->zFar = zFar;
+
+    _instructionSet = instructionSet;
+
+    batchFill = 0;
+
+    memset(JTLanes, 0, sizeof(JTLanes));
+    memset(wJTJLanes, 0, sizeof(wJTJLanes));
+    memset(JTScalar, 0, sizeof(JTScalar));
+    memset(wJTJScalar, 0, sizeof(wJTJScalar));
+}
+
+JacobianAccumulator::InstructionSet JacobianAccumulator::getInstructionSet()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const InstructionSet instructionSet =
+        checkHardwareSupport(CV_CPU_AVX2) ? AVX2 : SSE;
+
+    return instructionSet;
+#else
+    return SCALAR;
+#endif
+}
+
+void JacobianAccumulator::processBatch()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    JacobianConstants c = {fx,
+                           fy,
+                           {K_inv[0], K_inv[1], K_inv[2], K_inv[3]},
+                           zNear,
+                           zFar};
+#endif
+
+    switch (_instructionSet)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        case AVX2:
+            accumulateAVX2(batch, c, JTLanes, wJTJLanes);
+            break;
+        case SSE:
+            accumulateSSE(batch, 0, c, JTLanes, wJTJLanes);
+            accumulateSSE(batch, 4, c, JTLanes, wJTJLanes);
+            break;
+#endif
+        default:
+            for (int b = 0; b < batchSize; b++)
+            {
+                accumulatePixel(b, wJTJScalar, JTScalar);
+            }
+            break;
+    }
+
+    batchFill = 0;
+}
+
+void JacobianAccumulator::finish(float* wJTJ, float* JT)
+{
+    // the pixels of an incomplete batch are evaluated one by one
+    for (int b = 0; b < batchFill; b++)
+    {
+        accumulatePixel(b, wJTJ, JT);
+    }
+    batchFill = 0;
+
+    // reduce the per lane sums
+    int k = 0;
+    for (int n = 0; n < 6; n++)
+    {
+        JT[n] += JTScalar[n];
+
+        for (int l = 0; l < batchSize; l++)
+        {
+            JT[n] += JTLanes[n][l];
+        }
+
+        for (int m = n; m < 6; m++, k++)
+        {
+            wJTJ[n * 6 + m] += wJTJScalar[n * 6 + m];
+
+            for (int l = 0; l < batchSize; l++)
+            {
+                wJTJ[n * 6 + m] += wJTJLanes[k][l];
+            }
+        }
+    }
+
+    memset(JTLanes, 0, sizeof(JTLanes));
+    memset(wJTJLanes, 0, sizeof(wJTJLanes));
+    memset(JTScalar, 0, sizeof(JTScalar));
+    memset(wJTJScalar, 0, sizeof(wJTJScalar));
+}
+
+void JacobianAccumulator::accumulatePixel(int b, float* wJTJ, float* JT) const
+{
+    float dist = batch[DIST][b];
+    float pYFVal = batch[PYF][b];
+    float pYBVal = batch[PYB][b];
+    float x = batch[X][b];
+    float y = batch[Y][b];
+    float DsdtDx = batch[DSDT_DX][b];
+    float DsdtDy = batch[DSDT_DY][b];
+
+    float s = 1.2f;
+    float s2 = s * s;
+
+    // the smoothed Heaviside value for this signed distance
+    float heaviside = 1.0f / float(CV_PI) * (-atan(dist * s)) + 0.5f;
+
+    // the corresponding smoothed dirac delta value
+    float dirac = (1.0f / float(CV_PI)) * (s / (dist * s2 * dist + 1.0f));
+
+    // the energy inside the log
+    float e = heaviside * (pYFVal - pYBVal) + pYBVal + 0.000001;
+
+    // the outer derivation
+    float DlogeDe = -(pYFVal - pYBVal) / e;
+    // the constant part of the overall gradient for this image
+    float constant_deriv = DlogeDe * dirac;
+
+    float c2 = constant_deriv * constant_deriv;
+
+    // compute the weighting term for this pixel
+    float w = -1.0f / log(e);
+
+    // the depth and the inverse depth buffer
+    for (int d = DEPTH; d <= DEPTH_INV; d++)
+    {
+        float depth = batch[d][b];
+
+        // compute the Z-distance to the camera from the depth buffer value
+        float D = 2.0f * zNear * zFar /
+                  (zFar + zNear - (2.0f * depth - 1.0) * (zFar - zNear));
+
+        // back-project to camera coordinates
+        float X_c = D * (K_inv[0] * x + K_inv[1]);
+        float Y_c = D * (K_inv[2] * y + K_inv[3]);
+        float Z_c = D;
+
+        float Z_c2 = Z_c * Z_c;
+
+        // compute the Jacobian of the signed distance transform with respect
+        // to the twist coordinates for this pixel
+        float J[6];
+        J[0] = DsdtDy * (-(fy * pow(Y_c, 2)) / Z_c2 - fy) -
+               (DsdtDx * fx * X_c * Y_c) / Z_c2;
+        J[1] = DsdtDx * ((fx * pow(X_c, 2)) / Z_c2 + fx) +
+               (DsdtDy * fy * X_c * Y_c) / Z_c2;
+        J[2] = (DsdtDy * fy * X_c) / Z_c - (DsdtDx * fx * Y_c) / Z_c;
+        J[3] = (DsdtDx * fx) / Z_c;
+        J[4] = (DsdtDy * fy) / Z_c;
+        J[5] = -(DsdtDy * fy * Y_c) / Z_c2 - (DsdtDx * fx * X_c) / Z_c2;
+
+        // compute and add the per pixel gradient
+        for (int n = 0; n < 6; n++)
+        {
+            JT[n] += constant_deriv * J[n];
+        }
+
+        // compute and add the per pixel Hessian approximation
+        for (int n = 0; n < 6; n++)
+        {
+            for (int m = n; m < 6; m++)
+            {
+                wJTJ[n * 6 + m] += w * J[n] * c2 * J[m];
+            }
+        }
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACOBIAN_ACCUMULATOR_H
+#define JACOBIAN_ACCUMULATOR_H
+
+#include <opencv2/core.hpp>
+
+/**
+ *  This class accumulates the per pixel gradient and Hessian approximation
+ *  terms of the region-based cost function required for a Gauss-Newton pose
+ *  update step. The per pixel inputs are collected in batches of eight pixels
+ *  which are evaluated with AVX2 or SSE depending on the instruction sets
+ *  supported by the CPU at runtime, including the smoothed Heaviside and
+ *  dirac delta functions. On other architectures than x86 they are evaluated
+ *  one by one. Only the upper triangle of the Hessian is accumulated.
+ */
+class JacobianAccumulator
+{
+  public:
+    enum InstructionSet
+    {
+        SCALAR,
+        SSE,
+        AVX2
+    };
+
+    /**
+     *  Constructor of an accumulator with all sums set to zero.
+     *
+     *  @param  K The camera's instrinsic matrix at the current pyramid level.
+     *  @param  zNear The near plane used to render the depth maps.
+     *  @param  zFar The far plane used to render the depth maps.
+     *  @param  instructionSet The instruction set to be used for evaluating
+     * the batches (default = the best one supported by the CPU).
+     */
+    JacobianAccumulator(const cv::Matx33f& K,
+                        float zNear,
+                        float zFar,
+                        InstructionSet instructionSet = getInstructionSet());
+
+    /**
+     *  Returns the best instruction set supported by the CPU, which is
+     * SCALAR on other architectures than x86.
+     *
+     *  @return The best supported instruction set.
+     */
+    static InstructionSet getInstructionSet();
+
+    /**
+     *  Adds a single pixel to the accumulated Jacobian terms. The pixel is
+     * buffered and evaluated once a full batch has been collected.
+     *
+     *  @param  dist The signed distance of the pixel to the contour.
+     *  @param  pYF The average foreground posterior of the pixel.
+     *  @param  pYB The average background posterior of the pixel.
+     *  @param  x The x-coordinate of the (closest contour) pixel in the image.
+     *  @param  y The y-coordinate of the (closest contour) pixel in the image.
+     *  @param  depth The depth buffer value of the (closest contour) pixel.
+     *  @param  depthInv The inverse depth buffer value of the (closest
+     * contour) pixel.
+     *  @param  DsdtDx The derivative of the signed distance transform in
+     * x-direction at the pixel.
+     *  @param  DsdtDy The derivative of the signed distance transform in
+     * y-direction at the pixel.
+     */
+    void addPixel(float dist,
+                  float pYF,
+                  float pYB,
+                  float x,
+                  float y,
+                  float depth,
+                  float depthInv,
+                  float DsdtDx,
+                  float DsdtDy)
+    {
+        int b = batchFill++;
+
+        batch[DIST][b] = dist;
+        batch[PYF][b] = pYF;
+        batch[PYB][b] = pYB;
+        batch[X][b] = x;
+        batch[Y][b] = y;
+        batch[DEPTH][b] = depth;
+        batch[DEPTH_INV][b] = depthInv;
+        batch[DSDT_DX][b] = DsdtDx;
+        batch[DSDT_DY][b] = DsdtDy;
+
+        if (batchFill == batchSize)
+        {
+            processBatch();
+        }
+    }
+
+    /**
+     *  Evaluates all remaining buffered pixels and adds the accumulated terms
+     * to the given gradient and upper triangle of the Hessian approximation.
+     *
+     *  @param  wJTJ The 6x6 row-major Hessian approximation to be added to.
+     *  @param  JT The 6x1 gradient to be added to.
+     */
+    void finish(float* wJTJ, float* JT);
+
+  private:
+    enum Input
+    {
+        DIST,
+        PYF,
+        PYB,
+        X,
+        Y,
+        DEPTH,
+        DEPTH_INV,
+        DSDT_DX,
+        DSDT_DY,
+        NUM_INPUTS
+    };
+
+    static const int batchSize = 8;
+
+    alignas(32) float batch[NUM_INPUTS][batchSize];
+
+    // per lane sums of the gradient and of the upper triangle of the Hessian
+    alignas(32) float JTLanes[6][batchSize];
+    alignas(32) float wJTJLanes[21][batchSize];
+
+    // sums of the pixels evaluated without SIMD instructions
+    float JTScalar[6];
+    float wJTJScalar[36];
+
+    int batchFill;
+
+    float fx, fy;
+
+    float K_inv[4];
+
+    float zNear, zFar;
+
+    InstructionSet _instructionSet;
+
+    void processBatch();
+
+    void accumulatePixel(int b, float* wJTJ, float* JT) const;
+};
+
+#endif // JACOBIAN_ACCUMULATOR_H
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <opencv2/core.hpp>
+
+#include "KernelScene.hpp"
+#include "object3d.h"
+#include "optimization_engine.h"
+#include "pose_estimator6d.h"
+#include "rendering_engine.h"
+#include "signed_distance_transform2d.h"
+#include "tclc_histograms.h"
+#include "template_view.h"
+
+// Benchmarks the Parallel_For_* kernels of the tracker in isolation. Their
+// inputs are the example frame and the silhouettes of the models in data/
+// rendered on the CPU at several distances, i.e. region of interest sizes.
+// Every kernel is partitioned like at its call site in the tracker, while
+// the number of threads of OpenCV's pool is swept. Run it from the root of
+// the repository.
+namespace
+{
+    using Scene = fds::KernelScene;
+
+    constexpr auto zNear = Scene::zNear;
+    constexpr auto zFar = Scene::zFar;
+    constexpr auto maxDist = Scene::maxDist;
+    constexpr auto partitions = Scene::partitions;
+
+    // Returns the scene of the benchmark's model and distance, rendering it
+    // the first time, or nullptr if the frame is missing or the model is not
+    // visible.
+    auto getScene(benchmark::State& state) -> Scene*
+    {
+        static auto scenes =
+            std::map<std::pair<int, int>, std::unique_ptr<Scene>>{};
+
+        Scene::initRenderer();
+
+        auto const key = std::pair{static_cast<int>(state.range(0)),
+                                   static_cast<int>(state.range(1))};
+        auto it = scenes.find(key);
+        if (it == scenes.end())
+        {
+            it = scenes.emplace(key, Scene::make(key.first, key.second)).first;
+        }
+
+        cv::setNumThreads(static_cast<int>(state.range(2)));
+
+        if (!it->second)
+        {
+            state.SkipWithError(
+                "no scene, run from the repository root with the model in "
+                "view");
+        }
+        return it->second.get();
+    }
+
+    auto setPixelsProcessed(benchmark::State& state, cv::Size size) -> void
+    {
+        state.SetItemsProcessed(state.iterations() * size.area());
+        state.counters["pixels"] = size.area();
+    }
+
+    auto BM_convertToBins(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto const numBins = scene->object->getTCLCHistograms().getNumBins();
+        auto binned = cv::Mat{};
+
+        for (auto _ : state)
+        {
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_convertToBins(
+                              scene->frame, binned, numBins, partitions));
+            benchmark::DoNotOptimize(binned.data);
+        }
+        setPixelsProcessed(state, scene->frame.size());
+    }
+
+    auto BM_convertToHeaviside(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto heaviside = cv::Mat{};
+
+        for (auto _ : state)
+        {
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_convertToHeaviside(
+                              scene->sdt, heaviside, partitions));
+            benchmark::DoNotOptimize(heaviside.data);
+        }
+        setPixelsProcessed(state, scene->sdt.size());
+    }
+
+    auto BM_buildLocalHistograms(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto& histograms = scene->object->getTCLCHistograms();
+        auto const numCenters = static_cast<int>(scene->centersIDs.size());
+        auto notNormalizedFG = scene->notNormalizedFG.clone();
+        auto notNormalizedBG = scene->notNormalizedBG.clone();
+        auto sumsFB = scene->sumsFB.clone();
+
+        for (auto _ : state)
+        {
+            notNormalizedFG.setTo(0);
+            notNormalizedBG.setTo(0);
+            sumsFB.setTo(0);
+
+            parallel_for_(cv::Range(0, numCenters),
+                          Parallel_For_buildLocalHistograms(
+                              scene->frame,
+                              scene->mask,
+                              scene->centersIDs,
+                              histograms.getRadius(),
+                              histograms.getNumBins(),
+                              notNormalizedFG,
+                              notNormalizedBG,
+                              sumsFB,
+                              scene->object->getModelID(),
+                              numCenters));
+            benchmark::DoNotOptimize(sumsFB.data);
+        }
+        state.SetItemsProcessed(state.iterations() * numCenters);
+        state.counters["centers"] = numCenters;
+    }
+
+    auto BM_mergeLocalHistograms(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        // blend into existing histograms like in steady-state tracking
+        auto const numCenters = static_cast<int>(scene->centersIDs.size());
+        auto const histogramSize = scene->notNormalizedFG.cols;
+        auto normalizedFG = cv::Mat{numCenters, histogramSize, CV_32FC1};
+        auto normalizedBG = cv::Mat{numCenters, histogramSize, CV_32FC1};
+        auto posteriors = cv::Mat{numCenters, histogramSize, CV_32FC1};
+        auto slots = std::vector<int>(numCenters);
+        std::iota(slots.begin(), slots.end(), 0);
+        auto const isNew = std::vector<uchar>(numCenters, 0);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            normalizedFG.setTo(1.0f / histogramSize);
+            normalizedBG.setTo(1.0f / histogramSize);
+            state.ResumeTiming();
+
+            parallel_for_(cv::Range(0, numCenters),
+                          Parallel_For_mergeLocalHistograms(
+                              scene->notNormalizedFG,
+                              scene->notNormalizedBG,
+                              normalizedFG,
+                              normalizedBG,
+                              posteriors,
+                              slots,
+                              isNew,
+                              scene->sumsFB,
+                              0.1f,
+                              0.2f,
+                              numCenters));
+            benchmark::DoNotOptimize(posteriors.data);
+        }
+        state.SetItemsProcessed(state.iterations() * numCenters);
+        state.counters["centers"] = numCenters;
+    }
+
+    auto BM_computeJacobiansGN(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        // the contour pixels split evenly like in
+        // OptimizationEngine::parallel_computeJacobians
+        auto pixels = std::vector<int>(scene->sdt.total());
+        auto const numPixels = Parallel_For_computeJacobiansGN::collectPixels(
+            scene->sdt, pixels.data());
+        auto const threads = std::max(1, std::min(partitions, numPixels / 64));
+        auto JTCollection = std::vector<cv::Matx61f>(threads);
+        auto wJTJCollection = std::vector<cv::Matx66f>(threads);
+
+        for (auto _ : state)
+        {
+            std::fill(
+                JTCollection.begin(), JTCollection.end(), cv::Matx61f::zeros());
+            std::fill(wJTJCollection.begin(),
+                      wJTJCollection.end(),
+                      cv::Matx66f::zeros());
+
+            parallel_for_(cv::Range(0, threads),
+                          Parallel_For_computeJacobiansGN(
+                              &scene->object->getTCLCHistograms(),
+                              scene->frame,
+                              scene->sdt,
+                              scene->xyPos,
+                              scene->croppedDepth,
+                              scene->croppedDepthInv,
+                              Scene::getK(),
+                              zNear,
+                              zFar,
+                              scene->roi,
+                              scene->croppedDepth,
+                              -1,
+                              0,
+                              pixels.data(),
+                              numPixels,
+                              wJTJCollection.data(),
+                              JTCollection.data(),
+                              threads));
+            benchmark::DoNotOptimize(JTCollection.data());
+        }
+        state.SetItemsProcessed(state.iterations() * numPixels);
+        state.counters["pixels"] = numPixels;
+    }
+
+    auto BM_distanceTransformRows(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto const& src = scene->croppedDepth;
+        auto const n = std::max(src.cols, src.rows);
+        auto dd = cv::Mat{src.size(), CV_32SC1};
+        auto xPos = cv::Mat{src.size(), CV_32SC1};
+        auto v = std::vector<int>(partitions * n);
+        auto z = std::vector<int>(partitions * (n + 1));
+
+        for (auto _ : state)
+        {
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_distanceTransformRows<float>(
+                              src, dd, xPos, v.data(), z.data(), partitions));
+            benchmark::DoNotOptimize(dd.data);
+        }
+        setPixelsProcessed(state, src.size());
+    }
+
+    auto BM_distanceTransformCols(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto const& src = scene->croppedDepth;
+        auto const n = std::max(src.cols, src.rows);
+        auto dd = cv::Mat{src.size(), CV_32SC1};
+        auto xPos = cv::Mat{src.size(), CV_32SC1};
+        auto sdt = cv::Mat{src.size(), CV_32FC1};
+        auto xyPos = cv::Mat{src.size(), CV_32SC2};
+        auto v = std::vector<int>(partitions * n);
+        auto z = std::vector<int>(partitions * (n + 1));
+        auto f = std::vector<int>(partitions * n);
+
+        parallel_for_(cv::Range(0, partitions),
+                      Parallel_For_distanceTransformRows<float>(
+                          src, dd, xPos, v.data(), z.data(), partitions));
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            sdt.setTo(0);
+            xyPos.setTo(-1);
+            state.ResumeTiming();
+
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_distanceTransformCols(dd,
+                                                             sdt,
+                                                             xPos,
+                                                             xyPos,
+                                                             maxDist,
+                                                             v.data(),
+                                                             z.data(),
+                                                             f.data(),
+                                                             partitions));
+            benchmark::DoNotOptimize(sdt.data);
+        }
+        setPixelsProcessed(state, src.size());
+    }
+
+    // The narrow band transform the tracker actually uses instead of the
+    // separable rows and columns passes.
+    auto BM_distanceTransformBand(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        auto const& src = scene->croppedDepth;
+        auto sdt = cv::Mat{src.size(), CV_32FC1};
+        auto xyPos = cv::Mat{src.size(), CV_32SC2};
+        auto hPos = std::vector<int>(src.total());
+        auto vPos = std::vector<int>(src.total());
+        auto hCnt = std::vector<int>(src.rows);
+        auto vCnt = std::vector<int>(src.rows);
+        auto d2 = std::vector<int>(partitions * src.cols);
+        auto closest = std::vector<int>(partitions * 3 * src.cols);
+
+        for (auto _ : state)
+        {
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_findContourTransitions<float>(
+                              src,
+                              0,
+                              hPos.data(),
+                              hCnt.data(),
+                              vPos.data(),
+                              vCnt.data(),
+                              partitions));
+            parallel_for_(cv::Range(0, partitions),
+                          Parallel_For_distanceTransformBand<float>(
+                              src,
+                              0,
+                              sdt,
+                              xyPos,
+                              maxDist,
+                              hPos.data(),
+                              hCnt.data(),
+                              vPos.data(),
+                              vCnt.data(),
+                              d2.data(),
+                              closest.data(),
+                              partitions));
+            benchmark::DoNotOptimize(sdt.data);
+        }
+        setPixelsProcessed(state, src.size());
+    }
+
+    auto BM_evaluateEnergy(benchmark::State& state) -> void
+    {
+        auto* scene = getScene(state);
+        if (!scene)
+        {
+            return;
+        }
+
+        // the contour pixels split evenly like in
+        // PoseEstimator6D::evaluateEnergyFunction
+        auto const& roi = scene->energyROI;
+        auto pixels = std::vector<int>(scene->heaviside.total());
+        auto const numPixels =
+            Parallel_For_evaluateEnergy::collectPixels(scene->heaviside,
+                                                       roi.x,
+                                                       roi.y,
+                                                       scene->binned.size(),
+                                                       pixels.data());
+        auto const threads = std::max(1, std::min(partitions, numPixels / 64));
+        auto eCollection = cv::Mat{1, threads, CV_32FC3};
+
+        for (auto _ : state)
+        {
+            eCollection.setTo(0);
+
+            parallel_for_(cv::Range(0, threads),
+                          Parallel_For_evaluateEnergy(
+                              &scene->object->getTCLCHistograms(),
+                              scene->centersIDs,
+                              scene->binned,
+                              scene->heaviside,
+                              roi,
+                              roi.x,
+                              roi.y,
+                              0,
+                              pixels.data(),
+                              numPixels,
+                              eCollection,
+                              threads));
+            benchmark::DoNotOptimize(eCollection.data);
+        }
+        state.SetItemsProcessed(state.iterations() * numPixels);
+        state.counters["pixels"] = numPixels;
+    }
+
+    // models x distances in mm x threads of OpenCV's pool
+    auto sweep(benchmark::internal::Benchmark* benchmark) -> void
+    {
+        auto models = std::vector<std::int64_t>(Scene::getNumModels());
+        std::iota(models.begin(), models.end(), 0);
+
+        benchmark->ArgNames({"model", "distance", "threads"})
+            ->ArgsProduct({models, {400, 800, 1600}, {1, 2, 4, 8}})
+            ->Unit(benchmark::kMicrosecond)
+            ->UseRealTime();
+    }
+} // namespace
+
+BENCHMARK(BM_convertToBins)->Apply(sweep);
+BENCHMARK(BM_convertToHeaviside)->Apply(sweep);
+BENCHMARK(BM_buildLocalHistograms)->Apply(sweep);
+BENCHMARK(BM_mergeLocalHistograms)->Apply(sweep);
+BENCHMARK(BM_computeJacobiansGN)->Apply(sweep);
+BENCHMARK(BM_distanceTransformRows)->Apply(sweep);
+BENCHMARK(BM_distanceTransformCols)->Apply(sweep);
+BENCHMARK(BM_distanceTransformBand)->Apply(sweep);
+BENCHMARK(BM_evaluateEnergy)->Apply(sweep);
+
+BENCHMARK_MAIN();
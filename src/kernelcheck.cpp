@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "KernelScene.hpp"
+#include "jacobian_accumulator.h"
+#include "optimization_engine.h"
+#include "tclc_histograms.h"
+
+// Checks that the SIMD kernels of the JacobianAccumulator agree with its
+// scalar code. For the silhouettes of the models in data/ rendered on the CPU
+// at several distances, Parallel_For_computeJacobiansGN is run with every
+// instruction set the CPU supports. The Hessian approximation and the gradient
+// of each must not differ from the scalar ones by more than the relative
+// tolerance below in the Frobenius norm, which leaves room for the different
+// summation order and the polynomial approximations of atan and log. Run it
+// from the root of the repository, it exits with a failure otherwise.
+namespace
+{
+    using Scene = fds::KernelScene;
+    using InstructionSet = JacobianAccumulator::InstructionSet;
+
+    constexpr auto tolerance = 1e-3;
+
+    auto getName(InstructionSet instructionSet) -> char const*
+    {
+        switch (instructionSet)
+        {
+            case JacobianAccumulator::AVX2:
+                return "AVX2";
+            case JacobianAccumulator::SSE:
+                return "SSE";
+            default:
+                return "SCALAR";
+        }
+    }
+
+    // Accumulates the Jacobian terms of all contour pixels of the scene,
+    // partitioned like in OptimizationEngine::parallel_computeJacobians.
+    auto computeJacobians(Scene& scene,
+                          InstructionSet instructionSet,
+                          cv::Matx66f& wJTJ,
+                          cv::Matx61f& JT) -> void
+    {
+        auto pixels = std::vector<int>(scene.sdt.total());
+        auto const numPixels = Parallel_For_computeJacobiansGN::collectPixels(
+            scene.sdt, pixels.data());
+        auto const threads =
+            std::max(1, std::min(Scene::partitions, numPixels / 64));
+        auto JTCollection =
+            std::vector<cv::Matx61f>(threads, cv::Matx61f::zeros());
+        auto wJTJCollection =
+            std::vector<cv::Matx66f>(threads, cv::Matx66f::zeros());
+
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_computeJacobiansGN(
+                          &scene.object->getTCLCHistograms(),
+                          scene.frame,
+                          scene.sdt,
+                          scene.xyPos,
+                          scene.croppedDepth,
+                          scene.croppedDepthInv,
+                          Scene::getK(),
+                          Scene::zNear,
+                          Scene::zFar,
+                          scene.roi,
+                          scene.croppedDepth,
+                          -1,
+                          0,
+                          pixels.data(),
+                          numPixels,
+                          wJTJCollection.data(),
+                          JTCollection.data(),
+                          threads,
+                          instructionSet));
+
+        wJTJ = cv::Matx66f::zeros();
+        JT = cv::Matx61f::zeros();
+        for (auto i = 0; i < threads; i++)
+        {
+            wJTJ += wJTJCollection[i];
+            JT += JTCollection[i];
+        }
+    }
+
+    template <typename Matx>
+    auto getRelativeError(Matx const& value, Matx const& reference) -> double
+    {
+        auto const norm = cv::norm(reference);
+        return norm > 0.0 ? cv::norm(value - reference) / norm
+                          : cv::norm(value);
+    }
+} // namespace
+
+auto main() -> int
+{
+    Scene::initRenderer();
+
+    auto const best = JacobianAccumulator::getInstructionSet();
+    auto failed = false;
+
+    for (auto model = 0; model < Scene::getNumModels(); model++)
+    {
+        for (auto const distance : {400, 800, 1600})
+        {
+            auto scene = Scene::make(model, distance);
+            if (!scene)
+            {
+                std::cerr << "No scene for model " << model << " at "
+                          << distance
+                          << " mm, run from the repository root with the "
+                             "model in view\n"
+                          << std::flush;
+                return EXIT_FAILURE;
+            }
+
+            auto wJTJScalar = cv::Matx66f{};
+            auto JTScalar = cv::Matx61f{};
+            computeJacobians(
+                *scene, JacobianAccumulator::SCALAR, wJTJScalar, JTScalar);
+
+            for (auto const instructionSet :
+                 {JacobianAccumulator::SSE, JacobianAccumulator::AVX2})
+            {
+                // only the instruction sets supported by the CPU are run
+                if (instructionSet > best)
+                {
+                    continue;
+                }
+
+                auto wJTJ = cv::Matx66f{};
+                auto JT = cv::Matx61f{};
+                computeJacobians(*scene, instructionSet, wJTJ, JT);
+
+                auto const wJTJError = getRelativeError(wJTJ, wJTJScalar);
+                auto const JTError = getRelativeError(JT, JTScalar);
+                auto const passed =
+                    wJTJError <= tolerance && JTError <= tolerance;
+                failed |= !passed;
+
+                std::cout << "model " << model << ", " << distance << " mm, "
+                          << getName(instructionSet)
+                          << ": wJTJ error " << wJTJError << ", JT error "
+                          << JTError << (passed ? "" : " FAILED") << '\n';
+            }
+        }
+    }
+
+    std::cout << (failed ? "The SIMD kernels differ from the scalar code\n"
+                         : "The SIMD kernels agree with the scalar code\n")
+              << std::flush;
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
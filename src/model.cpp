@@ -214,7 +214,7 @@ float Model::getScaling()
     return scaling;
 }
 
-vector<Vec3f> Model::getVertices()
+const vector<Vec3f>& Model::getVertices()
 {
     return vertices;
 }
@@ -224,6 +224,11 @@ int Model::getNumVertices()
     return (int)vertices.size();
 }
 
+const vector<GLuint>& Model::getIndices()
+{
+    return indices;
+}
+
 int Model::getModelID()
 {
     return m_id;
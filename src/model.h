@@ -221,7 +221,7 @@ class Model
      *
      *  @return  A vector containing all unnormalized 3D model verticies.
      */
-    std::vector<cv::Vec3f> getVertices();
+    const std::vector<cv::Vec3f>& getVertices();
 
     /**
      *  Returns the total number of 3D model verticies.
@@ -230,6 +230,14 @@ class Model
      */
     int getNumVertices();
 
+    /**
+     *  Returns a vector containing three vertex indices per triangle of the
+     *  model.
+     *
+     *  @return  A vector containing the vertex indices of all triangles.
+     */
+    const std::vector<GLuint>& getIndices();
+
     /**
      *  Returns the index of the model. These indices should be
      *  unique and within [1,255] as they also define the rendering
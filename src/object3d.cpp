@@ -34,7 +34,14 @@
  */
 
 #include "object3d.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "RecordingFile.hpp"
 #include "tclc_histograms.h"
+#include "template_cache.h"
 #include "template_view.h"
 
 using namespace std;
@@ -58,6 +65,8 @@ Object3D::Object3D(const string objFilename,
     : Model{objFilename, tx, ty, tz, alpha, beta, gamma, scale},
       tclcHistograms{this, 32, 40, 10.0f}
 {
+    this->modelFilename = objFilename;
+
     this->trackingLost = false;
 
     this->qualityThreshold = qualityThreshold;
@@ -66,6 +75,8 @@ Object3D::Object3D(const string objFilename,
 
     this->numDistances = (int)templateDistances.size();
 
+    this->templateCache = nullptr;
+
     // icosahedron geometry for generating the base templates
     baseIcosahedron.push_back(Vec3f(0, 1, 1.61803));
     baseIcosahedron.push_back(Vec3f(1, 1.61803, 0));
@@ -138,6 +149,9 @@ Object3D::~Object3D()
         delete neighboringTemplates[i];
     }
     neighboringTemplates.clear();
+
+    // the loaded templates refer to the memory of the cache
+    delete templateCache;
 }
 
 bool Object3D::isTrackingLost()
@@ -160,12 +174,61 @@ auto Object3D::getTCLCHistograms() noexcept -> TCLCHistograms&
     return tclcHistograms;
 }
 
-void Object3D::generateTemplates()
+void Object3D::setTemplateCacheDirectory(const string& directory)
+{
+    templateCacheDirectory = directory;
+}
+
+void Object3D::generateTemplates(const ExecutionContext& context)
 {
     int numLevels = 4;
 
     int numBaseRotations = 4;
 
+    uint64_t modelHash = 0;
+    if (!templateCacheDirectory.empty())
+    {
+        try
+        {
+            modelHash = fds::hashFile(modelFilename);
+        }
+        catch (const runtime_error& e)
+        {
+            cout << e.what();
+        }
+    }
+
+    if (modelHash != 0)
+    {
+        RenderingEngine* renderingEngine = RenderingEngine::Instance();
+        renderingEngine->setLevel(0);
+
+        TemplateCacheKey key;
+        key.modelHash = modelHash;
+        key.normalization = getNormalization();
+        key.K = renderingEngine->getCalibrationMatrix().get_minor<3, 3>(0, 0);
+        key.frameSize = renderingEngine->getFrameSize();
+        key.zNear = renderingEngine->getZNear();
+        key.zFar = renderingEngine->getZFar();
+        key.backend = RenderingEngine::getBackend();
+        key.numBins = tclcHistograms.getNumBins();
+        key.radius = tclcHistograms.getRadius();
+        key.numHistograms = tclcHistograms.getNumHistograms();
+        key.numLevels = numLevels;
+        key.distances = templateDistances;
+
+        delete templateCache;
+        templateCache = new TemplateCache(
+            templateCacheDirectory,
+            std::filesystem::path(modelFilename).stem().string(),
+            key);
+
+        if (templateCache->load(baseTemplates, neighboringTemplates))
+        {
+            return;
+        }
+    }
+
     // create all base templates
     for (int i = 0; i < baseIcosahedron.size(); i++)
     {
@@ -217,6 +280,17 @@ void Object3D::generateTemplates()
         }
     }
 
+    // the silhouettes have been rendered one after the other on the OpenGL
+    // context, all remaining computations run concurrently on the CPU
+    vector<TemplateView*> templateViews = baseTemplates;
+    templateViews.insert(templateViews.end(),
+                         neighboringTemplates.begin(),
+                         neighboringTemplates.end());
+
+    parallel_for_(cv::Range(0, (int)templateViews.size()),
+                  Parallel_For_postProcessTemplates(templateViews.data()),
+                  context.getNumThreads() * 4);
+
     int gamma2Steps = 360 / gamma2Precision;
 
     // associate each base template with its corresponding neighboring templates
@@ -270,6 +344,13 @@ void Object3D::generateTemplates()
         }
     }
 
+    if (templateCache &&
+        !templateCache->save(baseTemplates, neighboringTemplates))
+    {
+        cout << "error writing the template cache "
+             << templateCache->getFilename() << endl;
+    }
+
     // reset the model to its prescribed initial pose
     Model::reset();
 }
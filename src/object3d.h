@@ -36,9 +36,11 @@
 #ifndef OBJECT3D_H
 #define OBJECT3D_H
 
+#include "execution_context.h"
 #include "model.h"
 #include "tclc_histograms.h"
 
+class TemplateCache;
 class TemplateView;
 
 /**
@@ -124,14 +126,30 @@ class Object3D : public Model
      */
     auto getTCLCHistograms() noexcept -> TCLCHistograms&;
 
+    /**
+     *  Sets the directory in which the generated templates are cached, such
+     *  that they are only generated once for the same model, camera and
+     *  template distances. An empty directory disables the cache (default).
+     *
+     *  @param  directory The directory holding the template cache files.
+     */
+    void setTemplateCacheDirectory(const std::string& directory);
+
     /**
      *  Generates all base and neighboring templates required for
      *  the pose detection algorithm after a tracking loss.
      *  Must be called after the rendering buffers of the
      *  corresponding 3D model have been initialized and while
      *  the offscreen rendering OpenGL context is active.
+     *  If a template cache directory has been set, the templates are
+     *  loaded from it instead whenever possible and written to it
+     *  otherwise.
+     *
+     *  @param  context The execution context used to post-process the
+     * rendered template views in parallel.
      */
-    void generateTemplates();
+    void
+    generateTemplates(const ExecutionContext& context = ExecutionContext());
 
     /**
      *  Returns the set of all pre-generated base and neighboring template views
@@ -157,6 +175,8 @@ class Object3D : public Model
     void reset();
 
   private:
+    std::string modelFilename;
+
     bool trackingLost;
 
     float qualityThreshold;
@@ -172,6 +192,10 @@ class Object3D : public Model
 
     std::vector<TemplateView*> baseTemplates;
     std::vector<TemplateView*> neighboringTemplates;
+
+    std::string templateCacheDirectory;
+
+    TemplateCache* templateCache;
 };
 
 #endif /* OBJECT3D_H */
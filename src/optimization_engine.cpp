@@ -38,11 +38,15 @@
 using namespace std;
 using namespace cv;
 
-OptimizationEngine::OptimizationEngine(int width, int height)
+OptimizationEngine::OptimizationEngine(int width,
+                                       int height,
+                                       const ExecutionContext& context)
 {
     renderingEngine = RenderingEngine::Instance();
 
-    SDT2D = new SignedDistanceTransform2D(8.0f);
+    SDT2D = new SignedDistanceTransform2D(8.0f, true, context);
+
+    this->context = context;
 
     this->width = width;
     this->height = height;
@@ -78,10 +82,24 @@ void OptimizationEngine::minimize(vector<Mat>& imagePyramid,
     }
 }
 
+void OptimizationEngine::resetFrameArena()
+{
+    arena.reset();
+    SDT2D->getFrameArena().reset();
+}
+
+int OptimizationEngine::getNumReallocations()
+{
+    return arena.getNumReallocations() +
+           SDT2D->getFrameArena().getNumReallocations();
+}
+
 void OptimizationEngine::runIteration(vector<Object3D*>& objects,
                                       const vector<Mat>& imagePyramid,
                                       int level)
 {
+    TRACE_SCOPE("OptimizationEngine::runIteration");
+
     Rect roi;
     Mat mask, depth, depthInv, sdt, xyPos;
     Mat croppedMask, croppedDepth, croppedDepthInv;
@@ -117,31 +135,18 @@ void OptimizationEngine::runIteration(vector<Object3D*>& objects,
         }
     }
 
-    // render the common silhouette mask
-    renderingEngine->setLevel(level);
-    renderingEngine->renderSilhouette(
-        vector<Model*>(objects.begin(), objects.end()), GL_FILL);
-
-    // download the depth buffer
-    depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-
-    // if more than one object is initialized, download the common silhouette
-    // mask required for occlusion detection
-    if (numInitialized > 1)
-    {
-        mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-    }
-    else // otherwise for a single object the mask is equal to the depth buffer
-    {
-        mask = depth;
-    }
+    // compute the 2D regions of interest containing the silhouettes of all
+    // objects, only these are downloaded from the GPU
+    vector<size_t>& indices = objectIndices;
+    vector<Rect>& rois = objectROIs;
+    indices.clear();
+    rois.clear();
 
+    Rect roiUnion;
     for (size_t o = 0; o < objects.size(); o++)
     {
         if (objects[o]->isInitialized())
         {
-            // compute the 2D region of interest containing the silhouette of
-            // the current object
             roi = compute2DROI(
                 objects[o],
                 Size(width / pow(2, level), height / pow(2, level)),
@@ -152,44 +157,119 @@ void OptimizationEngine::runIteration(vector<Object3D*>& objects,
                 continue;
             }
 
-            // render the individual inverse depth buffer per object
-            renderingEngine->renderSilhouette(objects[o], GL_FILL, true);
-            depthInv = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
-
-            // crop the images wrt to the 2D roi
-            croppedMask = mask(roi).clone();
-            croppedDepth = depth(roi).clone();
-            croppedDepthInv = depthInv(roi).clone();
-
-            int m_id = (numInitialized <= 1) ? -1 : objects[o]->getModelID();
-
-            // compute the 2D signed distance transform of the silhouette
-            SDT2D->computeTransform(croppedMask, sdt, xyPos, 8, m_id);
-
-            // the hessian approximation
-            Matx66f wJTJ;
-            // the gradient
-            Matx61f JT;
-
-            // compute the Jacobian terms (i.e. the gradient and the hessian
-            // approx.) needed for the Gauss-Newton step
-            parallel_computeJacobians(objects[o],
-                                      imagePyramid[level],
-                                      croppedDepth,
-                                      croppedDepthInv,
-                                      sdt,
-                                      xyPos,
-                                      roi,
-                                      croppedMask,
-                                      m_id,
-                                      level,
-                                      wJTJ,
-                                      JT,
-                                      roi.height);
-
-            // update the pose by computing the Gauss-Newton step
-            applyStepGaussNewton(objects[o], wJTJ, JT);
+            indices.push_back(o);
+            rois.push_back(roi);
+            roiUnion = roiUnion.area() == 0 ? roi : (roiUnion | roi);
+        }
+    }
+
+    {
+        StageTimer timer(STAGE_RENDER);
+
+        // render the common silhouette mask
+        renderingEngine->setLevel(level);
+        objectModels.assign(objects.begin(), objects.end());
+        renderingEngine->renderSilhouette(objectModels, GL_FILL);
+
+        Size frameSize = renderingEngine->getFrameSize();
+
+        depth = arena.getMat(BUFFER_DEPTH, frameSize, CV_32FC1);
+        mask = arena.getMat(BUFFER_MASK, frameSize, CV_8UC1);
+        depthInv = arena.getMat(BUFFER_DEPTH_INV, frameSize, CV_32FC1);
+
+        // download the depth buffer and, if more than one object is
+        // initialized, the common silhouette mask required for occlusion
+        // detection, both asynchronously in parallel
+        renderingEngine->requestFrame(RenderingEngine::DEPTH, roiUnion);
+        if (numInitialized > 1)
+        {
+            renderingEngine->requestFrame(RenderingEngine::MASK, roiUnion);
+        }
+
+        renderingEngine->retrieveFrame(depth);
+        if (numInitialized > 1)
+        {
+            renderingEngine->retrieveFrame(mask);
+        }
+        else // otherwise for a single object the mask equals the depth buffer
+        {
+            mask = depth;
+        }
+    }
+
+    size_t numRequested = 0;
+
+    for (size_t n = 0; n < indices.size(); n++)
+    {
+        size_t o = indices[n];
+        roi = rois[n];
+
+        // render the individual inverse depth buffers per object ahead of
+        // time, such that the GPU renders and copies the next one while the
+        // current object is being processed
+        {
+            StageTimer timer(STAGE_RENDER);
+
+            while (numRequested < indices.size() &&
+                   numRequested < n + RenderingEngine::NUM_PIXEL_BUFFERS)
+            {
+                renderingEngine->renderSilhouette(
+                    objects[indices[numRequested]], GL_FILL, true);
+                renderingEngine->requestFrame(RenderingEngine::DEPTH,
+                                              rois[numRequested]);
+                numRequested++;
+            }
+            renderingEngine->retrieveFrame(depthInv);
+        }
+
+        // crop the images wrt to the 2D roi into the reused buffers
+        croppedMask =
+            arena.getMat(BUFFER_CROPPED_MASK, roi.size(), mask.type());
+        croppedDepth =
+            arena.getMat(BUFFER_CROPPED_DEPTH, roi.size(), depth.type());
+        croppedDepthInv = arena.getMat(
+            BUFFER_CROPPED_DEPTH_INV, roi.size(), depthInv.type());
+
+        mask(roi).copyTo(croppedMask);
+        depth(roi).copyTo(croppedDepth);
+        depthInv(roi).copyTo(croppedDepthInv);
+
+        sdt = arena.getMat(BUFFER_SDT, roi.size(), CV_32FC1);
+        xyPos = arena.getMat(BUFFER_XY_POS, roi.size(), CV_32SC2);
+
+        int m_id = (numInitialized <= 1) ? -1 : objects[o]->getModelID();
+
+        // compute the 2D signed distance transform of the silhouette
+        {
+            StageTimer timer(STAGE_SDT);
+
+            SDT2D->computeTransform(croppedMask, sdt, xyPos, m_id);
         }
+
+        // the hessian approximation
+        Matx66f wJTJ;
+        // the gradient
+        Matx61f JT;
+
+        // compute the Jacobian terms (i.e. the gradient and the hessian
+        // approx.) needed for the Gauss-Newton step
+        StageTimer timer(STAGE_JACOBIANS);
+
+        parallel_computeJacobians(objects[o],
+                                  imagePyramid[level],
+                                  croppedDepth,
+                                  croppedDepthInv,
+                                  sdt,
+                                  xyPos,
+                                  roi,
+                                  croppedMask,
+                                  m_id,
+                                  level,
+                                  wJTJ,
+                                  JT);
+
+        // update the pose by computing the Gauss-Newton step
+        applyStepGaussNewton(objects[o], wJTJ, JT);
     }
 }
 
@@ -204,8 +284,7 @@ void OptimizationEngine::parallel_computeJacobians(Object3D* object,
                                                    int m_id,
                                                    int level,
                                                    Matx66f& wJTJ,
-                                                   Matx61f& JT,
-                                                   int threads)
+                                                   Matx61f& JT)
 {
     float zNear = renderingEngine->getZNear();
     float zFar = renderingEngine->getZFar();
@@ -214,8 +293,20 @@ void OptimizationEngine::parallel_computeJacobians(Object3D* object,
     JT = Matx61f::zeros();
     wJTJ = Matx66f::zeros();
 
-    vector<Matx61f> JTCollection(threads);
-    vector<Matx66f> wJTJCollection(threads);
+    // only the pixels near the contour contribute, split these evenly
+    int* pixels = arena.getBuffer<int>(BUFFER_CONTOUR_PIXELS, roi.area());
+    int numPixels = Parallel_For_computeJacobiansGN::collectPixels(sdt, pixels);
+
+    int threads = context.getNumPartitions(numPixels, 64);
+
+    Matx61f* JTCollection = arena.getBuffer<Matx61f>(BUFFER_JT, threads);
+    Matx66f* wJTJCollection = arena.getBuffer<Matx66f>(BUFFER_WJTJ, threads);
+
+    for (int i = 0; i < threads; i++)
+    {
+        JTCollection[i] = Matx61f::zeros();
+        wJTJCollection[i] = Matx66f::zeros();
+    }
 
     parallel_for_(cv::Range(0, threads),
                   Parallel_For_computeJacobiansGN(&object->getTCLCHistograms(),
@@ -231,6 +322,8 @@ void OptimizationEngine::parallel_computeJacobians(Object3D* object,
                                                   mask,
                                                   m_id,
                                                   level,
+                                                  pixels,
+                                                  numPixels,
                                                   wJTJCollection,
                                                   JTCollection,
                                                   threads));
@@ -40,10 +40,15 @@
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "execution_context.h"
+#include "frame_arena.h"
+#include "jacobian_accumulator.h"
 #include "object3d.h"
 #include "rendering_engine.h"
 #include "signed_distance_transform2d.h"
+#include "stage_timer.h"
 #include "tclc_histograms.h"
+#include "trace.h"
 
 /**
  *  This class implements an iterative Gauss-Newton optimization strategy for
@@ -62,8 +67,12 @@ class OptimizationEngine
      * resolution.
      *  @param height  The height in pixels of the camera frame at full
      * resolution.
+     *  @param context  The execution context used to parallelize the signed
+     * distance transforms.
      */
-    OptimizationEngine(int width, int height);
+    OptimizationEngine(int width,
+                       int height,
+                       const ExecutionContext& context = ExecutionContext());
 
     ~OptimizationEngine();
 
@@ -87,13 +96,51 @@ class OptimizationEngine
                   std::vector<Object3D*>& objects,
                   int runs = 1);
 
+    /**
+     *  Marks the beginning of a new frame for the scratch buffers that are
+     *  reused between iterations, i.e. restarts their allocation counters.
+     */
+    void resetFrameArena();
+
+    /**
+     *  Returns the number of scratch buffer reallocations of the frame arenas
+     *  since the last call of resetFrameArena(), which should be zero once
+     *  the buffers have grown to their high-water mark.
+     *
+     *  @return The number of arena reallocations in the current frame.
+     */
+    int getNumReallocations();
+
   private:
+    enum BufferSlot
+    {
+        BUFFER_DEPTH,
+        BUFFER_MASK,
+        BUFFER_DEPTH_INV,
+        BUFFER_CROPPED_MASK,
+        BUFFER_CROPPED_DEPTH,
+        BUFFER_CROPPED_DEPTH_INV,
+        BUFFER_SDT,
+        BUFFER_XY_POS,
+        BUFFER_JT,
+        BUFFER_WJTJ,
+        BUFFER_CONTOUR_PIXELS
+    };
+
     static OptimizationEngine* instance;
 
     RenderingEngine* renderingEngine;
 
     SignedDistanceTransform2D* SDT2D;
 
+    ExecutionContext context;
+
+    FrameArena arena;
+
+    std::vector<size_t> objectIndices;
+    std::vector<cv::Rect> objectROIs;
+    std::vector<Model*> objectModels;
+
     int width;
     int height;
 
@@ -112,8 +159,7 @@ class OptimizationEngine
                                    int m_id,
                                    int level,
                                    cv::Matx66f& wJTJ,
-                                   cv::Matx61f& JT,
-                                   int threads);
+                                   cv::Matx61f& JT);
 
     cv::Rect
     compute2DROI(Object3D* object, const cv::Size& maxSize, int offset);
@@ -127,37 +173,50 @@ class OptimizationEngine
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, the Jacobian terms required
  * for the Gauss-Newton pose update step are computed for a single object.
+ * Only the pixels within the band around the contour contribute, so these are
+ * collected beforehand and split evenly among the partitions, instead of
+ * splitting the region of interest into bands of rows of which only a few
+ * contain any contour pixels.
  */
 class Parallel_For_computeJacobiansGN : public cv::ParallelLoopBody
 {
   private:
-    uchar *frameData, *maskData, *initializedData;
+    uchar *frameData, *maskData;
+
+    const int* slotsData;
 
-    float *histogramsFGData, *histogramsBGData, *sdtData, *depthData,
-        *depthInvData, *K_invData;
+    float *posteriorsData, *sdtData, *depthData, *depthInvData;
 
     int* xyPosData;
 
-    cv::Mat localFG, localBG;
+    cv::Mat localPosteriors;
 
-    std::vector<cv::Point3i> centersIDs;
+    const cv::Point3i* centersIDs;
 
-    int numHistograms, radius2, upscale, numBins, binShift, fullWidth,
-        fullHeight, _m_id;
+    const HistogramCenterGrid* centerGrid;
 
-    float _fx, _fy, _zNear, _zFar;
+    int numHistograms, histogramSize, radius2, upscale, numBins, binShift,
+        fullWidth, fullHeight, _m_id;
+
+    float _zNear, _zFar;
 
     bool maskAvailable;
 
     cv::Rect _roi;
 
-    cv::Matx33f K_inv;
+    cv::Matx33f _K;
+
+    const int* _pixels;
+
+    int _numPixels;
 
     cv::Matx66f* _wJTJCollection;
     cv::Matx61f* _JTCollection;
 
     int _threads;
 
+    JacobianAccumulator::InstructionSet _instructionSet;
+
   public:
     Parallel_For_computeJacobiansGN(TCLCHistograms* tclcHistograms,
                                     const cv::Mat& frame,
@@ -172,23 +231,29 @@ class Parallel_For_computeJacobiansGN : public cv::ParallelLoopBody
                                     const cv::Mat& mask,
                                     int m_id,
                                     int level,
-                                    std::vector<cv::Matx66f>& wJTJCollection,
-                                    std::vector<cv::Matx61f>& JTCollection,
-                                    int threads)
+                                    const int* pixels,
+                                    int numPixels,
+                                    cv::Matx66f* wJTJCollection,
+                                    cv::Matx61f* JTCollection,
+                                    int threads,
+                                    JacobianAccumulator::InstructionSet
+                                        instructionSet =
+                                            JacobianAccumulator::
+                                                getInstructionSet())
     {
         frameData = frame.data;
 
-        localFG = tclcHistograms->getLocalForegroundHistograms();
-        localBG = tclcHistograms->getLocalBackgroundHistograms();
+        localPosteriors = tclcHistograms->getLocalPosteriors();
 
-        histogramsFGData = (float*)localFG.ptr<float>();
-        histogramsBGData = (float*)localBG.ptr<float>();
+        posteriorsData = (float*)localPosteriors.ptr<float>();
 
-        centersIDs = tclcHistograms->getCentersAndIDs();
+        centersIDs = tclcHistograms->getCentersAndIDs().data();
 
-        initializedData = tclcHistograms->getInitialized().data;
+        centerGrid = &tclcHistograms->getCenterGrid();
 
-        numHistograms = (int)centersIDs.size();
+        slotsData = tclcHistograms->getHistogramSlots().data();
+
+        numHistograms = (int)tclcHistograms->getCentersAndIDs().size();
 
         int radius = tclcHistograms->getRadius();
 
@@ -198,6 +263,8 @@ class Parallel_For_computeJacobiansGN : public cv::ParallelLoopBody
 
         numBins = tclcHistograms->getNumBins();
 
+        histogramSize = numBins * numBins * numBins;
+
         binShift = 8 - log(numBins) / log(2);
 
         fullWidth = frame.cols;
@@ -217,21 +284,53 @@ class Parallel_For_computeJacobiansGN : public cv::ParallelLoopBody
             _m_id = m_id;
         }
 
-        K_inv = K.inv();
-        K_invData = K_inv.val;
-
-        _fx = K(0, 0);
-        _fy = K(1, 1);
+        _K = K;
 
         _zNear = zNear;
         _zFar = zFar;
 
         _roi = roi;
 
-        _wJTJCollection = wJTJCollection.data();
-        _JTCollection = JTCollection.data();
+        _pixels = pixels;
+        _numPixels = numPixels;
+
+        _wJTJCollection = wJTJCollection;
+        _JTCollection = JTCollection;
 
         _threads = threads;
+
+        _instructionSet = instructionSet;
+    }
+
+    /**
+     *  Collects the indices of all pixels of a signed distance transform that
+     * lie within the band around the contour, leaving out the outermost rows
+     * and columns where no central differences can be computed.
+     *
+     *  @param  sdt The signed distance transform of the region of interest
+     * (single channel, float).
+     *  @param  pixels The output indices, with room for at least as many
+     * elements as sdt has pixels.
+     *  @return The number of collected pixels.
+     */
+    static int collectPixels(const cv::Mat& sdt, int* pixels)
+    {
+        int numPixels = 0;
+
+        for (int j = 1; j < sdt.rows - 1; j++)
+        {
+            const float* sdtRow = sdt.ptr<float>(j);
+
+            for (int i = 1; i < sdt.cols - 1; i++)
+            {
+                if (fabs(sdtRow[i]) <= 8.0f)
+                {
+                    pixels[numPixels++] = j * sdt.cols + i;
+                }
+            }
+        }
+
+        return numPixels;
     }
 
     bool isOccluded(int idx, float dist, float d) const
@@ -307,231 +406,135 @@ class Parallel_For_computeJacobiansGN : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
-        int range = _roi.height / _threads;
-
-        int jStart = r.start * range;
-        if (r.start == 0)
-            jStart = 1;
+        TRACE_SCOPE("Parallel_For_computeJacobiansGN");
 
-        int jEnd = r.end * range;
-        if (r.end == _threads)
-        {
-            jEnd = _roi.height - 1;
-        }
+        int nStart = r.start * _numPixels / _threads;
+        int nEnd = r.end * _numPixels / _threads;
 
         float* wJTJ = (float*)_wJTJCollection[r.start].val;
         float* JT = (float*)_JTCollection[r.start].val;
 
-        float s = 1.2f;
-        float s2 = s * s;
+        JacobianAccumulator accumulator(_K, _zNear, _zFar, _instructionSet);
 
-        for (int j = jStart; j < jEnd; j++)
+        for (int n = nStart; n < nEnd; n++)
         {
-            float J[6];
-
-            int idx = j * _roi.width + 1;
-
-            for (int i = 1; i < _roi.width - 1; i++, idx++)
-            {
-                float dist = sdtData[idx];
+            int idx = _pixels[n];
 
-                if (fabs(dist) <= 8.0f)
-                {
-                    // the smoothed Heaviside value for this signed distance
-                    float heaviside =
-                        1.0f / float(CV_PI) * (-atan(dist * s)) + 0.5f;
+            int j = idx / _roi.width;
+            int i = idx - j * _roi.width;
 
-                    // the corresponding smoothed dirac delta value
-                    float dirac =
-                        (1.0f / float(CV_PI)) * (s / (dist * s2 * dist + 1.0f));
+            float dist = sdtData[idx];
 
-                    // compute the average foreground and background posterior
-                    // probablities from the given set of tclc-histograms
-                    int pIdx = (j + _roi.y) * fullWidth + i + _roi.x;
+            // compute the average foreground and background posterior
+            // probablities from the given set of tclc-histograms
+            int pIdx = (j + _roi.y) * fullWidth + i + _roi.x;
 
-                    // compute the histogram bin index from the pixel's color
-                    int ru = (frameData[3 * pIdx] >> binShift);
-                    int gu = (frameData[3 * pIdx + 1] >> binShift);
-                    int bu = (frameData[3 * pIdx + 2] >> binShift);
+            // compute the histogram bin index from the pixel's color
+            int ru = (frameData[3 * pIdx] >> binShift);
+            int gu = (frameData[3 * pIdx + 1] >> binShift);
+            int bu = (frameData[3 * pIdx + 2] >> binShift);
 
-                    int binIdx = (ru * numBins + gu) * numBins + bu;
+            int binIdx = (ru * numBins + gu) * numBins + bu;
 
-                    float pYFVal = 0;
-                    float pYBVal = 0;
+            float pYFVal = 0;
+            float pYBVal = 0;
 
-                    int cnt = 0;
+            int cnt = 0;
 
-                    for (int h = 0; h < numHistograms; h++)
-                    {
-                        cv::Point3i centerID = centersIDs[h];
-
-                        if (initializedData[centerID.z])
-                        {
-                            // check whether the pixel is within the local
-                            // histogram region
-                            int dx = centerID.x - upscale * (i + _roi.x + 0.5f);
-                            int dy = centerID.y - upscale * (j + _roi.y + 0.5f);
-                            int distance = dx * dx + dy * dy;
-
-                            if (distance <= radius2)
-                            {
-                                float pyf =
-                                    localFG.at<float>(centerID.z, binIdx);
-                                float pyb =
-                                    localBG.at<float>(centerID.z, binIdx);
-
-                                pyf += 0.0000001f;
-                                pyb += 0.0000001f;
-
-                                // compute local pixel-wise posteriors
-                                pYFVal += pyf / (pyf + pyb);
-                                pYBVal += pyb / (pyf + pyb);
-
-                                cnt++;
-                            }
-                        }
-                    }
+            // only visit the centers listed in the grid cell of this pixel
+            // instead of all of them
+            int cell =
+                centerGrid->getCell((int)(upscale * (i + _roi.x + 0.5f)),
+                                    (int)(upscale * (j + _roi.y + 0.5f)));
 
-                    if (cnt)
-                    {
-                        pYFVal /= cnt;
-                        pYBVal /= cnt;
-                    }
+            int hStart = cell >= 0 ? centerGrid->offsets[cell] : 0;
+            int hEnd = cell >= 0 ? centerGrid->offsets[cell + 1] : 0;
 
-                    // the energy inside the log
-                    float e = heaviside * (pYFVal - pYBVal) + pYBVal + 0.000001;
-
-                    // the outer derivation
-                    float DlogeDe = -(pYFVal - pYBVal) / e;
-                    // the constant part of the overall gradient for this image
-                    float constant_deriv = DlogeDe * dirac;
-
-                    float x = _roi.x;
-                    float y = _roi.y;
-                    float D;
-
-                    int zIdx;
-
-                    // get the closest pixel on the contour for pixels in the
-                    // background
-                    if (dist > 0)
-                    {
-                        int xPos = xyPosData[2 * idx];
-                        int yPos = xyPosData[2 * idx + 1];
+            for (int k = hStart; k < hEnd; k++)
+            {
+                cv::Point3i centerID = centersIDs[centerGrid->ids[k]];
 
-                        // should not happen
-                        if (xPos < 0 || yPos < 0)
-                            continue;
+                int slot = slotsData[centerID.z];
 
-                        x += xPos;
-                        y += yPos;
-                        zIdx = yPos * _roi.width + xPos;
-                    }
-                    else
-                    {
-                        x += i;
-                        y += j;
-                        zIdx = idx;
-                    }
+                if (slot >= 0)
+                {
+                    // check whether the pixel is within the local histogram
+                    // region
+                    int dx = centerID.x - upscale * (i + _roi.x + 0.5f);
+                    int dy = centerID.y - upscale * (j + _roi.y + 0.5f);
+                    int distance = dx * dx + dy * dy;
 
-                    // get the depth buffer value for this pixel
-                    float depth = 1.0f - depthData[zIdx];
-
-                    // check for occlusions in case of multiple objects
-                    if (maskAvailable && isOccluded(idx, dist, depth))
-                        continue;
-
-                    // compute the Z-distance to the camera from the depth
-                    // buffer value
-                    D = 2.0f * _zNear * _zFar /
-                        (_zFar + _zNear -
-                         (2.0f * depth - 1.0) * (_zFar - _zNear));
-
-                    // back-project to camera coordinates
-                    float X_c = D * (K_invData[0] * x + K_invData[2]);
-                    float Y_c = D * (K_invData[4] * y + K_invData[5]);
-                    float Z_c = D;
-
-                    float Z_c2 = Z_c * Z_c;
-
-                    // the image gradient of the signed distance transform
-                    float DsdtDx = (sdtData[idx + 1] - sdtData[idx - 1]) / 2.0f;
-                    float DsdtDy = (sdtData[idx + _roi.width] -
-                                    sdtData[idx - _roi.width]) /
-                                   2.0f;
-
-                    // compute the Jacobian of the signed distance transform
-                    // with respect to the twist coordinates for this pixel
-                    J[0] = DsdtDy * (-(_fy * pow(Y_c, 2)) / Z_c2 - _fy) -
-                           (DsdtDx * _fx * X_c * Y_c) / Z_c2;
-                    J[1] = DsdtDx * ((_fx * pow(X_c, 2)) / Z_c2 + _fx) +
-                           (DsdtDy * _fy * X_c * Y_c) / Z_c2;
-                    J[2] =
-                        (DsdtDy * _fy * X_c) / Z_c - (DsdtDx * _fx * Y_c) / Z_c;
-                    J[3] = (DsdtDx * _fx) / Z_c;
-                    J[4] = (DsdtDy * _fy) / Z_c;
-                    J[5] = -(DsdtDy * _fy * Y_c) / Z_c2 -
-                           (DsdtDx * _fx * X_c) / Z_c2;
-
-                    // compute and add the per pixel gradient
-                    for (int n = 0; n < 6; n++)
+                    if (distance <= radius2)
                     {
-                        JT[n] += constant_deriv * J[n];
-                    }
-
-                    float c2 = constant_deriv * constant_deriv;
+                        // look up the local pixel-wise posteriors
+                        float pyf =
+                            posteriorsData[slot * histogramSize + binIdx];
 
-                    // compute the weighting term for this pixel
-                    float w = -1.0f / log(e);
+                        pYFVal += pyf;
+                        pYBVal += 1.0f - pyf;
 
-                    // compute and add the per pixel Hessian approximation
-                    for (int n = 0; n < 6; n++)
-                    {
-                        for (int m = n; m < 6; m++)
-                        {
-                            wJTJ[n * 6 + m] += w * J[n] * c2 * J[m];
-                        }
+                        cnt++;
                     }
+                }
+            }
 
-                    // do the same for the inverse depth buffer
-                    depth = 1.0f - depthInvData[zIdx];
+            if (cnt)
+            {
+                pYFVal /= cnt;
+                pYBVal /= cnt;
+            }
 
-                    D = 2.0f * _zNear * _zFar /
-                        (_zFar + _zNear -
-                         (2.0f * depth - 1.0) * (_zFar - _zNear));
+            float x = _roi.x;
+            float y = _roi.y;
 
-                    X_c = D * (K_invData[0] * x + K_invData[2]);
-                    Y_c = D * (K_invData[4] * y + K_invData[5]);
-                    Z_c = D;
+            int zIdx;
 
-                    Z_c2 = Z_c * Z_c;
+            // get the closest pixel on the contour for pixels in the background
+            if (dist > 0)
+            {
+                int xPos = xyPosData[2 * idx];
+                int yPos = xyPosData[2 * idx + 1];
 
-                    J[0] = DsdtDy * (-(_fy * pow(Y_c, 2)) / Z_c2 - _fy) -
-                           (DsdtDx * _fx * X_c * Y_c) / Z_c2;
-                    J[1] = DsdtDx * ((_fx * pow(X_c, 2)) / Z_c2 + _fx) +
-                           (DsdtDy * _fy * X_c * Y_c) / Z_c2;
-                    J[2] =
-                        (DsdtDy * _fy * X_c) / Z_c - (DsdtDx * _fx * Y_c) / Z_c;
-                    J[3] = (DsdtDx * _fx) / Z_c;
-                    J[4] = (DsdtDy * _fy) / Z_c;
-                    J[5] = -(DsdtDy * _fy * Y_c) / Z_c2 -
-                           (DsdtDx * _fx * X_c) / Z_c2;
+                // should not happen
+                if (xPos < 0 || yPos < 0)
+                    continue;
 
-                    for (int n = 0; n < 6; n++)
-                    {
-                        JT[n] += constant_deriv * J[n];
-                    }
-
-                    for (int n = 0; n < 6; n++)
-                    {
-                        for (int m = n; m < 6; m++)
-                        {
-                            wJTJ[n * 6 + m] += w * J[n] * c2 * J[m];
-                        }
-                    }
-                }
+                x += xPos;
+                y += yPos;
+                zIdx = yPos * _roi.width + xPos;
             }
+            else
+            {
+                x += i;
+                y += j;
+                zIdx = idx;
+            }
+
+            // get the depth buffer value for this pixel
+            float depth = 1.0f - depthData[zIdx];
+
+            // check for occlusions in case of multiple objects
+            if (maskAvailable && isOccluded(idx, dist, depth))
+                continue;
+
+            // the image gradient of the signed distance transform
+            float DsdtDx = (sdtData[idx + 1] - sdtData[idx - 1]) / 2.0f;
+            float DsdtDy =
+                (sdtData[idx + _roi.width] - sdtData[idx - _roi.width]) / 2.0f;
+
+            // the Jacobian itself is evaluated for batches of pixels
+            accumulator.addPixel(dist,
+                                 pYFVal,
+                                 pYBVal,
+                                 x,
+                                 y,
+                                 depth,
+                                 1.0f - depthInvData[zIdx],
+                                 DsdtDx,
+                                 DsdtDy);
         }
+
+        accumulator.finish(wJTJ, JT);
     }
 };
 
@@ -38,12 +38,6 @@
 using namespace std;
 using namespace cv;
 
-bool sortTemplateView(std::pair<float, TemplateView*> a,
-                      std::pair<float, TemplateView*> b)
-{
-    return a.first < b.first;
-}
-
 PoseEstimator6D::PoseEstimator6D(int width,
                                  int height,
                                  float zNear,
@@ -51,9 +45,11 @@ PoseEstimator6D::PoseEstimator6D(int width,
                                  const cv::Matx33f& K,
                                  const cv::Matx14f& distCoeffs,
                                  vector<Object3D*>& objects,
-                                 bool const generateObjectTemplates)
+                                 bool const generateObjectTemplates,
+                                 const ExecutionContext& context)
     : width{width}, height{height}, K{K}, distCoeffs{distCoeffs},
-      optimizationEngine{width, height}
+      context{context}, optimizationEngine{width, height, context},
+      SDT2D{8.0f, true, context}, relocalizer{K, context}
 {
     renderingEngine = RenderingEngine::Instance();
 
@@ -74,13 +70,18 @@ PoseEstimator6D::PoseEstimator6D(int width,
     {
         objects[i]->setModelID(i + 1);
         this->objects.push_back(objects[i]);
-        this->objects[i]->initBuffers();
+        this->objects[i]->getTCLCHistograms().setExecutionContext(context);
+        if (RenderingEngine::getBackend() == RenderingEngine::OPENGL)
+        {
+            this->objects[i]->initBuffers();
+        }
         if (generateObjectTemplates)
         {
-            this->objects[i]->generateTemplates();
+            this->objects[i]->generateTemplates(context);
         }
         this->objects[i]->reset();
     }
+    models.assign(this->objects.begin(), this->objects.end());
 
     renderingEngine->doneCurrent();
 }
@@ -97,6 +98,10 @@ void PoseEstimator6D::toggleTracking(cv::Mat& frame,
     if (objectIndex >= objects.size())
         return;
 
+    // the histograms are reinitialized, which a background search must not
+    // read at the same time
+    relocalizer.cancel(objects[objectIndex]);
+
     if (undistortFrame)
         remap(frame, frame, map1, map2, INTER_LINEAR);
 
@@ -106,8 +111,7 @@ void PoseEstimator6D::toggleTracking(cv::Mat& frame,
 
         renderingEngine->setLevel(0);
 
-        renderingEngine->renderSilhouette(
-            vector<Model*>(objects.begin(), objects.end()), GL_FILL);
+        renderingEngine->renderSilhouette(models, GL_FILL);
 
         Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
         Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
@@ -136,44 +140,68 @@ void PoseEstimator6D::estimatePoses(cv::Mat& frame,
                                     bool undistortFrame,
                                     bool checkForLoss)
 {
+    TRACE_SCOPE("PoseEstimator6D::estimatePoses");
+
     if (undistortFrame)
         remap(frame, frame, map1, map2, INTER_LINEAR);
 
-    vector<Mat> imagePyramid;
+    // start counting the scratch buffer allocations for this frame
+    optimizationEngine.resetFrameArena();
+    SDT2D.getFrameArena().reset();
+    arena.reset();
 
-    Mat frameCpy = frame.clone();
-    imagePyramid.push_back(frameCpy);
+    // start measuring the run times of the stages for this frame
+    StageTimings::reset();
 
-    for (int l = 1; l < 4; l++)
     {
-        resize(frame,
-               frameCpy,
-               Size(frame.cols / pow(2, l), frame.rows / pow(2, l)));
-        imagePyramid.push_back(frameCpy);
+        StageTimer timer(STAGE_PYRAMID);
+
+        imagePyramid.clear();
+
+        for (int l = 0; l < NUM_PYRAMID_LEVELS; l++)
+        {
+            Size size(frame.cols / pow(2, l), frame.rows / pow(2, l));
+            Mat level = arena.getMat(BUFFER_PYRAMID + l, size, frame.type());
+
+            if (l == 0)
+                frame.copyTo(level);
+            else
+                resize(frame, level, size);
+
+            imagePyramid.push_back(level);
+        }
     }
 
     if (initialized)
     {
         optimizationEngine.minimize(imagePyramid, objects);
 
-        renderingEngine->setLevel(0);
+        Rect frameRect(0, 0, width, height);
 
-        renderingEngine->renderSilhouette(
-            vector<Model*>(objects.begin(), objects.end()), GL_FILL);
+        Mat mask = arena.getMat(BUFFER_MASK, frameRect.size(), CV_8UC1);
+        Mat depth = arena.getMat(BUFFER_DEPTH, frameRect.size(), CV_32FC1);
+        {
+            StageTimer timer(STAGE_RENDER);
 
-        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
+            renderingEngine->setLevel(0);
+
+            renderingEngine->renderSilhouette(models, GL_FILL);
+
+            renderingEngine->downloadFrame(
+                RenderingEngine::MASK, mask, frameRect);
+            renderingEngine->downloadFrame(
+                RenderingEngine::DEPTH, depth, frameRect);
+        }
 
         float zNear = renderingEngine->getZNear();
         float zFar = renderingEngine->getZFar();
 
-        Mat binned;
-        parallel_for_(cv::Range(0, 8),
-                      Parallel_For_convertToBins(
-                          frame,
-                          binned,
-                          objects[0]->getTCLCHistograms().getNumBins(),
-                          8));
+        Mat binned = arena.getMat(BUFFER_BINNED, frame.size(), CV_32SC1);
+        {
+            StageTimer timer(STAGE_HISTOGRAMS);
+
+            convertToBins(objects[0], frame, binned);
+        }
 
         for (size_t i = 0; i < objects.size(); i++)
         {
@@ -181,8 +209,17 @@ void PoseEstimator6D::estimatePoses(cv::Mat& frame,
             {
                 if (!objects[i]->isTrackingLost())
                 {
-                    float e = evaluateEnergyFunction(
-                        objects[i], mask, depth, binned, 0, 8);
+                    // the object may have been recovered from outside, a
+                    // search still reading its histograms is discarded
+                    relocalizer.cancel(objects[i]);
+
+                    float e;
+                    {
+                        StageTimer timer(STAGE_ENERGY);
+
+                        e = evaluateEnergyFunction(
+                            objects[i], mask, depth, binned, 0);
+                    }
 
                     if (checkForLoss &&
                         (e > objects[i]->getQualityThreshold() || e == 0.0f))
@@ -192,12 +229,16 @@ void PoseEstimator6D::estimatePoses(cv::Mat& frame,
                     }
                     else
                     {
+                        StageTimer timer(STAGE_HISTOGRAMS);
+
                         objects[i]->getTCLCHistograms().update(
                             frame, mask, depth, K, zNear, zFar);
                     }
                 }
                 else
                 {
+                    StageTimer timer(STAGE_RELOCALIZATION);
+
                     relocalize(objects[i], imagePyramid);
                 }
             }
@@ -205,170 +246,76 @@ void PoseEstimator6D::estimatePoses(cv::Mat& frame,
     }
 }
 
-void PoseEstimator6D::relocalize(Object3D* object, vector<Mat>& imagePyramid)
+void PoseEstimator6D::resetPose(size_t objectIndex, const Matx44f& pose)
 {
-    vector<TemplateView*> templateViews = object->getTemplateViews();
-
-    int numDistances = object->getNumDistances();
-
-    int level = 3;
-
-    // PREPARE FRAME FOR LOWEST LEVEL
-    Mat binned;
-    parallel_for_(
-        cv::Range(0, 8),
-        Parallel_For_convertToBins(imagePyramid[level],
-                                   binned,
-                                   object->getTCLCHistograms().getNumBins(),
-                                   8));
+    if (objectIndex >= objects.size())
+        return;
 
-    Mat prMap;
-    parallel_for_(cv::Range(0, 8),
-                  Parallel_For_createPosteriorResponseMap(
-                      &object->getTCLCHistograms(), binned, prMap, 8));
+    relocalizer.cancel(objects[objectIndex]);
 
-    parallel_for_(cv::Range(0, (int)templateViews.size()),
-                  Parallel_For_exhaustiveSearch(
-                      object, templateViews, binned, prMap, level, 4, -1));
+    objects[objectIndex]->setPose(pose);
+    objects[objectIndex]->setTrackingLost(false);
+}
 
-    parallel_for_(cv::Range(0, (int)templateViews.size()),
-                  Parallel_For_exhaustiveSearch(
-                      object, templateViews, binned, prMap, level, 1, 2));
+void PoseEstimator6D::relocalize(Object3D* object, vector<Mat>& imagePyramid)
+{
+    TRACE_SCOPE("PoseEstimator6D::relocalize");
 
-    // KEEP ONLY THE BEST MATCHING DISTANCE PER TEMPLATE
-    vector<pair<float, TemplateView*>> errorKVMap0;
+    vector<Matx44f> poses;
 
-    for (size_t i = 0; i < templateViews.size(); i += numDistances)
+    if (!relocalizer.isAsynchronous())
     {
-        float minE = FLT_MAX;
-        int minIdx = -1;
-        for (int j = 0; j < numDistances; j++)
-        {
-            TemplateView* templateView = templateViews[i + j];
-            Point3f offset = templateView->getCurrentOffset(level);
-
-            if (offset.z < minE)
-            {
-                minE = offset.z;
-                minIdx = j;
-            }
-        }
-        if (minE > 0.0f && minIdx >= 0)
-        {
-            errorKVMap0.push_back(
-                pair<float, TemplateView*>(minE, templateViews[i + minIdx]));
-        }
+        relocalizer.search(object, imagePyramid, poses);
     }
-
-    sort(errorKVMap0.begin(), errorKVMap0.end(), sortTemplateView);
-
-    level = 2;
-
-    // PREPARE FRAME FOR 2ND LOWEST LEVEL
-    parallel_for_(
-        cv::Range(0, 8),
-        Parallel_For_convertToBins(imagePyramid[level],
-                                   binned,
-                                   object->getTCLCHistograms().getNumBins(),
-                                   8));
-
-    vector<pair<float, TemplateView*>> errorKVMap;
-
-    for (size_t i = 0; i < errorKVMap0.size() / 2; i++)
+    else if (!relocalizer.fetchResult(object, poses))
     {
-        float kve = errorKVMap0[i].first;
-        TemplateView* templateView = errorKVMap0[i].second;
-
-        if (kve > 0.0f && kve < 1.0f)
-        {
-            parallel_for_(
-                cv::Range(0, (int)templateView->getNeighborTemplates().size()),
-                Parallel_For_neighborSearch(
-                    object, templateView, binned, level, 1));
-
-            for (size_t n = 0; n < templateView->getNeighborTemplates().size();
-                 n++)
-            {
-                TemplateView* kvn = templateView->getNeighborTemplates()[n];
-
-                float e = kvn->getCurrentOffset(level).z;
-
-                if (e > 0.0f && e < 1.0f)
-                    errorKVMap.push_back(pair<float, TemplateView*>(e, kvn));
-            }
-        }
+        // search this frame in the background unless a search is pending,
+        // the result is refined within the frame in which it is fetched
+        relocalizer.request(object, imagePyramid);
+        return;
     }
 
-    sort(errorKVMap.begin(), errorKVMap.end(), sortTemplateView);
-
-    parallel_for_(
-        cv::Range(0, 8),
-        Parallel_For_convertToBins(imagePyramid[0],
-                                   binned,
-                                   object->getTCLCHistograms().getNumBins(),
-                                   8));
+    Mat binned;
+    convertToBins(object, imagePyramid[0], binned);
 
     float minE = FLT_MAX;
     Matx44f finalPose;
 
     bool trackingLost = true;
 
-    for (int i = 0; i < std::min(4, (int)errorKVMap.size()); i++)
+    // refine the candidates within the current frame, which catches up with
+    // the motion since the frame that has been searched in the background
+    for (size_t i = 0; i < poses.size(); i++)
     {
-        TemplateView* templateView = errorKVMap[i].second;
-
-        Point3f offset = templateView->getCurrentOffset(level);
-        ;
-        int offsetX = offset.x;
-        int offsetY = offset.y;
-        float offsetE = offset.z;
+        object->setPose(poses[i]);
 
-        if (offsetE > 0 && offsetE < 1.0f)
-        {
-            Rect roi = templateView->getROI(level);
-
-            Vec3f offsetVec(
-                (-roi.x + offsetX) * pow(2, level) + imagePyramid[0].cols / 2,
-                (-roi.y + offsetY) * pow(2, level) + imagePyramid[0].rows / 2,
-                1);
-
-            Matx44f pose = templateView->getPose();
-
-            offsetVec = K.inv() * offsetVec;
-            pose(0, 3) = offsetVec[0] * pose(2, 3);
-            pose(1, 3) = offsetVec[1] * pose(2, 3);
-
-            object->setPose(pose);
+        renderingEngine->setLevel(0);
+        renderingEngine->renderSilhouette(models, GL_FILL);
 
-            renderingEngine->setLevel(0);
-            renderingEngine->renderSilhouette(
-                vector<Model*>(objects.begin(), objects.end()), GL_FILL);
+        Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
+        Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
 
-            Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-            Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
+        float zNear = renderingEngine->getZNear();
+        float zFar = renderingEngine->getZFar();
 
-            float zNear = renderingEngine->getZNear();
-            float zFar = renderingEngine->getZFar();
+        object->getTCLCHistograms().updateCentersAndIds(
+            mask, depth, K, zNear, zFar, 0);
 
-            object->getTCLCHistograms().updateCentersAndIds(
-                mask, depth, K, zNear, zFar, 0);
+        vector<Object3D*> tmp;
+        tmp.push_back(object);
 
-            vector<Object3D*> tmp;
-            tmp.push_back(object);
+        optimizationEngine.minimize(imagePyramid, tmp, 2);
 
-            optimizationEngine.minimize(imagePyramid, tmp, 2);
+        float e = evaluateEnergyFunction(object, binned, 0);
 
-            float e = evaluateEnergyFunction(object, binned, 0, 8);
+        if (e > 0.0f && e < minE)
+        {
+            minE = e;
+            finalPose = object->getPose();
 
-            if (e > 0.0f && e < minE)
+            if (e < object->getQualityThreshold())
             {
-                minE = e;
-                finalPose = object->getPose();
-
-                if (e < object->getQualityThreshold())
-                {
-                    trackingLost = false;
-                }
+                trackingLost = false;
             }
         }
     }
@@ -379,8 +326,7 @@ void PoseEstimator6D::relocalize(Object3D* object, vector<Mat>& imagePyramid)
         object->setTrackingLost(false);
 
         renderingEngine->setLevel(0);
-        renderingEngine->renderSilhouette(
-            vector<Model*>(objects.begin(), objects.end()), GL_FILL);
+        renderingEngine->renderSilhouette(models, GL_FILL);
 
         Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
         Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
@@ -439,27 +385,38 @@ PoseEstimator6D::computeBoundingBox(const std::vector<cv::Point3i>& centersIDs,
     return Rect(minX, minY, maxX - minX, maxY - minY);
 }
 
+void PoseEstimator6D::convertToBins(Object3D* object,
+                                    const Mat& frame,
+                                    Mat& binned)
+{
+    int threads = context.getNumPartitions(frame.rows);
+
+    parallel_for_(
+        cv::Range(0, threads),
+        Parallel_For_convertToBins(frame,
+                                   binned,
+                                   object->getTCLCHistograms().getNumBins(),
+                                   threads));
+}
+
 float PoseEstimator6D::evaluateEnergyFunction(Object3D* object,
                                               const Mat& binned,
-                                              int level,
-                                              int threads)
+                                              int level)
 {
     renderingEngine->setLevel(0);
-    renderingEngine->renderSilhouette(
-        vector<Model*>(objects.begin(), objects.end()), GL_FILL);
+    renderingEngine->renderSilhouette(models, GL_FILL);
 
     Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
     Mat depth = renderingEngine->downloadFrame(RenderingEngine::DEPTH);
 
-    return evaluateEnergyFunction(object, mask, depth, binned, level, threads);
+    return evaluateEnergyFunction(object, mask, depth, binned, level);
 }
 
 float PoseEstimator6D::evaluateEnergyFunction(Object3D* object,
                                               const Mat& mask,
                                               const Mat& depth,
                                               const Mat& binned,
-                                              int level,
-                                              int threads)
+                                              int level)
 {
     float zNear = renderingEngine->getZNear();
     float zFar = renderingEngine->getZFar();
@@ -467,22 +424,25 @@ float PoseEstimator6D::evaluateEnergyFunction(Object3D* object,
     auto& tclcHistograms = object->getTCLCHistograms();
     tclcHistograms.updateCentersAndIds(mask, depth, K, zNear, zFar, 0);
 
-    vector<Point3i> centersIDs = tclcHistograms.getCentersAndIDs();
+    const vector<Point3i>& centersIDs = tclcHistograms.getCentersAndIDs();
 
     if (centersIDs.size() > 0)
     {
         Rect roi = computeBoundingBox(
             centersIDs, tclcHistograms.getRadius(), 0, binned.size());
 
-        Mat croppedMask = mask(roi).clone();
-        Mat croppedDepth = depth(roi).clone();
+        Mat croppedMask =
+            arena.getMat(BUFFER_CROPPED_MASK, roi.size(), CV_8UC1);
+        mask(roi).copyTo(croppedMask);
+
+        Mat sdt = arena.getMat(BUFFER_SDT, roi.size(), CV_32FC1);
+        Mat xyPos = arena.getMat(BUFFER_XY_POS, roi.size(), CV_32SC2);
+        SDT2D.computeTransform(croppedMask, sdt, xyPos, object->getModelID());
 
-        Mat sdt, xyPos;
-        SDT2D.computeTransform(
-            croppedMask, sdt, xyPos, 8, object->getModelID());
+        int threads = context.getNumPartitions(sdt.rows);
 
-        Mat heaviside;
-        parallel_for_(cv::Range(0, 8),
+        Mat heaviside = arena.getMat(BUFFER_HEAVISIDE, roi.size(), CV_32FC1);
+        parallel_for_(cv::Range(0, threads),
                       Parallel_For_convertToHeaviside(sdt, heaviside, threads));
 
         return evaluateEnergyFunction(&tclcHistograms,
@@ -508,11 +468,19 @@ float PoseEstimator6D::evaluateEnergyFunction(TCLCHistograms* tclcHistograms,
                                               int level)
 {
     float e = 0.0f;
-    int N = roi.height;
 
-    Mat eCollection = Mat::zeros(1, N, CV_32FC3);
+    // only the pixels near the contour contribute, split these evenly
+    int* pixels = arena.getBuffer<int>(BUFFER_ENERGY_PIXELS, heaviside.total());
+    int numPixels = Parallel_For_evaluateEnergy::collectPixels(
+        heaviside, offsetX, offsetY, binned.size(), pixels);
 
-    parallel_for_(cv::Range(0, N),
+    int threads = context.getNumPartitions(numPixels, 64);
+
+    Mat eCollection =
+        arena.getMat(BUFFER_ENERGY_COLLECTION, Size(threads, 1), CV_32FC3);
+    eCollection.setTo(0);
+
+    parallel_for_(cv::Range(0, threads),
                   Parallel_For_evaluateEnergy(tclcHistograms,
                                               centersIDs,
                                               binned,
@@ -521,8 +489,10 @@ float PoseEstimator6D::evaluateEnergyFunction(TCLCHistograms* tclcHistograms,
                                               offsetX,
                                               offsetY,
                                               level,
+                                              pixels,
+                                              numPixels,
                                               eCollection,
-                                              N));
+                                              threads));
 
     int sum1 = 0;
     int sum2 = 0;
@@ -548,8 +518,17 @@ float PoseEstimator6D::evaluateEnergyFunction(TCLCHistograms* tclcHistograms,
     return e;
 }
 
+int PoseEstimator6D::getNumArenaReallocations()
+{
+    return optimizationEngine.getNumReallocations() +
+           SDT2D.getFrameArena().getNumReallocations() +
+           arena.getNumReallocations();
+}
+
 void PoseEstimator6D::reset()
 {
+    relocalizer.cancelAll();
+
     for (size_t i = 0; i < objects.size(); i++)
     {
         objects[i]->reset();
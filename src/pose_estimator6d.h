@@ -36,15 +36,23 @@
 #ifndef POSE_ESTIMATOR6D_H
 #define POSE_ESTIMATOR6D_H
 
+#include <cstdint>
+#include <vector>
+
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/video.hpp>
 
+#include "execution_context.h"
+#include "frame_arena.h"
 #include "object3d.h"
 #include "optimization_engine.h"
+#include "relocalizer.h"
 #include "rendering_engine.h"
 #include "signed_distance_transform2d.h"
+#include "stage_timer.h"
 #include "template_view.h"
+#include "trace.h"
 
 /**
  *  This class implements a region-based 6DOF pose estimator in form of a
@@ -75,6 +83,10 @@ class PoseEstimator6D
      *  @param  K The intrinsic camera matrix.
      *  @param  distCoeffs The cameras lens distortion coefficients.
      *  @param  objects A collection of all 3D objects to be tracked.
+     *  @param  generateObjectTemplates Whether to generate the template views
+     * of all objects used for relocalization.
+     *  @param  context The execution context used to parallelize the
+     * per-frame computations.
      */
     PoseEstimator6D(int width,
                     int height,
@@ -83,7 +95,8 @@ class PoseEstimator6D
                     const cv::Matx33f& K,
                     const cv::Matx14f& distCoeffs,
                     std::vector<Object3D*>& objects,
-                    bool generateObjectTemplates);
+                    bool generateObjectTemplates,
+                    const ExecutionContext& context = ExecutionContext());
 
     ~PoseEstimator6D();
 
@@ -109,7 +122,9 @@ class PoseEstimator6D
      *  successful tracking, the pose is estimated frame-to-frame.
      *  If tracking has been lost for an object, the pose will be
      *  estimated using a template matching approach for pose detection
-     *  also based on tclc-histograms.
+     *  also based on tclc-histograms. If the execution context provides
+     *  relocalization threads, the templates are searched in the background
+     *  and the pose of a lost object is recovered in a later frame.
      *  Within this method, the 3D objectives are updated with the
      *  new estimated poses which can be obtained by calling getPose()
      *  on each object afterwards.
@@ -124,13 +139,52 @@ class PoseEstimator6D
                        bool undistortFrame = true,
                        bool checkForLoss = true);
 
+    /**
+     *  Overrides the pose of an initialized object, e.g. with a ground truth
+     *  pose, and marks it as tracked again. A pending relocalization of the
+     *  object is discarded.
+     *
+     *  @param  objectIndex The index of the object.
+     *  @param  pose The new pose of the object.
+     */
+    void resetPose(size_t objectIndex, const cv::Matx44f& pose);
+
     /**
      *  Resets/stops pose tracking for all objects by clearing the
      *  respective sets of tclc-histograms.
      */
     void reset();
 
+    /**
+     *  Returns the number of frame arena reallocations that were performed
+     *  during the most recent call of estimatePoses(), which is zero in
+     *  steady-state tracking. The image pyramid, the rendered masks and depth
+     *  maps, the signed distance transforms and Heaviside maps of the energy
+     *  evaluation and the scratch buffers of the optimization all live in
+     *  these arenas. Allocations within the tclc-histograms and during the
+     *  relocalization of lost objects are not counted.
+     *
+     *  @return The number of arena reallocations in the most recent frame.
+     */
+    int getNumArenaReallocations();
+
   private:
+    static const int NUM_PYRAMID_LEVELS = 4;
+
+    enum BufferSlot
+    {
+        BUFFER_PYRAMID,
+        BUFFER_MASK = BUFFER_PYRAMID + NUM_PYRAMID_LEVELS,
+        BUFFER_DEPTH,
+        BUFFER_BINNED,
+        BUFFER_CROPPED_MASK,
+        BUFFER_SDT,
+        BUFFER_XY_POS,
+        BUFFER_HEAVISIDE,
+        BUFFER_ENERGY_PIXELS,
+        BUFFER_ENERGY_COLLECTION
+    };
+
     int width;
     int height;
 
@@ -142,10 +196,21 @@ class PoseEstimator6D
 
     std::vector<Object3D*> objects;
 
+    ExecutionContext context;
+
     RenderingEngine* renderingEngine;
     OptimizationEngine optimizationEngine;
 
-    SignedDistanceTransform2D SDT2D = SignedDistanceTransform2D{8.0f};
+    SignedDistanceTransform2D SDT2D;
+
+    Relocalizer relocalizer;
+
+    FrameArena arena;
+
+    // the models of all objects and the image pyramid of the current frame,
+    // kept such that they are not rebuilt in every frame
+    std::vector<Model*> models;
+    std::vector<cv::Mat> imagePyramid;
 
     cv::Mat lastFrame;
 
@@ -158,17 +223,19 @@ class PoseEstimator6D
                                 int level,
                                 const cv::Size& maxSize);
 
+    void convertToBins(Object3D* object,
+                       const cv::Mat& frame,
+                       cv::Mat& binned);
+
     float evaluateEnergyFunction(Object3D* object,
                                  const cv::Mat& binned,
-                                 int level,
-                                 int threads);
+                                 int level);
 
     float evaluateEnergyFunction(Object3D* object,
                                  const cv::Mat& mask,
                                  const cv::Mat& depth,
                                  const cv::Mat& binned,
-                                 int level,
-                                 int threads);
+                                 int level);
 
     float evaluateEnergyFunction(TCLCHistograms* tclcHistograms,
                                  const std::vector<cv::Point3i>& centersIDs,
@@ -194,21 +261,25 @@ class PoseEstimator6D
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, the region-based cost
  * function is evaluated given the current camera image for a single object.
+ * The pixels within the band around the contour are collected beforehand and
+ * split evenly among the partitions.
  */
 class Parallel_For_evaluateEnergy : public cv::ParallelLoopBody
 {
   private:
     int* binsData;
 
-    cv::Mat localFG;
-    cv::Mat localBG;
+    cv::Mat localPosteriors;
+
+    float* posteriorsData;
+
+    int histogramSize;
 
-    float* histogramsFGData;
-    float* histogramsBGData;
+    const cv::Point3i* centersIDsData;
 
-    std::vector<cv::Point3i> _centersIDs;
+    const HistogramCenterGrid* centerGrid;
 
-    uchar* initializedData;
+    const int* slotsData;
 
     int numHistograms;
     int radius;
@@ -226,11 +297,58 @@ class Parallel_For_evaluateEnergy : public cv::ParallelLoopBody
 
     cv::Rect _roi;
 
+    const int* _pixels;
+
+    int _numPixels;
+
     float* _eCollection;
 
     int _threads;
 
   public:
+    /**
+     *  Collects the indices of all pixels of a Heaviside map that lie within
+     * the band around the contour as well as within the camera frame.
+     *
+     *  @param  heaviside The Heaviside map of the region of interest (single
+     * channel, float, negative outside of the band).
+     *  @param  offsetX The horizontal offset of the map within the frame.
+     *  @param  offsetY The vertical offset of the map within the frame.
+     *  @param  frameSize The size of the camera frame.
+     *  @param  pixels The output indices, with room for at least as many
+     * elements as the map has pixels.
+     *  @return The number of collected pixels.
+     */
+    static int collectPixels(const cv::Mat& heaviside,
+                             int offsetX,
+                             int offsetY,
+                             const cv::Size& frameSize,
+                             int* pixels)
+    {
+        int numPixels = 0;
+
+        int jStart = std::max(0, -offsetY);
+        int jEnd = std::min(heaviside.rows, frameSize.height - offsetY);
+
+        int iStart = std::max(0, -offsetX);
+        int iEnd = std::min(heaviside.cols, frameSize.width - offsetX);
+
+        for (int j = jStart; j < jEnd; j++)
+        {
+            const float* hsRow = heaviside.ptr<float>(j);
+
+            for (int i = iStart; i < iEnd; i++)
+            {
+                if (hsRow[i] >= 0.0f)
+                {
+                    pixels[numPixels++] = j * heaviside.cols + i;
+                }
+            }
+        }
+
+        return numPixels;
+    }
+
     Parallel_For_evaluateEnergy(TCLCHistograms* tclcHistograms,
                                 const std::vector<cv::Point3i>& centersIDs,
                                 const cv::Mat& bins,
@@ -239,20 +357,26 @@ class Parallel_For_evaluateEnergy : public cv::ParallelLoopBody
                                 int offsetX,
                                 int offsetY,
                                 int level,
+                                const int* pixels,
+                                int numPixels,
                                 cv::Mat& eCollection,
                                 int threads)
     {
         binsData = (int*)bins.ptr<int>();
 
-        localFG = tclcHistograms->getLocalForegroundHistograms();
-        localBG = tclcHistograms->getLocalBackgroundHistograms();
+        localPosteriors = tclcHistograms->getLocalPosteriors();
+
+        posteriorsData = (float*)localPosteriors.ptr<float>();
 
-        histogramsFGData = (float*)localFG.ptr<float>();
-        histogramsBGData = (float*)localBG.ptr<float>();
+        histogramSize = localPosteriors.cols;
 
-        _centersIDs = centersIDs;
+        // the centers must be the ones of the last update, so that they match
+        // the center grid of the histograms
+        centersIDsData = centersIDs.data();
 
-        initializedData = tclcHistograms->getInitialized().data;
+        centerGrid = &tclcHistograms->getCenterGrid();
+
+        slotsData = tclcHistograms->getHistogramSlots().data();
 
         numHistograms = (int)centersIDs.size();
 
@@ -272,6 +396,9 @@ class Parallel_For_evaluateEnergy : public cv::ParallelLoopBody
 
         _roi = roi;
 
+        _pixels = pixels;
+        _numPixels = numPixels;
+
         _eCollection = (float*)eCollection.ptr<float>();
 
         _threads = threads;
@@ -279,79 +406,71 @@ class Parallel_For_evaluateEnergy : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
-        int range = _roi.height / _threads;
+        TRACE_SCOPE("Parallel_For_evaluateEnergy");
 
-        int jEnd = r.end * range;
-        if (r.end == _threads)
-        {
-            jEnd = _roi.height;
-        }
+        int nStart = r.start * _numPixels / _threads;
+        int nEnd = r.end * _numPixels / _threads;
 
         float* e = _eCollection + 3 * r.start;
 
-        for (int j = r.start * range; j < jEnd; j++)
+        for (int n = nStart; n < nEnd; n++)
         {
-            int idx = j * _roi.width;
-
-            for (int i = 0; i < _roi.width; i++, idx++)
-            {
-                float hsVal = hsData[idx];
+            int idx = _pixels[n];
 
-                int px = i + _offsetX;
-                int py = j + _offsetY;
+            int j = idx / _roi.width;
+            int i = idx - j * _roi.width;
 
-                if (hsVal >= 0.0f && py >= 0 && py < fullHeight && px >= 0 &&
-                    px < fullWidth)
-                {
-                    int pIdx = py * fullWidth + px;
+            float hsVal = hsData[idx];
 
-                    int binIdx = binsData[pIdx];
+            int pIdx = (j + _offsetY) * fullWidth + i + _offsetX;
 
-                    e[2] += 1.0f;
+            int binIdx = binsData[pIdx];
 
-                    float pYFVal = 0;
-                    float pYBVal = 0;
+            e[2] += 1.0f;
 
-                    int cnt = 0;
+            float pYFVal = 0;
+            float pYBVal = 0;
 
-                    for (int h = 0; h < numHistograms; h++)
-                    {
-                        cv::Point3i centerID = _centersIDs[h];
+            int cnt = 0;
 
-                        if (initializedData[centerID.z])
-                        {
-                            int dx = centerID.x - scale * (i + _roi.x + 0.5f);
-                            int dy = centerID.y - scale * (j + _roi.y + 0.5f);
+            // only visit the centers listed in the grid cell of this pixel
+            // instead of all of them
+            int cell = centerGrid->getCell((int)(scale * (i + _roi.x + 0.5f)),
+                                           (int)(scale * (j + _roi.y + 0.5f)));
 
-                            int distance = dx * dx + dy * dy;
+            int hStart = cell >= 0 ? centerGrid->offsets[cell] : 0;
+            int hEnd = cell >= 0 ? centerGrid->offsets[cell + 1] : 0;
 
-                            if (distance <= radius2)
-                            {
-                                float pyf =
-                                    localFG.at<float>(centerID.z, binIdx);
-                                float pyb =
-                                    localBG.at<float>(centerID.z, binIdx);
+            for (int k = hStart; k < hEnd; k++)
+            {
+                cv::Point3i centerID = centersIDsData[centerGrid->ids[k]];
 
-                                pyf += 0.0000001f;
-                                pyb += 0.0000001f;
+                int slot = slotsData[centerID.z];
 
-                                pYFVal += pyf / (pyf + pyb);
+                if (slot >= 0)
+                {
+                    int dx = centerID.x - scale * (i + _roi.x + 0.5f);
+                    int dy = centerID.y - scale * (j + _roi.y + 0.5f);
 
-                                cnt++;
-                            }
-                        }
-                    }
+                    int distance = dx * dx + dy * dy;
 
-                    if (cnt > 1)
+                    if (distance <= radius2)
                     {
-                        pYFVal /= cnt;
-                        pYBVal = 1.0f - pYFVal;
+                        pYFVal += posteriorsData[slot * histogramSize + binIdx];
 
-                        e[0] += -log(hsVal * (pYFVal - pYBVal) + pYBVal);
-                        e[1] += 1.0f;
+                        cnt++;
                     }
                 }
             }
+
+            if (cnt > 1)
+            {
+                pYFVal /= cnt;
+                pYBVal = 1.0f - pYFVal;
+
+                e[0] += -log(hsVal * (pYFVal - pYBVal) + pYBVal);
+                e[1] += 1.0f;
+            }
         }
     }
 };
@@ -400,6 +519,8 @@ class Parallel_For_convertToBins : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_convertToBins");
+
         int range = _frame.rows / _threads;
 
         int yEnd = r.end * range;
@@ -443,8 +564,6 @@ class Parallel_For_createPosteriorResponseMap : public cv::ParallelLoopBody
     cv::Mat localFG;
     cv::Mat localBG;
 
-    uchar* initializedData;
-
     int numHistograms;
     int numBins;
 
@@ -465,9 +584,8 @@ class Parallel_For_createPosteriorResponseMap : public cv::ParallelLoopBody
         localFG = tclcHistograms->getLocalForegroundHistograms();
         localBG = tclcHistograms->getLocalBackgroundHistograms();
 
-        initializedData = tclcHistograms->getInitialized().data;
-
-        numHistograms = (int)tclcHistograms->getInitialized().cols;
+        // every materialized histogram has been initialized
+        numHistograms = tclcHistograms->getNumInitialized();
 
         numBins = tclcHistograms->getNumBins();
 
@@ -484,6 +602,8 @@ class Parallel_For_createPosteriorResponseMap : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_createPosteriorResponseMap");
+
         int range = _binned.rows / _threads;
 
         int yEnd = r.end * range;
@@ -525,21 +645,18 @@ class Parallel_For_createPosteriorResponseMap : public cv::ParallelLoopBody
 
                     for (int h = 0; h < numHistograms; h++)
                     {
-                        if (initializedData[h])
-                        {
-                            float pyf = localFG.at<float>(h, binIdx);
-                            float pyb = localBG.at<float>(h, binIdx);
+                        float pyf = localFG.at<float>(h, binIdx);
+                        float pyb = localBG.at<float>(h, binIdx);
 
-                            if (pyf > 0.0f || pyb > 0.0f)
-                            {
-                                pyf += 0.0000001f;
-                                pyb += 0.0000001f;
+                        if (pyf > 0.0f || pyb > 0.0f)
+                        {
+                            pyf += 0.0000001f;
+                            pyb += 0.0000001f;
 
-                                pYFVal += pyf / (pyf + pyb);
-                                pYBVal += pyb / (pyf + pyb);
-                            }
-                            cnt++;
+                            pYFVal += pyf / (pyf + pyb);
+                            pYBVal += pyb / (pyf + pyb);
                         }
+                        cnt++;
                     }
 
                     if (cnt)
@@ -579,7 +696,7 @@ class Parallel_For_templateMatcher : public cv::ParallelLoopBody
   public:
     float
     evaluateEnergyFunction(TCLCHistograms* tclcHistograms,
-                           const std::vector<PixelData>& compressedPixelData,
+                           const CompressedPixelData& compressedPixelData,
                            const cv::Mat& binned,
                            int offsetX,
                            int offsetY) const
@@ -589,22 +706,31 @@ class Parallel_For_templateMatcher : public cv::ParallelLoopBody
 
         int* binsData = (int*)binned.ptr<int>();
 
-        cv::Mat localFG = tclcHistograms->getLocalForegroundHistograms();
-        cv::Mat localBG = tclcHistograms->getLocalBackgroundHistograms();
+        cv::Mat localPosteriors = tclcHistograms->getLocalPosteriors();
 
-        uchar* initializedData = tclcHistograms->getInitialized().data;
+        float* posteriorsData = (float*)localPosteriors.ptr<float>();
+
+        int histogramSize = localPosteriors.cols;
+
+        const int* slotsData = tclcHistograms->getHistogramSlots().data();
 
         int fullWidth = binned.cols;
         int fullHeight = binned.rows;
 
-        for (size_t p = 0; p < compressedPixelData.size(); p++)
-        {
-            PixelData pixelData = compressedPixelData[p];
+        int numPixels = compressedPixelData.numPixels;
 
-            float hsVal = pixelData.hsVal;
+        const int* xData = compressedPixelData.x;
+        const int* yData = compressedPixelData.y;
+        const float* hsData = compressedPixelData.hsVal;
+        const int* offsetsData = compressedPixelData.offsets;
+        const int* idsData = compressedPixelData.ids;
 
-            int px = pixelData.x + offsetX;
-            int py = pixelData.y + offsetY;
+        for (int p = 0; p < numPixels; p++)
+        {
+            float hsVal = hsData[p];
+
+            int px = xData[p] + offsetX;
+            int py = yData[p] + offsetY;
 
             if (py >= 0 && py < fullHeight && px >= 0 && px < fullWidth)
             {
@@ -615,19 +741,16 @@ class Parallel_For_templateMatcher : public cv::ParallelLoopBody
                 float pYBVal = 0;
 
                 int cnt = 0;
-                for (int i = 0; i < pixelData.ids_size; i++)
+                for (int i = offsetsData[p]; i < offsetsData[p + 1]; i++)
                 {
-                    int hID = pixelData.ids[i];
-                    if (initializedData[hID])
+                    int slot = slotsData[idsData[i]];
+                    if (slot >= 0)
                     {
-                        float pyf = localFG.at<float>(hID, binIdx);
-                        float pyb = localBG.at<float>(hID, binIdx);
-
-                        pyf += 0.0000001f;
-                        pyb += 0.0000001f;
+                        float pyf = posteriorsData[slot * histogramSize +
+                                                   binIdx];
 
-                        pYFVal += pyf / (pyf + pyb);
-                        pYBVal += pyb / (pyf + pyb);
+                        pYFVal += pyf;
+                        pYBVal += 1.0f - pyf;
 
                         cnt++;
                     }
@@ -645,7 +768,7 @@ class Parallel_For_templateMatcher : public cv::ParallelLoopBody
             }
         }
 
-        if (sum && (float)sum / compressedPixelData.size() > 0.5f)
+        if (sum && (float)sum / numPixels > 0.5f)
             e /= sum;
         else
             e = FLT_MAX;
@@ -670,6 +793,13 @@ class Parallel_For_exhaustiveSearch : public Parallel_For_templateMatcher
     cv::Mat binned;
     cv::Mat prMap;
 
+    // the posterior response map packed into rows of 64 bit words
+    std::vector<uint64_t> prBits;
+    int prWords;
+
+    // the summed area table of the foreground pixels in the response map
+    cv::Mat prSAT;
+
     int level;
     int step;
     int diameter;
@@ -692,53 +822,77 @@ class Parallel_For_exhaustiveSearch : public Parallel_For_templateMatcher
         this->level = level;
         this->step = step;
         this->diameter = diameter;
-    }
 
-    float computeMapMaskMatch(const cv::Mat& map,
-                              const cv::Mat& mask,
-                              int etaF,
-                              int offsetX,
-                              int offsetY,
-                              int innerOffset) const
-    {
-        float score = 0.0f;
+        prWords = (prMap.cols + 63) / 64;
+        prBits.assign((size_t)prMap.rows * prWords, 0);
 
-        uchar* mapData = map.data;
-        uchar* maskData = mask.data;
+        prSAT.create(prMap.rows + 1, prMap.cols + 1, CV_32SC1);
+        std::fill(prSAT.ptr<int>(0), prSAT.ptr<int>(0) + prSAT.cols, 0);
 
-        int fullWidth = map.cols;
-        int fullHeight = map.rows;
+        for (int y = 0; y < prMap.rows; y++)
+        {
+            const uchar* mapRow = prMap.ptr<uchar>(y);
+            uint64_t* bitsRow = prBits.data() + (size_t)y * prWords;
 
-        int cnt = 0;
+            const int* satRow = prSAT.ptr<int>(y);
+            int* nextSATRow = prSAT.ptr<int>(y + 1);
 
-        for (int j = innerOffset; j < mask.rows - innerOffset; j++)
-        {
-            int idx = j * mask.cols + innerOffset;
+            nextSATRow[0] = 0;
 
-            for (int i = innerOffset; i < mask.cols - innerOffset; i++, idx++)
+            int rowSum = 0;
+            for (int x = 0; x < prMap.cols; x++)
             {
-                int px = i + offsetX;
-                int py = j + offsetY;
-
-                if (py >= 0 && py < fullHeight && px >= 0 && px < fullWidth)
+                if (mapRow[x])
                 {
-                    int pIdx = py * fullWidth + px;
-
-                    if (maskData[idx] && mapData[pIdx])
-                    {
-                        cnt++;
-                    }
+                    bitsRow[x / 64] |= (uint64_t)1 << (x % 64);
+                    rowSum++;
                 }
+                nextSATRow[x + 1] = satRow[x + 1] + rowSum;
             }
         }
+    }
 
-        score = (float)cnt / etaF;
+    /**
+     *  Returns the number of foreground pixels of the posterior response map
+     *  within the given window, which is clipped to the map.
+     */
+    int countResponses(int x0, int y0, int x1, int y1) const
+    {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, prMap.cols);
+        y1 = std::min(y1, prMap.rows);
+
+        if (x0 >= x1 || y0 >= y1)
+        {
+            return 0;
+        }
 
-        return score;
+        return prSAT.at<int>(y1, x1) - prSAT.at<int>(y0, x1) -
+               prSAT.at<int>(y1, x0) + prSAT.at<int>(y0, x0);
+    }
+
+    /**
+     *  Computes the fraction of the template's foreground pixels etaF that
+     *  overlap with the foreground of the posterior response map at the
+     *  given offset, considering only the inner region of the mask. The
+     *  overlap is counted with an AND and a popcount per 64 pixels.
+     */
+    float computeMapMaskMatch(const MaskBits& maskBits,
+                              int etaF,
+                              int offsetX,
+                              int offsetY) const
+    {
+        int cnt = maskBits.countOverlap(
+            prBits.data(), prWords, prMap.rows, offsetX, offsetY);
+
+        return (float)cnt / etaF;
     }
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_exhaustiveSearch");
+
         for (int t = r.start; t < r.end; t++)
         {
             auto& tclcHistograms = object->getTCLCHistograms();
@@ -750,10 +904,11 @@ class Parallel_For_exhaustiveSearch : public Parallel_For_templateMatcher
             cv::Mat heaviside = tv->getHeaviside(level);
             std::vector<cv::Point3i> centersIDs = tv->getCentersAndIDs(level);
 
-            cv::Mat mask = tv->getMask(level);
             int etaF = tv->getEtaF(level);
 
-            std::vector<PixelData> compressedPixelData =
+            const MaskBits& maskBits = tv->getMaskBits(level);
+
+            const CompressedPixelData& compressedPixelData =
                 tv->getCompressedPixelData(level);
 
             int xStart, xEnd, yStart, yEnd;
@@ -780,26 +935,37 @@ class Parallel_For_exhaustiveSearch : public Parallel_For_templateMatcher
             int finalX = 0;
             int finalY = 0;
 
+            const std::vector<int>& slots = tclcHistograms.getHistogramSlots();
+
             int initCnt = 0;
             for (size_t i = 0; i < centersIDs.size(); i++)
             {
-                if (tclcHistograms.getInitialized().data[centersIDs[i].z])
+                if (slots[centersIDs[i].z] >= 0)
                     initCnt++;
             }
 
-            if ((float)initCnt / centersIDs.size() > 0.5f)
+            // the overlap can neither exceed the inner mask nor the responses
+            // within the inner window, so most offsets are rejected by these
+            // upper bounds without changing any score
+            if ((float)initCnt / centersIDs.size() > 0.5f &&
+                (float)maskBits.count / etaF > 0.5f)
             {
                 std::vector<cv::Point2i> offsets;
                 for (int offsetY = yStart; offsetY < yEnd; offsetY += step)
                 {
                     for (int offsetX = xStart; offsetX < xEnd; offsetX += step)
                     {
-                        if (computeMapMaskMatch(prMap,
-                                                mask,
-                                                etaF,
-                                                offsetX,
-                                                offsetY,
-                                                innerOffset) > 0.5f)
+                        int x0 = offsetX + innerOffset;
+                        int y0 = offsetY + innerOffset;
+
+                        int bound = countResponses(x0,
+                                                   y0,
+                                                   x0 + maskBits.cols,
+                                                   y0 + maskBits.rows);
+
+                        if ((float)bound / etaF > 0.5f &&
+                            computeMapMaskMatch(
+                                maskBits, etaF, offsetX, offsetY) > 0.5f)
                         {
                             offsets.push_back(cv::Point2i(offsetX, offsetY));
 
@@ -880,6 +1046,8 @@ class Parallel_For_neighborSearch : public Parallel_For_templateMatcher
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_neighborSearch");
+
         for (int t = r.start; t < r.end; t++)
         {
             auto& tclcHistograms = object->getTCLCHistograms();
@@ -890,7 +1058,7 @@ class Parallel_For_neighborSearch : public Parallel_For_templateMatcher
             std::vector<cv::Point3i> centersIDs =
                 neighbor->getCentersAndIDs(level);
 
-            std::vector<PixelData> compressedPixelData =
+            const CompressedPixelData& compressedPixelData =
                 neighbor->getCompressedPixelData(level);
 
             int centerX = roi.x + roi.width / 2;
@@ -33,26 +33,53 @@
  * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
 
 #include <QApplication>
+#include <QGuiApplication>
 #include <QThread>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "Arguments.hpp"
+#include "AsyncVideo.hpp"
 #include "Pose.hpp"
 #include "Recording.hpp"
+#include "execution_context.h"
 #include "object3d.h"
 #include "pose_estimator6d.h"
+#include "trace.h"
 #include "video.hpp"
 
 using namespace std;
 using namespace cv;
 using TrackbarAction = std::function<void(int)>;
 
+void writeTrace(const std::optional<std::filesystem::path>& path)
+{
+    if (!path)
+    {
+        return;
+    }
+
+    if (!Trace::writeChromeTrace(path->string()))
+    {
+        cerr << "Unable to write " << *path << '\n' << flush;
+    }
+    else if (Trace::getNumDroppedEvents() != 0)
+    {
+        cerr << Trace::getNumDroppedEvents()
+             << " trace events were dropped\n"
+             << flush;
+    }
+}
+
 void render(const vector<Object3D*>& objects)
 {
     // render the models with phong shading
@@ -65,6 +92,29 @@ void render(const vector<Object3D*>& objects)
         vector<Model*>(objects.begin(), objects.end()), GL_FILL, colors, true);
 }
 
+cv::Rect renderMask(Object3D* object, cv::Mat& mask)
+{
+    // render the silhouette mask, but only download it within the 2D bounding
+    // box of the object
+    RenderingEngine::Instance()->setLevel(0);
+    RenderingEngine::Instance()->renderSilhouette(
+        object, GL_FILL, false, 1.0f, 1.0f, 1.0f, true);
+
+    vector<Point2f> projections;
+    Rect boundingRect;
+    RenderingEngine::Instance()->projectBoundingBox(
+        object, projections, boundingRect);
+
+    Size frameSize = RenderingEngine::Instance()->getFrameSize();
+    Rect roi = boundingRect & Rect(0, 0, frameSize.width, frameSize.height);
+    if (roi.area() > 0)
+    {
+        RenderingEngine::Instance()->downloadFrame(
+            RenderingEngine::MASK, mask, roi);
+    }
+    return roi;
+}
+
 cv::Mat drawResultOverlay(const cv::Mat& frame, const cv::Mat& depth)
 {
     // download the rendering to the CPU
@@ -94,20 +144,104 @@ cv::Mat drawResultOverlay(const cv::Mat& frame, const cv::Mat& depth)
     return result;
 }
 
+int trackHeadless(fds::AsyncVideo& video,
+                  PoseEstimator6D& poseEstimator,
+                  Object3D& object,
+                  const std::filesystem::path& posesPath)
+{
+    std::ofstream poses(posesPath);
+    if (!poses)
+    {
+        cerr << "Unable to open " << posesPath << '\n' << flush;
+        return 1;
+    }
+
+    // one line per frame with the tracking state and the row-major 4x4 pose
+    poses << "frame,lost";
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            poses << ",m" << i << j;
+        }
+    }
+    poses << '\n';
+
+    Mat frame;
+    size_t numFrames = 0;
+    auto start = chrono::steady_clock::now();
+
+    try
+    {
+        for (;; numFrames++)
+        {
+            video.readNextFrameInto(frame);
+
+            if (numFrames == 0)
+            {
+                // start tracking from the initial pose
+                poseEstimator.toggleTracking(frame, 0, false);
+                poseEstimator.estimatePoses(frame, true, false);
+            }
+            else
+            {
+                poseEstimator.estimatePoses(frame, false, true);
+            }
+
+            Matx44f pose = object.getPose();
+            poses << numFrames << ',' << object.isTrackingLost();
+            for (int i = 0; i < 16; i++)
+            {
+                poses << ',' << pose.val[i];
+            }
+            poses << '\n';
+        }
+    }
+    catch (const fds::EndOfVideo&)
+    {
+    }
+
+    double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << numFrames << " frames in " << seconds << " s, "
+         << (seconds > 0 ? numFrames / seconds : 0.0) << " fps\n"
+         << flush;
+
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
-    QApplication a(argc, argv);
     auto const args = fds::Arguments{argc, argv};
 
+    // headless runs need no widgets and with the CPU renderer not even a
+    // display connection
+    std::unique_ptr<QGuiApplication> application;
+    if (!args.getHeadless())
+    {
+        application = std::make_unique<QApplication>(argc, argv);
+    }
+    else if (!args.useCPURenderer())
+    {
+        application = std::make_unique<QGuiApplication>(argc, argv);
+    }
+
     // Camera image size
     auto const width = 640;
     auto const height = 480;
 
-    auto video = args.useCVVideo()
-        ? fds::makeCVV4l2Video(args.getDevicePath(), width, height)
-        : args.useCVFileVideo()
-            ? fds::makeCVFileVideo(args.getDevicePath(), width, height) 
-            : fds::makeSHMVideo();
+    // capture on a separate thread, live sources always deliver their latest
+    // frame while files are played back without skipping frames
+    auto const isLiveVideo = !args.useCVFileVideo();
+    auto video = std::make_unique<fds::AsyncVideo>(
+        args.useCVVideo()
+            ? fds::makeCVV4l2Video(args.getDevicePath(), width, height)
+            : args.useCVFileVideo()
+                ? fds::makeCVFileVideo(
+                      args.getDevicePath(), width, height, !args.getHeadless())
+                : fds::makeSHMVideo(),
+        3,
+        isLiveVideo ? fds::FramePolicy::dropOldest : fds::FramePolicy::block);
 
     // Near and far plane of the OpenGL view frustum.
     auto const zNear = 0.005f;
@@ -118,7 +252,8 @@ int main(int argc, char* argv[])
     Matx33f K = Matx33f(627.746, 0, 327.113, 0, 627.746, 242.4199, 0, 0, 1);
     Matx14f distCoeffs = Matx14f(0.0, 0, 0.0, 0.0);
 
-    auto pose = fds::Pose{0, 0, args.getZDistance(), 11, 184, 180};
+    auto pose = args.getInitialPose().value_or(
+        fds::Pose{0, 0, args.getZDistance(), 11, 184, 180});
 
     auto distances = args.getTemplateDistances();
 
@@ -134,8 +269,29 @@ int main(int argc, char* argv[])
                            args.getQualityThreshold(),
                            distances);
 
+    if (auto const cacheDirectory = args.getTemplateCacheDirectory();
+        cacheDirectory)
+    {
+        std::filesystem::create_directories(cacheDirectory.value());
+        object.setTemplateCacheDirectory(cacheDirectory.value().string());
+    }
+
     auto objects = std::vector<Object3D*>{&object};
 
+    // render on the CPU instead of OpenGL, e.g. on machines without a GPU
+    if (args.useCPURenderer())
+    {
+        RenderingEngine::setBackend(RenderingEngine::CPU);
+    }
+
+    // size (and optionally pin) the worker threads before the templates are
+    // generated, all per-frame kernels are split by this context
+    auto const context = ExecutionContext{
+        static_cast<int>(args.getThreads()),
+        args.getPinThreads(),
+        static_cast<int>(args.getRelocalizationThreads())};
+    context.apply();
+
     auto poseEstimator = PoseEstimator6D{width,
                                          height,
                                          zNear,
@@ -143,7 +299,8 @@ int main(int argc, char* argv[])
                                          K,
                                          distCoeffs,
                                          objects,
-                                         args.getGenerateObjectTemplates()};
+                                         args.getGenerateObjectTemplates(),
+                                         context};
 
     // move the OpenGL context for offscreen rendering to the current thread, if
     // run in a seperate QT worker thread (unnessary in this example)
@@ -153,6 +310,19 @@ int main(int argc, char* argv[])
     // estimation
     RenderingEngine::Instance()->makeCurrent();
 
+    if (args.getHeadless())
+    {
+        int result = trackHeadless(
+            *video, poseEstimator, object, args.getPosesPath());
+
+        RenderingEngine::Instance()->doneCurrent();
+        RenderingEngine::Instance()->destroy();
+
+        writeTrace(args.getTracePath());
+
+        return result;
+    }
+
     bool showHelp = true;
 
     constexpr auto window_name = "RBOT";
@@ -250,15 +420,33 @@ int main(int argc, char* argv[])
         objectPath,
         K,
         object.getDiameter(),
+        args.getRecordingThreads(),
+        args.getRecordingQueueCapacity(),
+        args.getRecordingPolicy(),
     };
 
+    cv::Mat mask;
+
     for (cv::Mat frame;;)
     {
-        video->readFrameInto(frame);
+        if (isLiveVideo)
+        {
+            video->readLatestFrameInto(frame);
+        }
+        else
+        {
+            video->readNextFrameInto(frame);
+        }
 
         // the main pose uodate call
         poseEstimator.estimatePoses(frame, false, true);
 
+        if (recording.getIsRecording())
+        {
+            auto maskROI = renderMask(&object, mask);
+            recording.update(frame, mask, maskROI, object.getPose());
+        }
+
         // render the models with the resulting pose estimates ontop of the
         // input image
         render(objects);
@@ -266,8 +454,6 @@ int main(int argc, char* argv[])
             RenderingEngine::Instance()->downloadFrame(RenderingEngine::DEPTH);
         auto result = drawResultOverlay(frame, depth);
 
-        recording.update(frame, depth, object.getPose());
-
         if (showHelp)
         {
             putText(result,
@@ -324,6 +510,24 @@ int main(int argc, char* argv[])
                 Scalar(0, 255, 0),
                 1);
 
+        if (isRecording)
+        {
+            auto const stats = recording.getStats();
+            putText(result,
+                    "queued: " + std::to_string(stats.queueDepth) +
+                        " dropped: " +
+                        std::to_string(stats.droppedFrameCount) +
+                        " encode: " +
+                        std::to_string(
+                            static_cast<int>(stats.meanEncodeMilliseconds)) +
+                        " ms",
+                    Point(10, 135),
+                    FONT_HERSHEY_DUPLEX,
+                    0.6,
+                    Scalar(0, 255, 0),
+                    1);
+        }
+
         imshow(window_name, result);
 
         int key = cv::waitKey(1 /* delay */);
@@ -357,4 +561,6 @@ int main(int argc, char* argv[])
 
     // clean up
     RenderingEngine::Instance()->destroy();
+
+    writeTrace(args.getTracePath());
 }
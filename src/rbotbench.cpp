@@ -0,0 +1,556 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <QGuiApplication>
+#include <cxxopts.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "../src/RecordingFile.hpp"
+#include "execution_context.h"
+#include "object3d.h"
+#include "pose_estimator6d.h"
+#include "stage_timer.h"
+#include "trace.h"
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // A pose counts as tracked successfully if it deviates from the ground
+    // truth by less than 5 cm and 5 degrees.
+    constexpr auto maxTranslationError = 50.0f;
+    constexpr auto maxRotationError = 5.0f;
+
+    // A sequence of frames with a ground truth pose each, along with the
+    // camera and the model of the tracked object.
+    struct Sequence final
+    {
+        std::string name;
+        fs::path modelPath;
+        cv::Matx33f K;
+        cv::Matx14f distCoeffs;
+        std::vector<cv::Matx44f> poses;
+        std::function<cv::Mat(std::size_t)> readFrame;
+    };
+
+    // Reads all numbers of a text file, skipping the lines that are not
+    // entirely numeric such as header rows.
+    auto readNumbers(fs::path const& path) -> std::vector<float>
+    {
+        auto file = std::ifstream{path};
+        if (!file)
+        {
+            throw std::runtime_error{"Unable to open " + path.string() + "\n"};
+        }
+
+        auto numbers = std::vector<float>{};
+        auto lineNumbers = std::vector<float>{};
+        for (auto line = std::string{}; std::getline(file, line);)
+        {
+            auto stream = std::istringstream{line};
+
+            lineNumbers.clear();
+            for (auto number = 0.0f; stream >> number;)
+            {
+                lineNumbers.push_back(number);
+            }
+
+            // extraction stops before the end of the line at the first token
+            // that is not a number
+            if (stream.eof())
+            {
+                numbers.insert(
+                    numbers.end(), lineNumbers.begin(), lineNumbers.end());
+            }
+        }
+        return numbers;
+    }
+
+    // The dataset keeps the camera and the ground truth next to the object
+    // directories, but a copy within an object directory takes precedence.
+    auto findDatasetFile(fs::path const& directory, std::string const& name)
+        -> fs::path
+    {
+        auto const path = directory / name;
+        if (fs::exists(path))
+        {
+            return path;
+        }
+        return directory.parent_path() / name;
+    }
+
+    // Loads a sequence of the RBOT dataset, i.e. the frames
+    // <directory>/frames/<sequence>NNNN.png with the camera of
+    // camera_calibration.txt (fx fy cx cy and optionally k1 k2 p1 p2) and
+    // the poses of poses_first.txt (row-major rotation and translation in mm,
+    // optionally preceded by their number).
+    auto loadRBOTSequence(fs::path const& directory,
+                          std::string const& sequence,
+                          std::optional<fs::path> const& modelPath)
+        -> Sequence
+    {
+        auto const camera =
+            readNumbers(findDatasetFile(directory, "camera_calibration.txt"));
+        if (camera.size() < 4)
+        {
+            throw std::runtime_error{"Invalid camera calibration\n"};
+        }
+
+        auto numbers =
+            readNumbers(findDatasetFile(directory, "poses_first.txt"));
+        if (numbers.size() % 12 == 1)
+        {
+            numbers.erase(numbers.begin());
+        }
+        if (numbers.empty() || numbers.size() % 12 != 0)
+        {
+            throw std::runtime_error{"Invalid ground truth poses\n"};
+        }
+
+        auto poses = std::vector<cv::Matx44f>{};
+        for (auto i = std::size_t{0}; i < numbers.size(); i += 12)
+        {
+            auto const* r = &numbers[i];
+            auto const* t = &numbers[i + 9];
+            poses.push_back(cv::Matx44f{r[0], r[1], r[2], t[0],
+                                        r[3], r[4], r[5], t[1],
+                                        r[6], r[7], r[8], t[2],
+                                        0.0f, 0.0f, 0.0f, 1.0f});
+        }
+
+        auto const name = directory.filename().string();
+        auto readFrame = [directory, sequence](std::size_t i) -> cv::Mat {
+            auto number = std::ostringstream{};
+            number << std::setw(4) << std::setfill('0') << i;
+            auto const path =
+                directory / "frames" / (sequence + number.str() + ".png");
+
+            auto frame = cv::imread(path.string());
+            if (frame.empty())
+            {
+                throw std::runtime_error{"Unable to read " + path.string() +
+                                         "\n"};
+            }
+            return frame;
+        };
+
+        return {
+            name + "/" + sequence,
+            modelPath.value_or(directory / (name + ".obj")),
+            {camera[0], 0.0f, camera[2], 0.0f, camera[1], camera[3], 0.0f,
+             0.0f, 1.0f},
+            camera.size() >= 8
+                ? cv::Matx14f{camera[4], camera[5], camera[6], camera[7]}
+                : cv::Matx14f{},
+            std::move(poses),
+            std::move(readFrame),
+        };
+    }
+
+    // Loads a directory written by Recording, the recorded poses serve as the
+    // ground truth.
+    auto loadRecording(fs::path const& directory,
+                       std::optional<fs::path> const& modelPath) -> Sequence
+    {
+        auto const recording = std::make_shared<fds::RecordingFileReader>(
+            directory / "recording.rbot");
+
+        auto poses = std::vector<cv::Matx44f>{};
+        for (auto i = std::size_t{0}; i < recording->getFrameCount(); ++i)
+        {
+            poses.push_back(recording->readRecord(i).pose);
+        }
+
+        return {
+            directory.filename().string(),
+            modelPath.value_or(directory / "model.ply"),
+            recording->getK(),
+            cv::Matx14f{},
+            std::move(poses),
+            [recording](std::size_t i) { return recording->readFrame(i).rgb; },
+        };
+    }
+
+    auto getTranslationError(cv::Matx44f const& pose,
+                             cv::Matx44f const& groundTruth) -> float
+    {
+        auto const dx = pose(0, 3) - groundTruth(0, 3);
+        auto const dy = pose(1, 3) - groundTruth(1, 3);
+        auto const dz = pose(2, 3) - groundTruth(2, 3);
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    // The angle of the rotation between both poses in degrees.
+    auto getRotationError(cv::Matx44f const& pose,
+                          cv::Matx44f const& groundTruth) -> float
+    {
+        auto trace = 0.0f;
+        for (auto i = 0; i < 3; ++i)
+        {
+            for (auto j = 0; j < 3; ++j)
+            {
+                trace += pose(j, i) * groundTruth(j, i);
+            }
+        }
+        auto const cosine = std::clamp((trace - 1.0f) / 2.0f, -1.0f, 1.0f);
+        return std::acos(cosine) * 180.0f / static_cast<float>(CV_PI);
+    }
+
+    // Writes the mean, the maximum and the 50th, 90th and 99th nearest-rank
+    // percentiles of the given run times as a JSON object.
+    auto writeTimings(std::ostream& json, std::vector<double> milliseconds)
+        -> void
+    {
+        std::sort(milliseconds.begin(), milliseconds.end());
+
+        auto const percentile = [&milliseconds](double p) {
+            if (milliseconds.empty())
+            {
+                return 0.0;
+            }
+            auto const rank = static_cast<std::size_t>(
+                std::ceil(p / 100.0 * milliseconds.size()));
+            return milliseconds[std::max<std::size_t>(rank, 1) - 1];
+        };
+
+        auto sum = 0.0;
+        for (auto const value : milliseconds)
+        {
+            sum += value;
+        }
+
+        json << "{\"mean_ms\": "
+             << (milliseconds.empty() ? 0.0 : sum / milliseconds.size())
+             << ", \"p50_ms\": " << percentile(50.0)
+             << ", \"p90_ms\": " << percentile(90.0)
+             << ", \"p99_ms\": " << percentile(99.0) << ", \"max_ms\": "
+             << (milliseconds.empty() ? 0.0 : milliseconds.back()) << '}';
+    }
+
+    auto escapeJSON(std::string const& string) -> std::string
+    {
+        auto escaped = std::string{};
+        for (auto const c : string)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+} // namespace
+
+// Replays a sequence of the RBOT dataset or a recording with ground truth
+// poses through the tracker and reports the run times of its stages, the
+// throughput and the success rate as JSON. Like in the dataset's evaluation
+// protocol, tracking starts from the first ground truth pose and is reset to
+// the ground truth whenever it fails.
+auto main(int argc, char** argv) -> int
+{
+    auto options = cxxopts::Options{"rbot-bench"};
+
+    auto addOption = options.add_options();
+    addOption("h,help", "print this message");
+    addOption("frames",
+              "maximum number of frames to track, 0 for all",
+              cxxopts::value<std::size_t>()->default_value("0"));
+    addOption("json",
+              "file the results are written to instead of stdout",
+              cxxopts::value<fs::path>());
+    addOption("model",
+              "model file path instead of the one next to the frames",
+              cxxopts::value<fs::path>());
+    addOption("pin-threads",
+              "pin each tracking thread to its own core",
+              cxxopts::value<bool>()->default_value("false"));
+    addOption("q,quality-threshold",
+              "quality threshold before object lost",
+              cxxopts::value<float>()->default_value("0.55"));
+    addOption("r,renderer",
+              "rendering backend, either gl or cpu",
+              cxxopts::value<std::string>()->default_value("gl"));
+    addOption("relocalize",
+              "generate templates and relocalize lost objects",
+              cxxopts::value<bool>()->default_value("false"));
+    addOption("relocalization-threads",
+              "number of threads searching lost objects in the background, "
+              "0 searches within the frame",
+              cxxopts::value<int>()->default_value("0"));
+    addOption("sequence",
+              "RBOT sequence to replay",
+              cxxopts::value<std::string>()->default_value("a_regular"));
+    addOption("template-cache",
+              "directory generated object templates are cached in",
+              cxxopts::value<fs::path>());
+    addOption("t,template-distances",
+              "template distances in mm, used to relocalize lost objects",
+              cxxopts::value<std::vector<float>>()->default_value(
+                  "500,1000,1200"));
+    addOption("threads",
+              "number of tracking threads, 0 uses all logical cores",
+              cxxopts::value<int>()->default_value("0"));
+    addOption("trace",
+              "file a Chrome trace is written to, needs a build with "
+              "-Dtrace=true",
+              cxxopts::value<fs::path>());
+    addOption("input",
+              "RBOT object directory or recording directory",
+              cxxopts::value<fs::path>());
+
+    options.parse_positional({"input"});
+    options.positional_help("input");
+
+    auto result = [&]() -> std::variant<cxxopts::ParseResult, std::string> {
+        try
+        {
+            return {options.parse(argc, argv)};
+        }
+        catch (cxxopts::invalid_option_format_error const& error)
+        {
+            return {error.what()};
+        }
+        catch (cxxopts::option_not_exists_exception const& error)
+        {
+            return {error.what()};
+        }
+        catch (cxxopts::option_requires_argument_exception const& error)
+        {
+            return {error.what()};
+        }
+    }();
+
+    if (std::holds_alternative<std::string>(result))
+    {
+        auto const& error = std::get<std::string>(result);
+        std::cout << error << '\n' << std::flush;
+        return 1;
+    }
+
+    auto const& args = std::get<cxxopts::ParseResult>(result);
+
+    if (args.count("help"))
+    {
+        std::cout << options.help() << std::flush;
+        return 0;
+    }
+
+    if (args.count("input") == 0)
+    {
+        std::cerr << "An input directory is required\n" << std::flush;
+        return 1;
+    }
+
+    auto const renderer = args["renderer"].as<std::string>();
+    if (renderer != "gl" && renderer != "cpu")
+    {
+        std::cerr << "Unknown renderer " << renderer << '\n' << std::flush;
+        return 1;
+    }
+    auto const useCPURenderer = renderer == "cpu";
+
+    if (args.count("trace") && !Trace::isEnabled())
+    {
+        std::cerr << "Tracing is disabled in this build, configure it with "
+                     "-Dtrace=true\n"
+                  << std::flush;
+        return 1;
+    }
+
+    auto const input = args["input"].as<fs::path>();
+    auto const modelPath = args.count("model")
+                               ? std::optional{args["model"].as<fs::path>()}
+                               : std::nullopt;
+    auto const sequence =
+        fs::exists(input / "recording.rbot")
+            ? loadRecording(input, modelPath)
+            : loadRBOTSequence(
+                  input, args["sequence"].as<std::string>(), modelPath);
+
+    auto numFrames = sequence.poses.size();
+    if (auto const maxFrames = args["frames"].as<std::size_t>(); maxFrames)
+    {
+        numFrames = std::min(numFrames, maxFrames);
+    }
+    if (numFrames == 0)
+    {
+        std::cerr << "The sequence has no frames\n" << std::flush;
+        return 1;
+    }
+
+    // the OpenGL renderer needs a display connection, but no widgets
+    auto application = std::unique_ptr<QGuiApplication>{};
+    if (useCPURenderer)
+    {
+        RenderingEngine::setBackend(RenderingEngine::CPU);
+    }
+    else
+    {
+        application = std::make_unique<QGuiApplication>(argc, argv);
+    }
+
+    auto frame = sequence.readFrame(0);
+
+    auto distances = args["template-distances"].as<std::vector<float>>();
+    auto object = Object3D{sequence.modelPath.string(),
+                           0.0f,
+                           0.0f,
+                           0.0f,
+                           0.0f,
+                           0.0f,
+                           0.0f,
+                           1.0f,
+                           args["quality-threshold"].as<float>(),
+                           distances};
+    object.setInitialPose(sequence.poses[0]);
+    if (args.count("template-cache"))
+    {
+        auto const cacheDirectory = args["template-cache"].as<fs::path>();
+        fs::create_directories(cacheDirectory);
+        object.setTemplateCacheDirectory(cacheDirectory.string());
+    }
+
+    auto objects = std::vector<Object3D*>{&object};
+    auto const relocalize = args["relocalize"].as<bool>();
+
+    auto const context =
+        ExecutionContext{args["threads"].as<int>(),
+                         args["pin-threads"].as<bool>(),
+                         args["relocalization-threads"].as<int>()};
+    context.apply();
+
+    auto poseEstimator = PoseEstimator6D{frame.cols,
+                                         frame.rows,
+                                         0.005f,
+                                         10000.0f,
+                                         sequence.K,
+                                         sequence.distCoeffs,
+                                         objects,
+                                         relocalize,
+                                         context};
+
+    RenderingEngine::Instance()->makeCurrent();
+
+    auto const undistort = sequence.distCoeffs != cv::Matx14f{};
+    poseEstimator.toggleTracking(frame, 0, undistort);
+
+    // the run times per tracked frame of every stage followed by the total
+    auto timings = std::vector<std::vector<double>>(NUM_STAGES + 1);
+    auto numSuccesses = std::size_t{0};
+    auto trackingSeconds = 0.0;
+
+    auto const start = std::chrono::steady_clock::now();
+
+    for (auto i = std::size_t{1}; i < numFrames; ++i)
+    {
+        frame = sequence.readFrame(i);
+
+        auto const frameStart = std::chrono::steady_clock::now();
+        poseEstimator.estimatePoses(frame, undistort, relocalize);
+        auto const frameSeconds = std::chrono::duration<double>(
+                                      std::chrono::steady_clock::now() -
+                                      frameStart)
+                                      .count();
+
+        trackingSeconds += frameSeconds;
+        for (auto s = 0; s < NUM_STAGES; ++s)
+        {
+            timings[s].push_back(StageTimings::get(static_cast<Stage>(s)));
+        }
+        timings[NUM_STAGES].push_back(frameSeconds * 1000.0);
+
+        auto const& groundTruth = sequence.poses[i];
+        auto const pose = object.getPose();
+        if (!object.isTrackingLost() &&
+            getTranslationError(pose, groundTruth) < maxTranslationError &&
+            getRotationError(pose, groundTruth) < maxRotationError)
+        {
+            ++numSuccesses;
+        }
+        else
+        {
+            poseEstimator.resetPose(0, groundTruth);
+        }
+    }
+
+    auto const seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+    RenderingEngine::Instance()->doneCurrent();
+
+    auto const numTracked = numFrames - 1;
+
+    auto file = std::ofstream{};
+    if (args.count("json"))
+    {
+        file.open(args["json"].as<fs::path>());
+        if (!file)
+        {
+            std::cerr << "Unable to open " << args["json"].as<fs::path>()
+                      << '\n'
+                      << std::flush;
+            return 1;
+        }
+    }
+    auto& json = args.count("json") ? static_cast<std::ostream&>(file)
+                                    : std::cout;
+
+    json << "{\n  \"sequence\": \"" << escapeJSON(sequence.name) << "\",\n"
+         << "  \"renderer\": \"" << renderer << "\",\n"
+         << "  \"threads\": " << context.getNumThreads() << ",\n"
+         << "  \"pinned\": " << (context.getPinThreads() ? "true" : "false")
+         << ",\n"
+         << "  \"relocalization_threads\": "
+         << context.getNumRelocalizationThreads() << ",\n"
+         << "  \"frames\": " << numTracked << ",\n"
+         << "  \"successes\": " << numSuccesses << ",\n"
+         << "  \"success_rate\": "
+         << (numTracked ? double(numSuccesses) / numTracked : 0.0) << ",\n"
+         << "  \"tracking_fps\": "
+         << (trackingSeconds > 0 ? numTracked / trackingSeconds : 0.0)
+         << ",\n"
+         << "  \"wall_fps\": " << (seconds > 0 ? numTracked / seconds : 0.0)
+         << ",\n"
+         << "  \"stages\": {\n";
+    for (auto s = 0; s < NUM_STAGES; ++s)
+    {
+        json << "    \"" << StageTimings::getName(static_cast<Stage>(s))
+             << "\": ";
+        writeTimings(json, timings[s]);
+        json << ",\n";
+    }
+    json << "    \"total\": ";
+    writeTimings(json, timings[NUM_STAGES]);
+    json << "\n  }\n}\n" << std::flush;
+
+    if (args.count("trace"))
+    {
+        auto const tracePath = args["trace"].as<fs::path>();
+        if (!Trace::writeChromeTrace(tracePath.string()))
+        {
+            std::cerr << "Unable to write " << tracePath << '\n'
+                      << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <variant>
+
+#include <cxxopts.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/persistence.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "../src/RecordingFile.hpp"
+
+// Exports a recording file into a directory with one JPEG image, PNG mask and
+// YAML pose per frame, as well as the camera matrix and object diameter.
+auto main(int argc, char** argv) -> int
+{
+    auto options = cxxopts::Options{"rbotdecode"};
+
+    auto addOption = options.add_options();
+    addOption("h,help", "print this message");
+    addOption("recording",
+              "recording file path",
+              cxxopts::value<std::filesystem::path>());
+    addOption("output-directory",
+              "directory to export to",
+              cxxopts::value<std::filesystem::path>());
+
+    options.parse_positional({"recording", "output-directory"});
+    options.positional_help("recording output-directory");
+
+    auto result = [&]() -> std::variant<cxxopts::ParseResult, std::string> {
+        try
+        {
+            return {options.parse(argc, argv)};
+        }
+        catch (cxxopts::invalid_option_format_error const& error)
+        {
+            return {error.what()};
+        }
+        catch (cxxopts::option_not_exists_exception const& error)
+        {
+            return {error.what()};
+        }
+        catch (cxxopts::option_requires_argument_exception const& error)
+        {
+            return {error.what()};
+        }
+    }();
+
+    if (std::holds_alternative<std::string>(result))
+    {
+        auto const& error = std::get<std::string>(result);
+        std::cout << error << '\n' << std::flush;
+        return 1;
+    }
+
+    auto const& args = std::get<cxxopts::ParseResult>(result);
+
+    if (args.count("help"))
+    {
+        std::cout << options.help() << std::flush;
+        return 0;
+    }
+
+    if (args.count("recording") == 0 || args.count("output-directory") == 0)
+    {
+        std::cerr << "A recording and an output directory are required\n"
+                  << std::flush;
+        return 1;
+    }
+
+    namespace fs = std::filesystem;
+    auto const directory = args["output-directory"].as<fs::path>();
+    auto const recording =
+        fds::RecordingFileReader{args["recording"].as<fs::path>()};
+
+    fs::create_directories(directory / "rgb");
+    fs::create_directories(directory / "mask");
+    fs::create_directories(directory / "pose");
+
+    auto kFile = cv::FileStorage{directory / "camera.yml",
+                                 cv::FileStorage::WRITE};
+    kFile << "camera" << recording.getK();
+    auto diameterFile = cv::FileStorage{directory / "diameter.yml",
+                                        cv::FileStorage::WRITE};
+    diameterFile << "diameter" << recording.getDiameter();
+
+    cv::Mat mask;
+
+    for (auto i = std::size_t{0}; i < recording.getFrameCount(); ++i)
+    {
+        std::cout << '\r' << i + 1 << '/' << recording.getFrameCount()
+                  << std::flush;
+
+        auto const frame = recording.readRecord(i);
+        auto const name = std::to_string(frame.frameNumber);
+
+        // the image is already JPEG encoded
+        auto rgbFile = std::ofstream{directory / "rgb" / (name + ".jpg"),
+                                     std::ios::binary};
+        rgbFile.write(reinterpret_cast<char const*>(frame.rgb.data()),
+                      frame.rgb.size());
+
+        fds::decodeMask(frame.maskEncoding,
+                        frame.mask.data(),
+                        frame.mask.size(),
+                        frame.maskROI,
+                        frame.size,
+                        mask);
+        cv::imwrite(directory / "mask" / (name + ".png"), mask);
+
+        auto poseFile = cv::FileStorage{directory / "pose" / (name + ".yml"),
+                                        cv::FileStorage::WRITE};
+        poseFile << "pose" << frame.pose;
+    }
+
+    std::cout << '\n' << std::flush;
+
+    return 0;
+}
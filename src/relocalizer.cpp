@@ -0,0 +1,435 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "relocalizer.h"
+
+#include <algorithm>
+
+#include "object3d.h"
+#include "pose_estimator6d.h"
+#include "trace.h"
+
+using namespace std;
+using namespace cv;
+
+static bool sortTemplateView(std::pair<float, TemplateView*> a,
+                             std::pair<float, TemplateView*> b)
+{
+    return a.first < b.first;
+}
+
+Relocalizer::Relocalizer(const cv::Matx33f& K, const ExecutionContext& context)
+    : K{K}, context{context}
+{
+    int numThreads = context.getNumRelocalizationThreads();
+
+    // a background search splits its loops among its own threads
+    if (numThreads > 0)
+    {
+        this->context = ExecutionContext(numThreads);
+    }
+
+    loopBody = nullptr;
+    nextIndex = 0;
+    loopGeneration = 0;
+    numBusy = 0;
+
+    stopping = false;
+    stoppingLoops = false;
+
+    if (numThreads > 0)
+    {
+        workers.push_back(thread(&Relocalizer::runSearches, this));
+
+        for (int i = 1; i < numThreads; i++)
+        {
+            workers.push_back(thread(&Relocalizer::runLoops, this));
+        }
+    }
+}
+
+Relocalizer::~Relocalizer()
+{
+    if (workers.empty())
+    {
+        return;
+    }
+
+    // let a running search finish before its helpers are stopped
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    workers[0].join();
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stoppingLoops = true;
+    }
+    loopAvailable.notify_all();
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+bool Relocalizer::isAsynchronous() const
+{
+    return !workers.empty();
+}
+
+void Relocalizer::search(Object3D* object,
+                         const vector<Mat>& imagePyramid,
+                         vector<Matx44f>& poses)
+{
+    TRACE_SCOPE("Relocalizer::search");
+
+    poses.clear();
+
+    vector<TemplateView*> templateViews = object->getTemplateViews();
+
+    int numDistances = object->getNumDistances();
+
+    int level = 3;
+
+    // PREPARE FRAME FOR LOWEST LEVEL
+    Mat binned;
+    convertToBins(object, imagePyramid[level], binned);
+
+    Mat prMap;
+    int threads = context.getNumPartitions(binned.rows);
+    parallelFor(cv::Range(0, threads),
+                Parallel_For_createPosteriorResponseMap(
+                    &object->getTCLCHistograms(), binned, prMap, threads));
+
+    parallelFor(cv::Range(0, (int)templateViews.size()),
+                Parallel_For_exhaustiveSearch(
+                    object, templateViews, binned, prMap, level, 4, -1));
+
+    parallelFor(cv::Range(0, (int)templateViews.size()),
+                Parallel_For_exhaustiveSearch(
+                    object, templateViews, binned, prMap, level, 1, 2));
+
+    // KEEP ONLY THE BEST MATCHING DISTANCE PER TEMPLATE
+    vector<pair<float, TemplateView*>> errorKVMap0;
+
+    for (size_t i = 0; i < templateViews.size(); i += numDistances)
+    {
+        float minE = FLT_MAX;
+        int minIdx = -1;
+        for (int j = 0; j < numDistances; j++)
+        {
+            TemplateView* templateView = templateViews[i + j];
+            Point3f offset = templateView->getCurrentOffset(level);
+
+            if (offset.z < minE)
+            {
+                minE = offset.z;
+                minIdx = j;
+            }
+        }
+        if (minE > 0.0f && minIdx >= 0)
+        {
+            errorKVMap0.push_back(
+                pair<float, TemplateView*>(minE, templateViews[i + minIdx]));
+        }
+    }
+
+    sort(errorKVMap0.begin(), errorKVMap0.end(), sortTemplateView);
+
+    level = 2;
+
+    // PREPARE FRAME FOR 2ND LOWEST LEVEL
+    convertToBins(object, imagePyramid[level], binned);
+
+    vector<pair<float, TemplateView*>> errorKVMap;
+
+    for (size_t i = 0; i < errorKVMap0.size() / 2; i++)
+    {
+        float kve = errorKVMap0[i].first;
+        TemplateView* templateView = errorKVMap0[i].second;
+
+        if (kve > 0.0f && kve < 1.0f)
+        {
+            parallelFor(
+                cv::Range(0, (int)templateView->getNeighborTemplates().size()),
+                Parallel_For_neighborSearch(
+                    object, templateView, binned, level, 1));
+
+            for (size_t n = 0; n < templateView->getNeighborTemplates().size();
+                 n++)
+            {
+                TemplateView* kvn = templateView->getNeighborTemplates()[n];
+
+                float e = kvn->getCurrentOffset(level).z;
+
+                if (e > 0.0f && e < 1.0f)
+                    errorKVMap.push_back(pair<float, TemplateView*>(e, kvn));
+            }
+        }
+    }
+
+    sort(errorKVMap.begin(), errorKVMap.end(), sortTemplateView);
+
+    // PLACE THE BEST TEMPLATES AT THEIR MATCHED 2D LOCATIONS
+    for (int i = 0; i < std::min(4, (int)errorKVMap.size()); i++)
+    {
+        TemplateView* templateView = errorKVMap[i].second;
+
+        Point3f offset = templateView->getCurrentOffset(level);
+
+        int offsetX = offset.x;
+        int offsetY = offset.y;
+        float offsetE = offset.z;
+
+        if (offsetE > 0 && offsetE < 1.0f)
+        {
+            Rect roi = templateView->getROI(level);
+
+            Vec3f offsetVec(
+                (-roi.x + offsetX) * pow(2, level) + imagePyramid[0].cols / 2,
+                (-roi.y + offsetY) * pow(2, level) + imagePyramid[0].rows / 2,
+                1);
+
+            Matx44f pose = templateView->getPose();
+
+            offsetVec = K.inv() * offsetVec;
+            pose(0, 3) = offsetVec[0] * pose(2, 3);
+            pose(1, 3) = offsetVec[1] * pose(2, 3);
+
+            poses.push_back(pose);
+        }
+    }
+}
+
+void Relocalizer::request(Object3D* object, const vector<Mat>& imagePyramid)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    for (list<Job>::iterator it = jobs.begin(); it != jobs.end(); it++)
+    {
+        if (it->object == object)
+        {
+            return;
+        }
+    }
+
+    Job job;
+    job.object = object;
+    job.running = false;
+    job.finished = false;
+
+    // the tracker builds a new pyramid every frame, but copy it anyway as the
+    // search may outlive the frame by far
+    for (size_t l = 0; l < imagePyramid.size(); l++)
+    {
+        job.imagePyramid.push_back(imagePyramid[l].clone());
+    }
+
+    jobs.push_back(job);
+
+    jobAvailable.notify_one();
+}
+
+bool Relocalizer::fetchResult(Object3D* object, vector<Matx44f>& poses)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    for (list<Job>::iterator it = jobs.begin(); it != jobs.end(); it++)
+    {
+        if (it->object == object && it->finished)
+        {
+            poses = it->poses;
+            jobs.erase(it);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Relocalizer::cancel(Object3D* object)
+{
+    unique_lock<std::mutex> lock(mutex);
+
+    list<Job>::iterator it = jobs.begin();
+    while (it != jobs.end())
+    {
+        if (it->object == object)
+        {
+            jobFinished.wait(lock, [&]() { return !it->running; });
+            it = jobs.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void Relocalizer::cancelAll()
+{
+    unique_lock<std::mutex> lock(mutex);
+
+    for (list<Job>::iterator it = jobs.begin(); it != jobs.end(); it++)
+    {
+        jobFinished.wait(lock, [&]() { return !it->running; });
+    }
+
+    jobs.clear();
+}
+
+void Relocalizer::runSearches()
+{
+    unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        list<Job>::iterator it = jobs.end();
+
+        jobAvailable.wait(lock, [&]() {
+            it = jobs.begin();
+            while (it != jobs.end() && (it->running || it->finished))
+            {
+                it++;
+            }
+            return stopping || it != jobs.end();
+        });
+
+        if (stopping)
+        {
+            return;
+        }
+
+        // the job stays in place until it is finished, since cancelling it
+        // waits for that
+        it->running = true;
+
+        lock.unlock();
+        search(it->object, it->imagePyramid, it->poses);
+        lock.lock();
+
+        it->running = false;
+        it->finished = true;
+        it->imagePyramid.clear();
+
+        jobFinished.notify_all();
+    }
+}
+
+void Relocalizer::runLoops()
+{
+    unique_lock<std::mutex> lock(mutex);
+
+    int generation = 0;
+
+    while (true)
+    {
+        loopAvailable.wait(lock, [&]() {
+            return stoppingLoops || loopGeneration != generation;
+        });
+
+        if (stoppingLoops)
+        {
+            return;
+        }
+
+        generation = loopGeneration;
+
+        lock.unlock();
+        processLoop();
+        lock.lock();
+
+        if (--numBusy == 0)
+        {
+            loopFinished.notify_all();
+        }
+    }
+}
+
+void Relocalizer::processLoop()
+{
+    for (int i = nextIndex++; i < loopRange.end; i = nextIndex++)
+    {
+        (*loopBody)(cv::Range(i, i + 1));
+    }
+}
+
+void Relocalizer::parallelFor(const cv::Range& range,
+                              const cv::ParallelLoopBody& body)
+{
+    // searching within the frame uses the same thread pool as tracking
+    if (workers.empty())
+    {
+        parallel_for_(range, body);
+        return;
+    }
+
+    // OpenCV's pool is left to the tracker, as it would run the tracking
+    // loops sequentially while busy with a search
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        loopBody = &body;
+        loopRange = range;
+        nextIndex = range.start;
+        numBusy = (int)workers.size() - 1;
+        loopGeneration++;
+    }
+    loopAvailable.notify_all();
+
+    processLoop();
+
+    unique_lock<std::mutex> lock(mutex);
+    loopFinished.wait(lock, [&]() { return numBusy == 0; });
+}
+
+void Relocalizer::convertToBins(Object3D* object,
+                                const Mat& frame,
+                                Mat& binned)
+{
+    int threads = context.getNumPartitions(frame.rows);
+
+    parallelFor(
+        cv::Range(0, threads),
+        Parallel_For_convertToBins(frame,
+                                   binned,
+                                   object->getTCLCHistograms().getNumBins(),
+                                   threads));
+}
@@ -0,0 +1,190 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RELOCALIZER_H
+#define RELOCALIZER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "execution_context.h"
+
+class Object3D;
+
+/**
+ *  This class implements the template search used to detect the pose of an
+ *  object whose tracking has been lost. It either searches within the frame
+ *  in which the object is lost using OpenCV's thread pool or, if the execution
+ *  context provides relocalization threads, in the background on a pool of
+ *  threads of its own against a snapshot of the image pyramid. In the latter
+ *  case the resulting candidate poses are fetched in a later frame, such that
+ *  tracking the other objects does not stall while a lost one is searched.
+ *  The search only reads the tclc-histograms of the object and writes the
+ *  match offsets of its templates, which are both left alone by the tracker
+ *  while the object is lost.
+ */
+class Relocalizer
+{
+  public:
+    /**
+     *  Constructor of the relocalizer starting the background threads, if
+     * any.
+     *
+     *  @param  K The intrinsic camera matrix.
+     *  @param  context The execution context providing the number of
+     * relocalization threads.
+     */
+    Relocalizer(const cv::Matx33f& K, const ExecutionContext& context);
+
+    ~Relocalizer();
+
+    /**
+     *  Tells whether lost objects are searched in the background.
+     *
+     *  @return True if the search runs asynchronously and false otherwise.
+     */
+    bool isAsynchronous() const;
+
+    /**
+     *  Searches the templates of an object within the given image pyramid
+     * on the calling thread. The template views of the object are matched
+     * exhaustively at the lowest pyramid level and the neighbors of the best
+     * ones at the second lowest level.
+     *
+     *  @param  object The lost object.
+     *  @param  imagePyramid The image pyramid of the camera frame.
+     *  @param  poses The candidate poses of the best matching templates,
+     * ordered by their matching error.
+     */
+    void search(Object3D* object,
+                const std::vector<cv::Mat>& imagePyramid,
+                std::vector<cv::Matx44f>& poses);
+
+    /**
+     *  Starts searching the templates of an object in the background on a
+     * copy of the given image pyramid, unless a search for the object is
+     * already pending or its result has not been fetched yet.
+     *
+     *  @param  object The lost object.
+     *  @param  imagePyramid The image pyramid of the camera frame.
+     */
+    void request(Object3D* object, const std::vector<cv::Mat>& imagePyramid);
+
+    /**
+     *  Fetches the result of a finished background search for an object.
+     *
+     *  @param  object The lost object.
+     *  @param  poses The candidate poses, ordered by their matching error.
+     *  @return True if a search has finished and false if it is still
+     * pending or has not been requested.
+     */
+    bool fetchResult(Object3D* object, std::vector<cv::Matx44f>& poses);
+
+    /**
+     *  Discards the pending search and result of an object, waiting for the
+     * search to finish if it is running right now. This must be done before
+     * the tclc-histograms of the object are reset.
+     *
+     *  @param  object The object whose search is discarded.
+     */
+    void cancel(Object3D* object);
+
+    /**
+     *  Discards the pending searches and results of all objects.
+     */
+    void cancelAll();
+
+  private:
+    struct Job
+    {
+        Object3D* object;
+
+        // the snapshot of the image pyramid that is searched
+        std::vector<cv::Mat> imagePyramid;
+
+        std::vector<cv::Matx44f> poses;
+
+        bool running;
+        bool finished;
+    };
+
+    cv::Matx33f K;
+
+    // sizes the partitions of the parallel loops of the search
+    ExecutionContext context;
+
+    // the queued, running and finished searches, in order of their requests
+    std::list<Job> jobs;
+
+    // the first worker runs the searches, the others help with their loops
+    std::vector<std::thread> workers;
+
+    // the parallel loop currently run by the threads
+    const cv::ParallelLoopBody* loopBody;
+    cv::Range loopRange;
+    std::atomic<int> nextIndex;
+    int loopGeneration;
+    int numBusy;
+
+    bool stopping;
+    bool stoppingLoops;
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobFinished;
+    std::condition_variable loopAvailable;
+    std::condition_variable loopFinished;
+
+    void runSearches();
+
+    void runLoops();
+
+    void processLoop();
+
+    void parallelFor(const cv::Range& range, const cv::ParallelLoopBody& body);
+
+    void convertToBins(Object3D* object,
+                       const cv::Mat& frame,
+                       cv::Mat& binned);
+};
+
+#endif // RELOCALIZER_H
@@ -42,8 +42,36 @@ using namespace cv;
 
 RenderingEngine* RenderingEngine::instance;
 
+RenderingEngine::Backend RenderingEngine::backend = RenderingEngine::OPENGL;
+
 RenderingEngine::RenderingEngine()
 {
+    glContext = NULL;
+
+    silhouetteShaderProgram = NULL;
+    phongblinnShaderProgram = NULL;
+    normalsShaderProgram = NULL;
+
+    cpuRasterizer = NULL;
+
+    calibrationMatrices.push_back(Matx44f::eye());
+
+    projectionMatrix =
+        Transformations::perspectiveMatrix(40, 4.0f / 3.0f, 0.1, 1000.0);
+
+    lookAtMatrix = Transformations::lookAtMatrix(0, 0, 0, 0, 0, 1, 0, -1, 0);
+
+    currentLevel = 0;
+
+    nextPixelBuffer = 0;
+    numPendingRequests = 0;
+
+    if (backend == CPU)
+    {
+        cpuRasterizer = new CPURasterizer();
+        return;
+    }
+
     QSurfaceFormat glFormat;
     glFormat.setVersion(3, 3);
     glFormat.setProfile(QSurfaceFormat::CoreProfile);
@@ -59,33 +87,59 @@ RenderingEngine::RenderingEngine()
     silhouetteShaderProgram = new QOpenGLShaderProgram();
     phongblinnShaderProgram = new QOpenGLShaderProgram();
     normalsShaderProgram = new QOpenGLShaderProgram();
-
-    calibrationMatrices.push_back(Matx44f::eye());
-
-    projectionMatrix =
-        Transformations::perspectiveMatrix(40, 4.0f / 3.0f, 0.1, 1000.0);
-
-    lookAtMatrix = Transformations::lookAtMatrix(0, 0, 0, 0, 0, 1, 0, -1, 0);
-
-    currentLevel = 0;
 }
 
 RenderingEngine::~RenderingEngine()
 {
+    if (backend == CPU)
+    {
+        delete cpuRasterizer;
+        return;
+    }
+
     glDeleteTextures(1, &colorTextureID);
     glDeleteTextures(1, &depthTextureID);
     glDeleteFramebuffers(1, &frameBufferID);
 
+    for (int i = 0; i < numPendingRequests; i++)
+    {
+        int idx = (nextPixelBuffer - numPendingRequests + i +
+                   NUM_PIXEL_BUFFERS) %
+                  NUM_PIXEL_BUFFERS;
+        glDeleteSync(pixelBufferRequests[idx].fence);
+    }
+    glDeleteBuffers(NUM_PIXEL_BUFFERS, pixelBufferIDs);
+
     delete phongblinnShaderProgram;
     delete normalsShaderProgram;
     delete silhouetteShaderProgram;
 }
 
+void RenderingEngine::setBackend(Backend backend)
+{
+    if (instance != NULL)
+    {
+        cout << "the rendering backend can only be set before the rendering "
+                "engine is created"
+             << endl;
+        return;
+    }
+    RenderingEngine::backend = backend;
+}
+
+RenderingEngine::Backend RenderingEngine::getBackend()
+{
+    return backend;
+}
+
 void RenderingEngine::destroy()
 {
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (backend == OPENGL)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
     delete instance;
     instance = NULL;
@@ -93,12 +147,14 @@ void RenderingEngine::destroy()
 
 void RenderingEngine::makeCurrent()
 {
-    glContext->makeCurrent(&surface);
+    if (glContext != NULL)
+        glContext->makeCurrent(&surface);
 }
 
 void RenderingEngine::doneCurrent()
 {
-    glContext->doneCurrent();
+    if (glContext != NULL)
+        glContext->doneCurrent();
 }
 
 QOpenGLContext* RenderingEngine::getContext()
@@ -157,15 +213,6 @@ void RenderingEngine::init(const Matx33f& K,
     projectionMatrix =
         Transformations::perspectiveMatrix(K, width, height, zNear, zFar, true);
 
-    makeCurrent();
-
-    initializeOpenGLFunctions();
-
-    // FIX FOR NEW OPENGL
-    uint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
     calibrationMatrices.clear();
 
     for (int i = 0; i < numLevels; i++)
@@ -181,6 +228,22 @@ void RenderingEngine::init(const Matx33f& K,
         calibrationMatrices.push_back(K_l);
     }
 
+    angle = 0;
+
+    lightPosition = cv::Vec3f(0, 0, 0);
+
+    if (backend == CPU)
+        return;
+
+    makeCurrent();
+
+    initializeOpenGLFunctions();
+
+    // FIX FOR NEW OPENGL
+    uint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
     glEnable(GL_DEPTH);
     glEnable(GL_DEPTH_TEST);
 
@@ -195,6 +258,8 @@ void RenderingEngine::init(const Matx33f& K,
 
     initRenderingBuffers();
 
+    initPixelBuffers();
+
     shaderFolder = std::getenv("RBOT_SHADERS_PATH");
 
     if (!shaderFolder.endsWith('/'))
@@ -206,10 +271,6 @@ void RenderingEngine::init(const Matx33f& K,
     initShaderProgram(phongblinnShaderProgram, "phongblinn");
     initShaderProgram(normalsShaderProgram, "normals");
 
-    angle = 0;
-
-    lightPosition = cv::Vec3f(0, 0, 0);
-
     doneCurrent();
 }
 
@@ -234,6 +295,11 @@ int RenderingEngine::getLevel()
     return currentLevel;
 }
 
+Size RenderingEngine::getFrameSize()
+{
+    return Size(width, height);
+}
+
 bool RenderingEngine::initRenderingBuffers()
 {
     glGenTextures(1, &colorTextureID);
@@ -283,6 +349,25 @@ bool RenderingEngine::initRenderingBuffers()
     return true;
 }
 
+void RenderingEngine::initPixelBuffers()
+{
+    // large enough for a padded RGB_32F frame at full resolution
+    GLsizeiptr size = (GLsizeiptr)(fullWidth + 4) * (fullHeight + 4) * 3 *
+                      sizeof(float);
+
+    glGenBuffers(NUM_PIXEL_BUFFERS, pixelBufferIDs);
+
+    for (int i = 0; i < NUM_PIXEL_BUFFERS; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferIDs[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    nextPixelBuffer = 0;
+    numPendingRequests = 0;
+}
+
 bool RenderingEngine::initShaderProgram(QOpenGLShaderProgram* program,
                                         QString shaderName)
 {
@@ -348,12 +433,19 @@ void RenderingEngine::renderNormals(Model* model,
     renderNormals(models, polyonMode, drawAll);
 }
 
-void RenderingEngine::renderSilhouette(vector<Model*> models,
+void RenderingEngine::renderSilhouette(const vector<Model*>& models,
                                        GLenum polyonMode,
                                        bool invertDepth,
                                        const std::vector<cv::Point3f>& colors,
                                        bool drawAll)
 {
+    if (backend == CPU)
+    {
+        renderCPU(
+            models, invertDepth, colors, CPURasterizer::CONSTANT, drawAll);
+        return;
+    }
+
     glViewport(0, 0, width, height);
 
     if (invertDepth)
@@ -405,7 +497,9 @@ void RenderingEngine::renderSilhouette(vector<Model*> models,
     glClearDepth(0.0f);
     glDepthFunc(GL_GREATER);
 
-    glFinish();
+    // only submit the commands, any download synchronizes with the GPU
+    // itself, while requestFrame() allows the CPU to continue meanwhile
+    glFlush();
 }
 
 void RenderingEngine::renderShaded(vector<Model*> models,
@@ -413,6 +507,12 @@ void RenderingEngine::renderShaded(vector<Model*> models,
                                    const std::vector<cv::Point3f>& colors,
                                    bool drawAll)
 {
+    if (backend == CPU)
+    {
+        renderCPU(models, false, colors, CPURasterizer::SHADED, drawAll);
+        return;
+    }
+
     glViewport(0, 0, width, height);
 
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -475,6 +575,16 @@ void RenderingEngine::renderNormals(vector<Model*> models,
                                     GLenum polyonMode,
                                     bool drawAll)
 {
+    if (backend == CPU)
+    {
+        renderCPU(models,
+                  false,
+                  vector<Point3f>(),
+                  CPURasterizer::NORMALS,
+                  drawAll);
+        return;
+    }
+
     glViewport(0, 0, width, height);
 
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -514,6 +624,50 @@ void RenderingEngine::renderNormals(vector<Model*> models,
     glFinish();
 }
 
+void RenderingEngine::renderCPU(const vector<Model*>& models,
+                                bool invertDepth,
+                                const vector<Point3f>& colors,
+                                CPURasterizer::Shading shading,
+                                bool drawAll)
+{
+    cpuRasterizer->clear(Size(width, height), invertDepth);
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        Model* model = models[i];
+
+        if (model->isInitialized() || drawAll)
+        {
+            Matx44f pose = model->getPose();
+            Matx44f normalization = model->getNormalization();
+
+            Matx44f modelViewMatrix = lookAtMatrix * (pose * normalization);
+
+            Point3f color;
+            if (i < colors.size())
+            {
+                color = colors[i];
+            }
+            else if (shading == CPURasterizer::CONSTANT)
+            {
+                color =
+                    Point3f((float)(model->getModelID()) / 255.0f, 0.0f, 0.0f);
+            }
+            else
+            {
+                color = Point3f(1.0, 0.5, 0.0);
+            }
+
+            cpuRasterizer->drawMesh(model->getVertices(),
+                                    model->getIndices(),
+                                    modelViewMatrix,
+                                    projectionMatrix,
+                                    Vec3f(color.x, color.y, color.z),
+                                    shading);
+        }
+    }
+}
+
 void RenderingEngine::projectBoundingBox(Model* model,
                                          std::vector<cv::Point2f>& projections,
                                          cv::Rect& boundingRect)
@@ -576,35 +730,208 @@ void RenderingEngine::projectBoundingBox(Model* model,
 Mat RenderingEngine::downloadFrame(RenderingEngine::FrameType type)
 {
     Mat res;
+    if (type != MASK && type != RGB && type != RGB_32F && type != DEPTH)
+    {
+        return Mat::zeros(height, width, CV_8UC1);
+    }
+
+    downloadFrame(type, res, Rect(0, 0, width, height));
+
+    return res;
+}
+
+void RenderingEngine::getPixelFormat(FrameType type,
+                                     int& matType,
+                                     GLenum& format,
+                                     GLenum& dataType)
+{
     switch (type)
     {
+        case RGB:
+            matType = CV_8UC3;
+            format = GL_RGB;
+            dataType = GL_UNSIGNED_BYTE;
+            break;
+        case RGB_32F:
+            matType = CV_32FC3;
+            format = GL_RGB;
+            dataType = GL_FLOAT;
+            break;
+        case DEPTH:
+            matType = CV_32FC1;
+            format = GL_DEPTH_COMPONENT;
+            dataType = GL_FLOAT;
+            break;
         case MASK:
-            res = Mat(height, width, CV_8UC1);
-            glReadPixels(
-                0, 0, res.cols, res.rows, GL_RED, GL_UNSIGNED_BYTE, res.data);
+        default:
+            matType = CV_8UC1;
+            format = GL_RED;
+            dataType = GL_UNSIGNED_BYTE;
             break;
+    }
+}
+
+void RenderingEngine::downloadFrame(RenderingEngine::FrameType type,
+                                    Mat& dst,
+                                    const Rect& roi)
+{
+    int matType;
+    GLenum format, dataType;
+    getPixelFormat(type, matType, format, dataType);
+
+    dst.create(height, width, matType);
+
+    Rect r = roi & Rect(0, 0, width, height);
+    if (r.area() == 0)
+        return;
+
+    if (backend == CPU)
+    {
+        Mat dstROI = dst(r);
+        readFrameCPU(type, r, dstROI);
+        return;
+    }
+
+    // read the rows of the region directly into the output image
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)(dst.step / dst.elemSize()));
+
+    glReadPixels(
+        r.x, r.y, r.width, r.height, format, dataType, dst.ptr(r.y, r.x));
+
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+}
+
+bool RenderingEngine::requestFrame(RenderingEngine::FrameType type,
+                                   const Rect& roi)
+{
+    if (numPendingRequests == NUM_PIXEL_BUFFERS)
+    {
+        cout << "all pixel buffers are pending, retrieve a frame first" << endl;
+        return false;
+    }
+
+    int matType;
+    GLenum format, dataType;
+    getPixelFormat(type, matType, format, dataType);
+
+    PixelBufferRequest& request = pixelBufferRequests[nextPixelBuffer];
+    request.type = type;
+    request.roi = roi & Rect(0, 0, width, height);
+
+    if (backend == CPU)
+    {
+        // rasterize the region right away, since it would be overwritten by
+        // any further rendering until the frame is retrieved
+        request.frame.create(request.roi.size(), matType);
+        readFrameCPU(type, request.roi, request.frame);
+
+        nextPixelBuffer = (nextPixelBuffer + 1) % NUM_PIXEL_BUFFERS;
+        numPendingRequests++;
+
+        return true;
+    }
+
+    // start the asynchronous copy of the tightly packed region into the
+    // pixel buffer
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferIDs[nextPixelBuffer]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    if (request.roi.area() > 0)
+    {
+        glReadPixels(request.roi.x,
+                     request.roi.y,
+                     request.roi.width,
+                     request.roi.height,
+                     format,
+                     dataType,
+                     0);
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    nextPixelBuffer = (nextPixelBuffer + 1) % NUM_PIXEL_BUFFERS;
+    numPendingRequests++;
+
+    return true;
+}
+
+bool RenderingEngine::retrieveFrame(Mat& dst)
+{
+    if (numPendingRequests == 0)
+    {
+        return false;
+    }
+
+    int idx = (nextPixelBuffer - numPendingRequests + NUM_PIXEL_BUFFERS) %
+              NUM_PIXEL_BUFFERS;
+    numPendingRequests--;
+
+    PixelBufferRequest& request = pixelBufferRequests[idx];
+
+    int matType;
+    GLenum format, dataType;
+    getPixelFormat(request.type, matType, format, dataType);
+
+    dst.create(height, width, matType);
+
+    if (backend == CPU)
+    {
+        if (request.roi.area() > 0)
+            request.frame.copyTo(dst(request.roi));
+        return true;
+    }
+
+    // only block here if the GPU has not yet finished the copy
+    while (glClientWaitSync(request.fence,
+                            GL_SYNC_FLUSH_COMMANDS_BIT,
+                            1000000000) == GL_TIMEOUT_EXPIRED)
+    {
+    }
+    glDeleteSync(request.fence);
+
+    Rect r = request.roi;
+    if (r.area() == 0)
+        return true;
+
+    size_t size = (size_t)r.area() * CV_ELEM_SIZE(matType);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferIDs[idx]);
+    void* data =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+    if (data != NULL)
+    {
+        Mat(r.height, r.width, matType, data).copyTo(dst(r));
+    }
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
+void RenderingEngine::readFrameCPU(RenderingEngine::FrameType type,
+                                   const Rect& roi,
+                                   Mat& dst)
+{
+    switch (type)
+    {
         case RGB:
-            res = Mat(height, width, CV_8UC3);
-            glReadPixels(
-                0, 0, res.cols, res.rows, GL_RGB, GL_UNSIGNED_BYTE, res.data);
-            break;
         case RGB_32F:
-            res = Mat(height, width, CV_32FC3);
-            glReadPixels(0, 0, res.cols, res.rows, GL_RGB, GL_FLOAT, res.data);
+            cpuRasterizer->readColor(roi, dst);
             break;
         case DEPTH:
-            res = Mat(height, width, CV_32FC1);
-            glReadPixels(0,
-                         0,
-                         res.cols,
-                         res.rows,
-                         GL_DEPTH_COMPONENT,
-                         GL_FLOAT,
-                         res.data);
+            cpuRasterizer->readDepth(roi, dst);
             break;
+        case MASK:
         default:
-            res = Mat::zeros(height, width, CV_8UC1);
+            cpuRasterizer->readMask(roi, dst);
             break;
     }
-    return res;
 }
@@ -48,6 +48,7 @@
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "cpu_rasterizer.h"
 #include "model.h"
 #include "transformations.h"
 
@@ -57,7 +58,10 @@
  * camera instrinsics. It supports one or mutiple objects to be rendered as
  * binary masks, depth maps, normal maps or phong-shaded. It also allows to
  * perform all renderings according to a specified image pyramid level at lower
- * resolutions. The class is  implemented as a singleton.
+ * resolutions. The class is  implemented as a singleton. Alternatively, on
+ * machines without a GPU the silhouettes and depth maps can be rendered with a
+ * CPU-based rasterizer backend that has to be chosen before the instance is
+ * created.
  */
 class RenderingEngine : public QOpenGLFunctions_3_3_Core
 {
@@ -70,6 +74,12 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
         DEPTH
     };
 
+    enum Backend
+    {
+        OPENGL,
+        CPU
+    };
+
     RenderingEngine();
 
     ~RenderingEngine();
@@ -81,6 +91,25 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
         return instance;
     }
 
+    /**
+     *  Selects the backend used for rendering. Must be called before the
+     * singleton instance is created for the first time. With the CPU backend
+     * no OpenGL context is created and the models are rasterized into the
+     * regions of the frames that are downloaded, where shaded renderings and
+     * normal maps are approximated by flat shading of the faces and the
+     * polygon mode is ignored, i.e. triangles are always filled.
+     *
+     *  @param  backend The rendering backend (e.g. OPENGL or CPU).
+     */
+    static void setBackend(Backend backend);
+
+    /**
+     *  Returns the backend used for rendering.
+     *
+     *  @return  The backend used for rendering.
+     */
+    static Backend getBackend();
+
     /**
      *  Initializes the rendering engine instance given a 3x3 float
      *  intrinsic camera matrix
@@ -266,7 +295,7 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
      * initlaized for tracking (default = false).
      */
     void renderSilhouette(
-        std::vector<Model*> models,
+        const std::vector<Model*>& models,
         GLenum polyonMode,
         bool invertDepth = false,
         const std::vector<cv::Point3f>& colors = std::vector<cv::Point3f>(),
@@ -334,6 +363,59 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
      */
     cv::Mat downloadFrame(RenderingEngine::FrameType type);
 
+    /**
+     *  Downloads a region of the most recently rendered image from the GPU to
+     * the host memory like downloadFrame(type), but only copies the pixels
+     * within the given region of interest. The output image is (re)allocated
+     * to the current frame size if necessary, all pixels outside of the region
+     * are left untouched.
+     *
+     *  @param type The frame type to be downloaded (e.g. MASK, RGB, RGB32F or
+     * DEPTH).
+     *  @param dst The image the region is copied into.
+     *  @param roi The region of interest within the rendered image.
+     */
+    void downloadFrame(RenderingEngine::FrameType type,
+                       cv::Mat& dst,
+                       const cv::Rect& roi);
+
+    /**
+     *  Starts an asynchronous download of a region of the most recently
+     * rendered image into one of NUM_PIXEL_BUFFERS pixel buffer objects and
+     * returns immediately. The CPU only has to wait for the GPU once the
+     * result is retrieved with retrieveFrame(), so that further images can be
+     * rendered and processed meanwhile.
+     *
+     *  @param type The frame type to be downloaded (e.g. MASK, RGB, RGB32F or
+     * DEPTH).
+     *  @param roi The region of interest within the rendered image.
+     *
+     *  @return  False if all pixel buffers are still waiting to be retrieved,
+     * true otherwise.
+     */
+    bool requestFrame(RenderingEngine::FrameType type, const cv::Rect& roi);
+
+    /**
+     *  Waits for the oldest pending download started by requestFrame() and
+     * copies its region into the corresponding location of a given image. The
+     * output image is (re)allocated to the current frame size if necessary,
+     * all pixels outside of the region are left untouched.
+     *
+     *  @param dst The image the requested region is copied into.
+     *
+     *  @return  False if no download is pending, true otherwise.
+     */
+    bool retrieveFrame(cv::Mat& dst);
+
+    /**
+     *  Returns the size of the rendered images at the current pyramid level.
+     *
+     *  @return  The size of the rendered images at the current pyramid level.
+     */
+    cv::Size getFrameSize();
+
+    static const int NUM_PIXEL_BUFFERS = 2;
+
     /**
      *  Destroys and deletes the current rendering engine singleton instance.
      */
@@ -342,6 +424,8 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
   private:
     static RenderingEngine* instance;
 
+    static Backend backend;
+
     int width;
     int height;
 
@@ -366,6 +450,21 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
     GLuint colorTextureID;
     GLuint depthTextureID;
 
+    struct PixelBufferRequest
+    {
+        FrameType type;
+        cv::Rect roi;
+        GLsync fence;
+        // the downloaded region when rendering with the CPU backend
+        cv::Mat frame;
+    };
+
+    GLuint pixelBufferIDs[NUM_PIXEL_BUFFERS];
+    PixelBufferRequest pixelBufferRequests[NUM_PIXEL_BUFFERS];
+
+    int nextPixelBuffer;
+    int numPendingRequests;
+
     int angle;
 
     cv::Vec3f lightPosition;
@@ -375,9 +474,26 @@ class RenderingEngine : public QOpenGLFunctions_3_3_Core
     QOpenGLShaderProgram* phongblinnShaderProgram;
     QOpenGLShaderProgram* normalsShaderProgram;
 
+    CPURasterizer* cpuRasterizer;
+
     bool initRenderingBuffers();
 
+    void initPixelBuffers();
+
+    void getPixelFormat(FrameType type,
+                        int& matType,
+                        GLenum& format,
+                        GLenum& dataType);
+
     bool initShaderProgram(QOpenGLShaderProgram* program, QString shaderName);
+
+    void renderCPU(const std::vector<Model*>& models,
+                   bool invertDepth,
+                   const std::vector<cv::Point3f>& colors,
+                   CPURasterizer::Shading shading,
+                   bool drawAll);
+
+    void readFrameCPU(FrameType type, const cv::Rect& roi, cv::Mat& dst);
 };
 
 #endif // RENDERING_ENGINE
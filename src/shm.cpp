@@ -0,0 +1,480 @@
+#include "shm.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t)
+                  && std::atomic<std::uint32_t>::is_always_lock_free);
+
+    // readers wake up this often to check whether they were interrupted,
+    // as waking them through the shared futex would race with their check
+    constexpr auto interruptPollInterval = timespec{0, 100'000'000};
+
+    // the futexes are shared between processes, hence not FUTEX_PRIVATE
+    auto futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected)
+        -> void
+    {
+        ::syscall(SYS_futex,
+                  reinterpret_cast<std::uint32_t*>(&word),
+                  FUTEX_WAIT,
+                  expected,
+                  &interruptPollInterval,
+                  nullptr,
+                  0);
+    }
+
+    auto futexWakeAll(std::atomic<std::uint32_t>& word) -> void
+    {
+        ::syscall(SYS_futex,
+                  reinterpret_cast<std::uint32_t*>(&word),
+                  FUTEX_WAKE,
+                  INT_MAX,
+                  nullptr,
+                  nullptr,
+                  0);
+    }
+} // namespace
+
+namespace fds
+{
+    FrameLease::FrameLease(SharedFrameSlot& slot,
+                           std::atomic<std::uint32_t>& lease) noexcept
+        : slot{&slot},
+          lease{&lease},
+          frame{slot.height, slot.width, CV_8UC(slot.channels), slot.frame}
+    {
+    }
+
+    FrameLease::FrameLease(FrameLease&& other) noexcept
+        : slot{other.slot}, lease{other.lease}, frame{other.frame}
+    {
+        other.slot = nullptr;
+        other.lease = nullptr;
+        other.frame = cv::Mat{};
+    }
+
+    auto FrameLease::operator=(FrameLease&& other) noexcept -> FrameLease&
+    {
+        if (this != &other)
+        {
+            release();
+            this->slot = other.slot;
+            this->lease = other.lease;
+            this->frame = other.frame;
+            other.slot = nullptr;
+            other.lease = nullptr;
+            other.frame = cv::Mat{};
+        }
+        return *this;
+    }
+
+    FrameLease::~FrameLease()
+    {
+        release();
+    }
+
+    auto FrameLease::getFrame() const noexcept -> cv::Mat const&
+    {
+        return this->frame;
+    }
+
+    auto FrameLease::getFrameNumber() const noexcept -> std::uint64_t
+    {
+        return this->slot != nullptr ? this->slot->frameNumber.load() : 0;
+    }
+
+    auto FrameLease::getTimestamp() const noexcept -> std::int64_t
+    {
+        return this->slot != nullptr ? this->slot->timestamp : 0;
+    }
+
+    auto FrameLease::release() noexcept -> void
+    {
+        if (this->slot != nullptr)
+        {
+            this->lease->fetch_sub(1);
+            this->slot = nullptr;
+            this->lease = nullptr;
+            this->frame = cv::Mat{};
+        }
+    }
+
+    SharedFrameWriter::SharedFrameWriter(SharedData& data) noexcept
+        : data{data}
+    {
+        for (auto& slot : this->data.slots)
+        {
+            // a slot a previous producer was writing when it exited is
+            // treated as never written
+            if (slot.sequence.load() % 2 == 1)
+            {
+                slot.sequence.store(0);
+            }
+            this->frameNumber =
+                std::max(this->frameNumber, slot.frameNumber.load());
+        }
+
+        this->data.epoch.fetch_add(1);
+        futexWakeAll(this->data.published);
+    }
+
+    auto SharedFrameWriter::beginFrame(int const width, int const height)
+        -> cv::Mat
+    {
+        if (width > SharedFrameSlot::maxWidth ||
+            height > SharedFrameSlot::maxHeight)
+        {
+            throw std::invalid_argument{"Frame too large for shared memory\n"};
+        }
+
+        auto const latest = this->data.latestSlot.load();
+
+        // never overwrite the latest frame, so a consumer always finds a
+        // complete one
+        for (auto i = 1; i < SharedData::numSlots; ++i)
+        {
+            auto const index = (latest + i) % SharedData::numSlots;
+            auto& slot = this->data.slots[index];
+
+            if (isLeased(index))
+            {
+                continue;
+            }
+
+            // mark the slot as written and back off again if a consumer
+            // leased it in the meantime, both sides use sequentially
+            // consistent operations, so at least one of them notices
+            auto const sequence = slot.sequence.load();
+            slot.sequence.store(sequence + 1);
+
+            if (isLeased(index))
+            {
+                slot.sequence.store(sequence);
+                continue;
+            }
+
+            this->writing = index;
+            return cv::Mat{height, width, CV_8UC3, slot.frame};
+        }
+
+        // all other slots are leased by slow consumers, capture the frame
+        // anyway to keep the device going but do not publish it
+        this->scratch.create(height, width, CV_8UC3);
+        this->writing = discarding;
+        return this->scratch;
+    }
+
+    auto SharedFrameWriter::endFrame(cv::Mat const& frame) -> void
+    {
+        if (this->writing == discarding)
+        {
+            this->data.overruns.fetch_add(1);
+            this->writing = -1;
+            return;
+        }
+
+        if (this->writing < 0)
+        {
+            throw std::logic_error{"No frame has been started\n"};
+        }
+
+        auto& slot = this->data.slots[this->writing];
+
+        if (frame.data != slot.frame)
+        {
+            auto const size = frame.total() * frame.elemSize();
+            if (frame.cols > SharedFrameSlot::maxWidth ||
+                frame.rows > SharedFrameSlot::maxHeight ||
+                frame.channels() > SharedFrameSlot::maxChannels ||
+                !frame.isContinuous())
+            {
+                slot.sequence.store(slot.sequence.load() - 1);
+                this->writing = -1;
+                throw std::invalid_argument{"Unsupported frame\n"};
+            }
+            std::memcpy(slot.frame, frame.data, size);
+        }
+
+        slot.width = frame.cols;
+        slot.height = frame.rows;
+        slot.channels = frame.channels();
+        slot.frameNumber = ++this->frameNumber;
+        slot.timestamp =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+
+        slot.sequence.store(slot.sequence.load() + 1);
+
+        this->data.latestSlot.store(this->writing);
+        this->data.published.fetch_add(1);
+        futexWakeAll(this->data.published);
+
+        this->writing = -1;
+    }
+
+    auto SharedFrameWriter::getOverrunCount() const noexcept -> std::uint64_t
+    {
+        return this->data.overruns.load();
+    }
+
+    auto SharedFrameWriter::getReaders() -> std::vector<SharedReaderStats>
+    {
+        auto readers = std::vector<SharedReaderStats>{};
+
+        for (auto& reader : this->data.readers)
+        {
+            auto pid = reader.pid.load();
+            if (pid == 0)
+            {
+                continue;
+            }
+
+            if (::kill(pid, 0) == -1 && errno == ESRCH)
+            {
+                // the entry is only reused once the pid is cleared, so the
+                // leases are given back first
+                for (auto& lease : reader.leases)
+                {
+                    lease.store(0);
+                }
+                reader.pid.compare_exchange_strong(pid, 0);
+                continue;
+            }
+
+            readers.push_back(
+                {pid, reader.cursor.load(), reader.dropped.load()});
+        }
+
+        return readers;
+    }
+
+    auto SharedFrameWriter::isLeased(int const index) const noexcept -> bool
+    {
+        for (auto const& reader : this->data.readers)
+        {
+            if (reader.leases[index].load() != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SharedFrameReader::SharedFrameReader(SharedData& data) : data{data}
+    {
+        this->epoch = this->data.epoch.load();
+        attach();
+    }
+
+    SharedFrameReader::~SharedFrameReader()
+    {
+        this->reader->pid.store(0);
+    }
+
+    auto SharedFrameReader::attach() -> void
+    {
+        for (auto& reader : this->data.readers)
+        {
+            auto expected = std::int32_t{0};
+            if (reader.pid.compare_exchange_strong(expected, ::getpid()))
+            {
+                reader.cursor.store(0);
+                reader.dropped.store(0);
+                this->reader = &reader;
+                return;
+            }
+        }
+
+        throw std::runtime_error{"Too many shared memory readers\n"};
+    }
+
+    auto SharedFrameReader::checkEpoch() -> void
+    {
+        auto const epoch = this->data.epoch.load();
+        if (epoch != this->epoch)
+        {
+            this->epoch = epoch;
+            restart();
+        }
+    }
+
+    auto SharedFrameReader::restart() -> void
+    {
+        // start over at the next frame of the new producer
+        this->lastFrameNumber = 0;
+        this->lastPublished = this->data.published.load();
+
+        if (this->reader->pid.load() != ::getpid())
+        {
+            attach();
+        }
+        this->reader->cursor.store(0);
+    }
+
+    auto SharedFrameReader::leaseLatestFrame() -> FrameLease
+    {
+        for (;;)
+        {
+            if (this->interrupted)
+            {
+                return {};
+            }
+
+            checkEpoch();
+
+            auto const published = this->data.published.load();
+
+            if (published == this->lastPublished)
+            {
+                futexWait(this->data.published, published);
+                continue;
+            }
+
+            // fails if the producer overwrites the slot before the lease is
+            // taken, in which case a newer frame has been published
+            auto lease = tryLease(this->data.latestSlot.load());
+            if (!lease)
+            {
+                continue;
+            }
+
+            this->lastPublished = published;
+
+            // the frame numbers only go backwards if the shared data was
+            // reinitialized under the reader, treat it like a restart
+            if (lease->getFrameNumber() < this->lastFrameNumber)
+            {
+                restart();
+                continue;
+            }
+
+            if (lease->getFrameNumber() > this->lastFrameNumber)
+            {
+                advanceCursor(lease->getFrameNumber());
+                return std::move(*lease);
+            }
+        }
+    }
+
+    auto SharedFrameReader::leaseNextFrame() -> FrameLease
+    {
+        for (;;)
+        {
+            if (this->interrupted)
+            {
+                return {};
+            }
+
+            checkEpoch();
+
+            // a reader that just attached or restarted starts at the latest
+            // frame
+            if (this->lastFrameNumber == 0)
+            {
+                return leaseLatestFrame();
+            }
+
+            auto const published = this->data.published.load();
+
+            // find the oldest newer frame without leasing the slots, which
+            // would keep the producer from writing them while scanning
+            auto next = -1;
+            auto nextFrameNumber = std::uint64_t{0};
+
+            for (auto i = 0; i < SharedData::numSlots; ++i)
+            {
+                auto const& slot = this->data.slots[i];
+                auto const sequence = slot.sequence.load();
+                auto const frameNumber = slot.frameNumber.load();
+
+                if (sequence % 2 == 1 || sequence == 0 ||
+                    slot.sequence.load() != sequence)
+                {
+                    continue;
+                }
+
+                if (frameNumber > this->lastFrameNumber &&
+                    (next == -1 || frameNumber < nextFrameNumber))
+                {
+                    next = i;
+                    nextFrameNumber = frameNumber;
+                }
+            }
+
+            if (next != -1)
+            {
+                // the slot may have been overwritten since, scan again then
+                auto lease = tryLease(next);
+                if (!lease || lease->getFrameNumber() != nextFrameNumber)
+                {
+                    continue;
+                }
+
+                this->lastPublished = published;
+                advanceCursor(nextFrameNumber);
+                return std::move(*lease);
+            }
+
+            // a frame published during the scan changes the counter, such
+            // that the wait returns right away
+            futexWait(this->data.published, published);
+        }
+    }
+
+    auto SharedFrameReader::interrupt() noexcept -> void
+    {
+        this->interrupted = true;
+    }
+
+    auto SharedFrameReader::getDroppedFrameCount() const noexcept
+        -> std::uint64_t
+    {
+        return this->reader->dropped.load();
+    }
+
+    auto SharedFrameReader::tryLease(int const index)
+        -> std::optional<FrameLease>
+    {
+        auto& slot = this->data.slots[index];
+        auto& lease = this->reader->leases[index];
+
+        lease.fetch_add(1);
+        auto const sequence = slot.sequence.load();
+
+        // an odd sequence number means the producer is writing the slot, 0
+        // that it has never been written
+        if (sequence % 2 == 1 || sequence == 0)
+        {
+            lease.fetch_sub(1);
+            return std::nullopt;
+        }
+
+        return FrameLease{slot, lease};
+    }
+
+    auto SharedFrameReader::advanceCursor(std::uint64_t const frameNumber)
+        -> void
+    {
+        if (this->lastFrameNumber != 0 &&
+            frameNumber > this->lastFrameNumber + 1)
+        {
+            this->reader->dropped.fetch_add(
+                frameNumber - this->lastFrameNumber - 1);
+        }
+
+        this->lastFrameNumber = frameNumber;
+        this->reader->cursor.store(frameNumber);
+    }
+} // namespace fds
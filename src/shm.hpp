@@ -1,23 +1,171 @@
 #pragma once
-#include <boost/interprocess/sync/interprocess_condition.hpp>
-#include <boost/interprocess/sync/interprocess_mutex.hpp>
-#include <boost/interprocess/sync/named_mutex.hpp>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <opencv2/core.hpp>
 
 namespace fds
 {
     constexpr auto sharedDataName = "frame";
 
-    struct SharedData final
+    // A frame in shared memory guarded by a sequence number, which is odd
+    // while the producer writes the slot and even once it is published.
+    // Consumers lease a slot while they read it, the producer never writes a
+    // leased slot.
+    struct SharedFrameSlot final
     {
         constexpr static auto maxWidth = 1920;
         constexpr static auto maxHeight = 1080;
         constexpr static auto maxChannels = 3;
-        boost::interprocess::interprocess_mutex mutex;
-        boost::interprocess::interprocess_condition condRead;
-        bool requestRead;
+        std::atomic<std::uint32_t> sequence;
+        std::atomic<std::uint64_t> frameNumber;
+        // steady clock nanoseconds, which are comparable across processes
+        std::int64_t timestamp;
         int width;
         int height;
         int channels;
-        uint8_t frame[maxWidth * maxHeight * maxChannels];
+        alignas(64) std::uint8_t frame[maxWidth * maxHeight * maxChannels];
+    };
+
+    // A consumer attached to the shared memory, identified by its process id
+    // or 0 if the entry is free.
+    struct SharedReader final
+    {
+        constexpr static auto numSlots = 8;
+        std::atomic<std::int32_t> pid;
+        // frame number of the last frame read
+        std::atomic<std::uint64_t> cursor;
+        std::atomic<std::uint64_t> dropped;
+        // the leases the reader holds per slot, which are kept per reader
+        // such that those of a crashed reader can be given back
+        std::atomic<std::uint32_t> leases[numSlots];
+    };
+
+    struct SharedData final
+    {
+        constexpr static auto numSlots = SharedReader::numSlots;
+        constexpr static auto maxReaders = 16;
+        // incremented whenever a producer attaches, e.g. after a restart,
+        // upon which consumers restart at its next frame
+        std::atomic<std::uint32_t> epoch;
+        // incremented for every published frame, consumers wait on it
+        std::atomic<std::uint32_t> published;
+        std::atomic<std::uint32_t> latestSlot;
+        // frames the producer discarded as all slots were leased
+        std::atomic<std::uint64_t> overruns;
+        SharedReader readers[maxReaders];
+        SharedFrameSlot slots[numSlots];
+    };
+
+    struct SharedReaderStats final
+    {
+        std::int32_t pid;
+        std::uint64_t cursor;
+        std::uint64_t dropped;
+    };
+
+    // A consumer's lease on a published frame. The frame points directly
+    // into shared memory and stays valid until the lease is released or
+    // destroyed.
+    class FrameLease final
+    {
+      public:
+        FrameLease() noexcept = default;
+        FrameLease(SharedFrameSlot& slot,
+                   std::atomic<std::uint32_t>& lease) noexcept;
+        FrameLease(FrameLease&& other) noexcept;
+        auto operator=(FrameLease&& other) noexcept -> FrameLease&;
+        FrameLease(FrameLease const&) = delete;
+        auto operator=(FrameLease const&) -> FrameLease& = delete;
+        ~FrameLease();
+
+        auto getFrame() const noexcept -> cv::Mat const&;
+        auto getFrameNumber() const noexcept -> std::uint64_t;
+        auto getTimestamp() const noexcept -> std::int64_t;
+        auto release() noexcept -> void;
+
+      private:
+        SharedFrameSlot* slot = nullptr;
+        std::atomic<std::uint32_t>* lease = nullptr;
+        cv::Mat frame;
+    };
+
+    class SharedFrameWriter final
+    {
+      public:
+        // Attaches to shared data that is either zero-initialized or left
+        // behind by a previous producer, whose consumers stay attached. The
+        // frame numbers continue after the ones still in the ring.
+        explicit SharedFrameWriter(SharedData& data) noexcept;
+
+        // Reserves a slot that no consumer holds a lease on and returns a
+        // CV_8UC3 header into it, such that a frame can be captured in place.
+        // The producer never waits for consumers, if all slots are leased the
+        // header points to a scratch frame that is discarded by endFrame.
+        auto beginFrame(int width, int height) -> cv::Mat;
+
+        // Publishes the reserved slot, the frame is only copied if it does
+        // not already use the slot's memory.
+        auto endFrame(cv::Mat const& frame) -> void;
+
+        auto getOverrunCount() const noexcept -> std::uint64_t;
+
+        // Returns the attached consumers and detaches those whose process
+        // has exited, giving back the slots they still held leases on.
+        auto getReaders() -> std::vector<SharedReaderStats>;
+
+      private:
+        constexpr static auto discarding = -2;
+
+        auto isLeased(int index) const noexcept -> bool;
+
+        SharedData& data;
+        int writing = -1;
+        std::uint64_t frameNumber = 0;
+        cv::Mat scratch;
+    };
+
+    // Any number of readers up to SharedData::maxReaders may attach, each
+    // with its own cursor over the ring.
+    class SharedFrameReader final
+    {
+      public:
+        explicit SharedFrameReader(SharedData& data);
+        SharedFrameReader(SharedFrameReader const&) = delete;
+        auto operator=(SharedFrameReader const&)
+            -> SharedFrameReader& = delete;
+        ~SharedFrameReader();
+
+        // Waits until a frame newer than the cursor is published and leases
+        // the most recent one without copying it, skipping all frames in
+        // between. Returns an empty lease once the reader is interrupted.
+        auto leaseLatestFrame() -> FrameLease;
+
+        // Waits for and leases the oldest frame newer than the cursor that is
+        // still in the ring, frames already overwritten count as dropped.
+        // Returns an empty lease once the reader is interrupted.
+        auto leaseNextFrame() -> FrameLease;
+
+        // Makes a wait for a frame on another thread return, as well as all
+        // later ones, even if the producer never publishes another frame.
+        auto interrupt() noexcept -> void;
+
+        auto getDroppedFrameCount() const noexcept -> std::uint64_t;
+
+      private:
+        auto attach() -> void;
+        auto checkEpoch() -> void;
+        auto restart() -> void;
+        auto tryLease(int index) -> std::optional<FrameLease>;
+        auto advanceCursor(std::uint64_t frameNumber) -> void;
+
+        SharedData& data;
+        SharedReader* reader = nullptr;
+        std::uint32_t epoch = 0;
+        std::uint32_t lastPublished = 0;
+        std::uint64_t lastFrameNumber = 0;
+        std::atomic<bool> interrupted = false;
     };
 } // namespace fds
@@ -1,4 +1,3 @@
-#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <string>
@@ -6,7 +5,6 @@
 
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
-#include <boost/interprocess/sync/scoped_lock.hpp>
 
 #include <cxxopts.hpp>
 
@@ -75,54 +73,54 @@ auto main(int argc, char** argv) -> int
 
     constexpr auto width = 640;
     constexpr auto height = 480;
-    constexpr auto channels = 3;
 
     auto const devicePath = args["device"].as<std::filesystem::path>();
     std::cout << "Opening " << devicePath << '\n' << std::flush;
     auto video = fds::makeCVV4l2Video(devicePath, width, height);
 
-    struct SHMRemove
-    {
-        SHMRemove()
-        {
-            shared_memory_object::remove(fds::sharedDataName);
-        }
-
-        ~SHMRemove()
-        {
-            shared_memory_object::remove(fds::sharedDataName);
-        }
-    } remover;
-
+    // the shared memory outlives the producer, such that consumers that are
+    // still attached to it keep receiving frames after a restart
     auto shm =
-        shared_memory_object{create_only, fds::sharedDataName, read_write};
-    shm.truncate(sizeof(SharedData));
-    auto region = mapped_region{shm, read_write};
-    auto const addr = region.get_address();
-    auto const data = new (addr) fds::SharedData{};
+        shared_memory_object{open_or_create, fds::sharedDataName, read_write};
 
+    auto size = offset_t{0};
+    shm.get_size(size);
+
+    auto const initialized = size != 0;
+    if (!initialized)
     {
-        scoped_lock<interprocess_mutex> lock{data->mutex};
-        data->requestRead = false;
-        data->width = width;
-        data->height = height;
-        data->channels = channels;
+        shm.truncate(sizeof(SharedData));
     }
+    else if (size != sizeof(SharedData))
+    {
+        std::cerr << "The shared memory " << fds::sharedDataName
+                  << " has an unexpected size, please remove it\n"
+                  << std::flush;
+        return 1;
+    }
+
+    auto region = mapped_region{shm, read_write};
+    auto const addr = region.get_address();
+    auto const data = initialized ? static_cast<SharedData*>(addr)
+                                  : new (addr) fds::SharedData{};
 
-    cv::Mat frame;
+    auto writer = fds::SharedFrameWriter{*data};
 
     for (auto i = 1;; ++i)
     {
-        std::cout << '\r' << i << std::flush;
-        video->readFrameInto(frame);
-        scoped_lock<interprocess_mutex> lock{data->mutex};
-        std::memcpy(data->frame, frame.data, width * height * channels);
-
-        if (!data->requestRead)
+        std::cout << '\r' << i << " overruns " << writer.getOverrunCount();
+        for (auto const& reader : writer.getReaders())
         {
-            data->requestRead = true;
-            data->condRead.notify_one();
+            std::cout << " | reader " << reader.pid << " at " << reader.cursor
+                      << " dropped " << reader.dropped;
         }
+        std::cout << "\x1b[K" << std::flush;
+
+        // capture directly into a free slot, consumers holding a lease on
+        // another slot are never waited for
+        auto frame = writer.beginFrame(width, height);
+        video->readFrameInto(frame);
+        writer.endFrame(frame);
     }
 
     return 0;
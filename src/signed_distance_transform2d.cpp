@@ -41,21 +41,36 @@
 using namespace cv;
 using namespace std;
 
-SignedDistanceTransform2D::SignedDistanceTransform2D(float maxDist)
+SignedDistanceTransform2D::SignedDistanceTransform2D(
+    float maxDist, bool narrowBand, const ExecutionContext& context)
+    : context{context}
 {
     this->maxDist = maxDist;
+    this->narrowBand = narrowBand;
 }
 
 SignedDistanceTransform2D::~SignedDistanceTransform2D()
 {
 }
 
-void SignedDistanceTransform2D::computeTransform(
-    const Mat& src, Mat& sdt, Mat& xyPos, int threads, uchar key)
+void SignedDistanceTransform2D::computeTransform(const Mat& src,
+                                                 Mat& sdt,
+                                                 Mat& xyPos,
+                                                 uchar key)
 {
+    // the rows are split for the horizontal and the columns for the vertical
+    // passes
+    int threads = context.getNumPartitions(std::min(src.rows, src.cols));
+
+    if (narrowBand)
+    {
+        computeNarrowBandTransform(src, sdt, xyPos, threads, key);
+        return;
+    }
+
     sdt.create(src.size(), CV_32FC1);
-    Mat dd(src.size(), CV_32SC1);
-    Mat xPos(src.size(), CV_32SC1);
+    Mat dd = arena.getMat(BUFFER_DD, src.size(), CV_32SC1);
+    Mat xPos = arena.getMat(BUFFER_X_POS, src.size(), CV_32SC1);
     xyPos.create(src.size(), CV_32SC2);
 
     sdt.setTo(0);
@@ -63,9 +78,9 @@ void SignedDistanceTransform2D::computeTransform(
 
     int n = (src.cols > src.rows) ? src.cols : src.rows;
 
-    int* v = (int*)malloc(threads * n * sizeof(int));
-    int* z = (int*)malloc(threads * (n + 1) * sizeof(int));
-    int* f = (int*)malloc(threads * n * sizeof(int));
+    int* v = arena.getBuffer<int>(BUFFER_V, threads * n);
+    int* z = arena.getBuffer<int>(BUFFER_Z, threads * (n + 1));
+    int* f = arena.getBuffer<int>(BUFFER_F, threads * n);
 
     int type = src.type();
     uchar depth = type & CV_MAT_DEPTH_MASK;
@@ -101,17 +116,85 @@ void SignedDistanceTransform2D::computeTransform(
     parallel_for_(cv::Range(0, threads),
                   Parallel_For_distanceTransformCols(
                       dd, sdt, xPos, xyPos, maxDist, v, z, f, threads));
+}
+
+void SignedDistanceTransform2D::computeNarrowBandTransform(
+    const Mat& src, Mat& sdt, Mat& xyPos, int threads, uchar key)
+{
+    sdt.create(src.size(), CV_32FC1);
+    xyPos.create(src.size(), CV_32SC2);
+
+    int* hPos = arena.getBuffer<int>(BUFFER_H_POS, src.rows * src.cols);
+    int* vPos = arena.getBuffer<int>(BUFFER_V_POS, src.rows * src.cols);
+    int* hCnt = arena.getBuffer<int>(BUFFER_H_CNT, src.rows);
+    int* vCnt = arena.getBuffer<int>(BUFFER_V_CNT, src.rows);
+
+    int* d2 = arena.getBuffer<int>(BUFFER_D2, threads * src.cols);
+    int* closest =
+        arena.getBuffer<int>(BUFFER_CLOSEST, threads * 3 * src.cols);
+
+    int type = src.type();
+    uchar depth = type & CV_MAT_DEPTH_MASK;
+
+    if (depth == CV_8U)
+    {
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_findContourTransitions<uchar>(
+                          src, key, hPos, hCnt, vPos, vCnt, threads));
+
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_distanceTransformBand<uchar>(src,
+                                                                key,
+                                                                sdt,
+                                                                xyPos,
+                                                                maxDist,
+                                                                hPos,
+                                                                hCnt,
+                                                                vPos,
+                                                                vCnt,
+                                                                d2,
+                                                                closest,
+                                                                threads));
+    }
+    else if (depth == CV_32F)
+    {
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_findContourTransitions<float>(
+                          src, 0, hPos, hCnt, vPos, vCnt, threads));
 
-    free(z);
-    free(v);
-    free(f);
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_distanceTransformBand<float>(src,
+                                                                0,
+                                                                sdt,
+                                                                xyPos,
+                                                                maxDist,
+                                                                hPos,
+                                                                hCnt,
+                                                                vPos,
+                                                                vCnt,
+                                                                d2,
+                                                                closest,
+                                                                threads));
+    }
+    else
+    {
+        cout << "WRONG IMAGE TYPE FOR SIGNED DISTANCE TRANSFORMATION! NOTE: "
+                "USE FLOAT OR UCHAR."
+             << endl;
+    }
+}
+
+FrameArena& SignedDistanceTransform2D::getFrameArena()
+{
+    return arena;
 }
 
 void SignedDistanceTransform2D::computeDerivatives(const cv::Mat& sdt,
                                                    cv::Mat& dX,
-                                                   cv::Mat& dY,
-                                                   int threads)
+                                                   cv::Mat& dY)
 {
+    int threads = context.getNumPartitions(sdt.rows);
+
     dX.create(sdt.size(), CV_32FC1);
     dY.create(sdt.size(), CV_32FC1);
 
@@ -42,6 +42,10 @@
 
 #include <opencv2/core.hpp>
 
+#include "execution_context.h"
+#include "frame_arena.h"
+#include "trace.h"
+
 /**
  *  This class implements a signed 2D Euclidean distance transform
  *  of an arbitrary binary image (e.g. an object silhouette mask).
@@ -63,8 +67,16 @@ class SignedDistanceTransform2D
      *
      *  @param  maxDist The maximal absolute distance at which the closest
      * contour points are being comuted.
+     *  @param  narrowBand Whether the distances are only computed within a
+     * narrow band of maxDist + 1 around the contour, with all pixels outside
+     * of it set to +/-(maxDist + 2) (default = false).
+     *  @param  context The execution context used for parallelization
+     * (default = one thread per logical CPU).
      */
-    SignedDistanceTransform2D(float maxDist);
+    SignedDistanceTransform2D(
+        float maxDist,
+        bool narrowBand = false,
+        const ExecutionContext& context = ExecutionContext());
 
     ~SignedDistanceTransform2D();
 
@@ -78,7 +90,6 @@ class SignedDistanceTransform2D
      *  @param  sdt The output 2D Euclidean signed distance transform of src.
      *  @param  xyPos The per pixel 2D coordinates of the closest contour points
      * (two channel, integer).
-     *  @param  threads The number of threads to be used for parallelization.
      *  @param  key In case of a uchar input image that is not binary, the value
      * specidfies the intensitiy to be considered foregorund (default = 0, i.e.
      * anything not equal to 0 is considered foreground).
@@ -86,7 +97,6 @@ class SignedDistanceTransform2D
     void computeTransform(const cv::Mat& src,
                           cv::Mat& sdt,
                           cv::Mat& xyPos,
-                          int threads,
                           uchar key = 0);
 
     /**
@@ -100,15 +110,46 @@ class SignedDistanceTransform2D
      * float).
      *  @param  dY The output derivatives in y-direction (single channel,
      * float).
-     *  @param  threads The number of threads to be used for parallelization.
      */
-    void computeDerivatives(const cv::Mat& sdt,
-                            cv::Mat& dX,
-                            cv::Mat& dY,
-                            int threads);
+    void computeDerivatives(const cv::Mat& sdt, cv::Mat& dX, cv::Mat& dY);
+
+    /**
+     *  Returns the arena holding the scratch buffers of the transform, which
+     * are reused between calls.
+     *
+     *  @return The arena of scratch buffers.
+     */
+    FrameArena& getFrameArena();
 
   private:
+    enum BufferSlot
+    {
+        BUFFER_DD,
+        BUFFER_X_POS,
+        BUFFER_V,
+        BUFFER_Z,
+        BUFFER_F,
+        BUFFER_H_POS,
+        BUFFER_V_POS,
+        BUFFER_H_CNT,
+        BUFFER_V_CNT,
+        BUFFER_D2,
+        BUFFER_CLOSEST
+    };
+
     float maxDist;
+
+    bool narrowBand;
+
+    ExecutionContext context;
+
+    FrameArena arena;
+
+    void computeNarrowBandTransform(const cv::Mat& src,
+                                    cv::Mat& sdt,
+                                    cv::Mat& xyPos,
+                                    int threads,
+                                    uchar key);
 };
 
 /**
@@ -152,6 +193,8 @@ class Parallel_For_distanceTransformRows : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_distanceTransformRows");
+
         type* src_pixels = (type*)_src.ptr<type>();
         int* dd = (int*)_dd.ptr<int>();
         int* xPos = (int*)_xPos.ptr<int>();
@@ -274,6 +317,8 @@ class Parallel_For_distanceTransformRowsWithKey : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_distanceTransformRowsWithKey");
+
         uchar* src_pixels = (uchar*)_src.ptr<uchar>();
         int* dd = (int*)_dd.ptr<int>();
         int* xPos = (int*)_xPos.ptr<int>();
@@ -401,6 +446,8 @@ class Parallel_For_distanceTransformCols : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_distanceTransformCols");
+
         int* dd = (int*)_src.ptr<int>();
         float* _d = (float*)_dst.ptr<float>();
 
@@ -617,6 +664,342 @@ class Parallel_For_distanceTransformCols : public cv::ParallelLoopBody
     }
 };
 
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, for every row in an input
+ * image the x locations of all horizontal foreground/background transitions
+ * as well as of all vertical transitions to the previous row are collected.
+ */
+template <class type>
+class Parallel_For_findContourTransitions : public cv::ParallelLoopBody
+{
+  private:
+    cv::Mat _src;
+
+    uchar _key;
+
+    int* _hPos;
+    int* _hCnt;
+    int* _vPos;
+    int* _vCnt;
+
+    int _threads;
+
+  public:
+    Parallel_For_findContourTransitions(const cv::Mat& src,
+                                        uchar key,
+                                        int* hPos,
+                                        int* hCnt,
+                                        int* vPos,
+                                        int* vCnt,
+                                        int threads)
+    {
+        _src = src;
+
+        _key = key;
+
+        _hPos = hPos;
+        _hCnt = hCnt;
+        _vPos = vPos;
+        _vCnt = vCnt;
+
+        _threads = threads;
+    }
+
+    bool isForeground(type val) const
+    {
+        return _key > 0 ? val == _key : !!val;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_findContourTransitions");
+
+        type* src_pixels = (type*)_src.ptr<type>();
+
+        int range = _src.rows / _threads;
+
+        int yEnd = r.end * range;
+        if (r.end == _threads)
+        {
+            yEnd = _src.rows;
+        }
+
+        for (int y = r.start * range; y < yEnd; y++)
+        {
+            type* src_row = src_pixels + y * _src.cols;
+
+            int* hPos = _hPos + y * _src.cols;
+            int* vPos = _vPos + y * _src.cols;
+
+            // transitions between the pixels j - 1 and j within this row
+            int cnt = 0;
+            for (int j = 1; j < _src.cols; j++)
+            {
+                if (isForeground(src_row[j - 1]) != isForeground(src_row[j]))
+                {
+                    hPos[cnt++] = j;
+                }
+            }
+            _hCnt[y] = cnt;
+
+            // transitions between the rows y - 1 and y within each column
+            cnt = 0;
+            if (y > 0)
+            {
+                type* prev_row = src_row - _src.cols;
+                for (int x = 0; x < _src.cols; x++)
+                {
+                    if (isForeground(prev_row[x]) != isForeground(src_row[x]))
+                    {
+                        vPos[cnt++] = x;
+                    }
+                }
+            }
+            _vCnt[y] = cnt;
+        }
+    }
+};
+
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, the per pixel 2D signed
+ * distance transform is computed for every row only within a narrow band
+ * around the previously collected contour transitions, based on the same
+ * distances as Parallel_For_distanceTransformCols. Here, also the 2D locations
+ * of the closest foreground contour pixels (i.e. the foreground pixels next
+ * to a transition) are calculated. Pixels outside of the band are set to
+ * +/-(maxDist + 2) without a contour point.
+ */
+template <class type>
+class Parallel_For_distanceTransformBand : public cv::ParallelLoopBody
+{
+  private:
+    cv::Mat _src;
+    cv::Mat _dst;
+    cv::Mat _xyPos;
+
+    uchar _key;
+
+    const int* _hPos;
+    const int* _hCnt;
+    const int* _vPos;
+    const int* _vCnt;
+
+    int* _d2;
+    int* _closest;
+
+    float _maxDist;
+
+    int _threads;
+
+  public:
+    Parallel_For_distanceTransformBand(const cv::Mat& src,
+                                       uchar key,
+                                       cv::Mat& dst,
+                                       cv::Mat& xyPos,
+                                       float maxDist,
+                                       const int* hPos,
+                                       const int* hCnt,
+                                       const int* vPos,
+                                       const int* vCnt,
+                                       int* d2,
+                                       int* closest,
+                                       int threads)
+    {
+        _src = src;
+        _dst = dst;
+        _xyPos = xyPos;
+
+        _key = key;
+
+        _hPos = hPos;
+        _hCnt = hCnt;
+        _vPos = vPos;
+        _vCnt = vCnt;
+
+        _d2 = d2;
+        _closest = closest;
+
+        _maxDist = maxDist;
+
+        _threads = threads;
+    }
+
+    bool isForeground(type val) const
+    {
+        return _key > 0 ? val == _key : !!val;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_distanceTransformBand");
+
+        type* src_pixels = (type*)_src.ptr<type>();
+        float* sdt = (float*)_dst.ptr<float>();
+        int* xyPos = (int*)_xyPos.ptr<int>();
+
+        // the band is one pixel wider than maxDist, such that the central
+        // differences are still valid at its border
+        float bandDist = _maxDist + 1.0f;
+        float outOfBand = bandDist + 1.0f;
+
+        // the band radius in pixels and the corresponding squared distance in
+        // half pixel units as used by the full transform
+        int band = (int)ceil(bandDist);
+        int maxD2 = (2 * band + 1) * (2 * band + 1);
+
+        int range = _src.rows / _threads;
+
+        int yEnd = r.end * range;
+        if (r.end == _threads)
+        {
+            yEnd = _src.rows;
+        }
+
+        int* d2 = _d2 + r.start * _src.cols;
+        int* closest = _closest + 3 * r.start * _src.cols;
+
+        for (int y = r.start * range; y < yEnd; y++)
+        {
+            int yyStart = std::max(0, y - band - 1);
+            int yyEnd = std::min(_src.rows - 1, y + band + 1);
+
+            type* src_row = src_pixels + y * _src.cols;
+            float* sdt_row = sdt + y * _src.cols;
+            int* xyPos_row = xyPos + 2 * y * _src.cols;
+
+            int numTransitions = 0;
+            for (int yy = yyStart; yy <= yyEnd; yy++)
+            {
+                numTransitions += _hCnt[yy] + _vCnt[yy];
+            }
+
+            // the whole row is outside of the band
+            if (numTransitions == 0)
+            {
+                for (int x = 0; x < _src.cols; x++)
+                {
+                    sdt_row[x] =
+                        isForeground(src_row[x]) ? -outOfBand : outOfBand;
+                    xyPos_row[2 * x] = -1;
+                    xyPos_row[2 * x + 1] = -1;
+                }
+                continue;
+            }
+
+            for (int x = 0; x < _src.cols; x++)
+            {
+                d2[x] = INT_MAX;
+                closest[3 * x] = INT_MAX;
+            }
+
+            for (int yy = yyStart; yy <= yyEnd; yy++)
+            {
+                type* src_row_yy = src_pixels + yy * _src.cols;
+
+                // horizontal transitions within the neighboring rows, where
+                // the row distances are spread over the whole pixel height
+                // like in the column pass of the full transform
+                int dy = y != yy ? 2 * abs(y - yy) - 1 : 0;
+                int dy2 = dy * dy;
+                if (dy2 <= maxD2)
+                {
+                    int dxMax = (int)sqrt((float)(maxD2 - dy2));
+
+                    const int* hPos = _hPos + yy * _src.cols;
+                    for (int k = 0; k < _hCnt[yy]; k++)
+                    {
+                        int j = hPos[k];
+                        int q = (j << 1) - 1;
+                        int px = isForeground(src_row_yy[j]) ? j : j - 1;
+
+                        // only visit the pixels for which |2x - q| <= dxMax
+                        int xStart = std::max(0, j - ((dxMax + 1) >> 1));
+                        int xEnd =
+                            std::min(_src.cols - 1, j + ((dxMax - 1) >> 1));
+                        for (int x = xStart; x <= xEnd; x++)
+                        {
+                            int d = (x << 1) - q;
+                            d = d * d + dy2;
+                            if (d < d2[x])
+                            {
+                                d2[x] = d;
+                            }
+
+                            int c = (x - px) * (x - px) + (y - yy) * (y - yy);
+                            if (c < closest[3 * x])
+                            {
+                                closest[3 * x] = c;
+                                closest[3 * x + 1] = px;
+                                closest[3 * x + 2] = yy;
+                            }
+                        }
+                    }
+                }
+
+                // vertical transitions between the rows yy - 1 and yy, which
+                // only count for pixels within the same column
+                if (yy > 0)
+                {
+                    int d = (y << 1) - ((yy << 1) - 1);
+                    d = d * d;
+                    if (d <= maxD2)
+                    {
+                        const int* vPos = _vPos + yy * _src.cols;
+                        for (int k = 0; k < _vCnt[yy]; k++)
+                        {
+                            int x = vPos[k];
+                            if (d < d2[x])
+                            {
+                                d2[x] = d;
+                            }
+
+                            int py = isForeground(src_row_yy[x]) ? yy : yy - 1;
+                            int c = (y - py) * (y - py);
+                            if (c < closest[3 * x])
+                            {
+                                closest[3 * x] = c;
+                                closest[3 * x + 1] = x;
+                                closest[3 * x + 2] = py;
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int x = 0; x < _src.cols; x++)
+            {
+                bool bg = !isForeground(src_row[x]);
+
+                float ds = bg ? outOfBand : -outOfBand;
+                if (d2[x] <= maxD2)
+                {
+                    float dsBand = sqrt(d2[x]);
+                    dsBand = bg ? dsBand : -dsBand;
+                    dsBand = (dsBand + 1) / 2;
+
+                    if (fabs(dsBand) <= bandDist)
+                        ds = dsBand;
+                }
+
+                sdt_row[x] = ds;
+
+                if (fabs(ds) <= _maxDist)
+                {
+                    xyPos_row[2 * x] = closest[3 * x + 1];
+                    xyPos_row[2 * x + 1] = closest[3 * x + 2];
+                }
+                else
+                {
+                    xyPos_row[2 * x] = -1;
+                    xyPos_row[2 * x + 1] = -1;
+                }
+            }
+        }
+    }
+};
+
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, for each pixel the central
@@ -657,6 +1040,8 @@ class Parallel_For_distanceTransformDX : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_distanceTransformDX");
+
         type* sdt = (type*)_sdt.ptr<type>();
         type* dX = (type*)_dX.ptr<type>();
 
@@ -732,6 +1117,8 @@ class Parallel_For_distanceTransformDY : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_distanceTransformDY");
+
         type* sdt = (type*)_sdt.ptr<type>();
         type* dY = (type*)_dY.ptr<type>();
 
@@ -0,0 +1,100 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stage_timer.h"
+#include "trace.h"
+
+using namespace std;
+
+double StageTimings::milliseconds[NUM_STAGES] = {};
+
+void StageTimings::reset()
+{
+    for (int i = 0; i < NUM_STAGES; i++)
+    {
+        milliseconds[i] = 0.0;
+    }
+}
+
+void StageTimings::add(Stage stage, double milliseconds)
+{
+    StageTimings::milliseconds[stage] += milliseconds;
+}
+
+double StageTimings::get(Stage stage)
+{
+    return milliseconds[stage];
+}
+
+const char* StageTimings::getName(Stage stage)
+{
+    switch (stage)
+    {
+        case STAGE_PYRAMID:
+            return "pyramid";
+        case STAGE_RENDER:
+            return "render";
+        case STAGE_SDT:
+            return "sdt";
+        case STAGE_JACOBIANS:
+            return "jacobians";
+        case STAGE_HISTOGRAMS:
+            return "histograms";
+        case STAGE_ENERGY:
+            return "energy";
+        case STAGE_RELOCALIZATION:
+            return "relocalization";
+        default:
+            return "unknown";
+    }
+}
+
+StageTimer::StageTimer(Stage stage)
+    : stage{stage}, start{chrono::steady_clock::now()}
+{
+}
+
+StageTimer::~StageTimer()
+{
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    chrono::duration<double, milli> elapsed = end - start;
+
+    StageTimings::add(stage, elapsed.count());
+
+#ifdef RBOT_TRACE
+    Trace::record(StageTimings::getName(stage), start, end);
+#endif
+}
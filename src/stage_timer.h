@@ -0,0 +1,122 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <chrono>
+
+/**
+ *  The stages of the per frame pose estimation whose run times are measured.
+ *  Stages may be nested, e.g. the relocalization includes the rendering,
+ *  signed distance transforms and Jacobians of its own pose refinement.
+ */
+enum Stage
+{
+    STAGE_PYRAMID,
+    STAGE_RENDER,
+    STAGE_SDT,
+    STAGE_JACOBIANS,
+    STAGE_HISTOGRAMS,
+    STAGE_ENERGY,
+    STAGE_RELOCALIZATION,
+    NUM_STAGES
+};
+
+/**
+ *  This class accumulates the run times of the stages of the pose estimation
+ *  since the last call of reset(). It is meant to be reset once per frame by
+ *  the thread that estimates the poses, which is also the only thread adding
+ *  to it.
+ */
+class StageTimings
+{
+  public:
+    /**
+     *  Sets the accumulated run times of all stages to zero.
+     */
+    static void reset();
+
+    /**
+     *  Adds a run time to the accumulated run time of a stage.
+     *
+     *  @param  stage The stage that was run.
+     *  @param  milliseconds The run time in milliseconds.
+     */
+    static void add(Stage stage, double milliseconds);
+
+    /**
+     *  Returns the accumulated run time of a stage since the last reset.
+     *
+     *  @param  stage The stage of interest.
+     *  @return The accumulated run time in milliseconds.
+     */
+    static double get(Stage stage);
+
+    /**
+     *  Returns the lower case name of a stage, e.g. for reports.
+     *
+     *  @param  stage The stage of interest.
+     *  @return The name of the stage.
+     */
+    static const char* getName(Stage stage);
+
+  private:
+    static double milliseconds[NUM_STAGES];
+};
+
+/**
+ *  A scoped timer that adds the time between its construction and its
+ *  destruction to the accumulated run time of a stage. With tracing enabled
+ *  it also records a trace event named after the stage.
+ */
+class StageTimer
+{
+  public:
+    explicit StageTimer(Stage stage);
+
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+  private:
+    Stage stage;
+
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // STAGE_TIMER_H
@@ -54,17 +54,9 @@ TCLCHistograms::TCLCHistograms(Model* model,
 
     this->_numHistograms = _model->getNumVertices();
 
-    normalizedFG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32FC1);
-    normalizedBG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32FC1);
+    this->histogramSize = numBins * numBins * numBins;
 
-    notNormalizedFG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32SC1);
-    notNormalizedBG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32SC1);
-
-    initialized = Mat::zeros(1, this->_numHistograms, CV_8UC1);
+    clear();
 }
 
 TCLCHistograms::~TCLCHistograms()
@@ -78,26 +70,36 @@ void TCLCHistograms::update(const Mat& frame,
                             float zNear,
                             float zFar)
 {
+    TRACE_SCOPE("TCLCHistograms::update");
+
     _centersIDs =
         parallelComputeLocalHistogramCenters(mask, depth, K, zNear, zFar, 0);
 
     filterHistogramCenters(100, 10.0f);
 
+    buildCenterGrid();
+
     int threads = (int)_centersIDs.size();
 
-    memset(notNormalizedFG.ptr<int>(),
-           0,
-           _centersIDs.size() * numBins * numBins * numBins * sizeof(int));
-    memset(notNormalizedBG.ptr<int>(),
-           0,
-           _centersIDs.size() * numBins * numBins * numBins * sizeof(int));
+    // the not normalized histograms are only needed for the current centers
+    notNormalizedFG.create(threads, histogramSize, CV_32SC1);
+    notNormalizedBG.create(threads, histogramSize, CV_32SC1);
 
-    memset(normalizedFG.ptr<float>(),
-           0,
-           _centersIDs.size() * numBins * numBins * numBins * sizeof(float));
-    memset(normalizedBG.ptr<float>(),
-           0,
-           _centersIDs.size() * numBins * numBins * numBins * sizeof(float));
+    notNormalizedFG.setTo(0);
+    notNormalizedBG.setTo(0);
+
+    // materialize the normalized histograms of all centers that are used for
+    // the first time, this has to happen before the parallel merge because
+    // the slab might be reallocated
+    vector<int> slots(threads);
+    vector<uchar> isNew(threads);
+
+    for (int c = 0; c < threads; c++)
+    {
+        bool newSlot;
+        slots[c] = acquireSlot(_centersIDs[c].z, newSlot);
+        isNew[c] = newSlot;
+    }
 
     Mat sumsFB = Mat::zeros((int)_centersIDs.size(), 1, CV_32SC2);
 
@@ -118,14 +120,57 @@ void TCLCHistograms::update(const Mat& frame,
                                                     notNormalizedBG,
                                                     normalizedFG,
                                                     normalizedBG,
-                                                    initialized,
-                                                    _centersIDs,
+                                                    posteriors,
+                                                    slots,
+                                                    isNew,
                                                     sumsFB,
                                                     0.1f,
                                                     0.2f,
                                                     threads));
 }
 
+int TCLCHistograms::acquireSlot(int id, bool& isNew)
+{
+    isNew = histogramSlots[id] < 0;
+
+    if (!isNew)
+        return histogramSlots[id];
+
+    // grow the slab geometrically, keeping all previously merged histograms
+    if (numSlots == normalizedFG.rows)
+    {
+        int capacity = std::max(128, 2 * normalizedFG.rows);
+
+        Mat grownFG = Mat::zeros(capacity, histogramSize, CV_32FC1);
+        Mat grownBG = Mat::zeros(capacity, histogramSize, CV_32FC1);
+        Mat grownPosteriors(capacity, histogramSize, CV_32FC1);
+
+        if (numSlots > 0)
+        {
+            normalizedFG.rowRange(0, numSlots)
+                .copyTo(grownFG.rowRange(0, numSlots));
+            normalizedBG.rowRange(0, numSlots)
+                .copyTo(grownBG.rowRange(0, numSlots));
+            posteriors.rowRange(0, numSlots)
+                .copyTo(grownPosteriors.rowRange(0, numSlots));
+        }
+
+        normalizedFG = grownFG;
+        normalizedBG = grownBG;
+        posteriors = grownPosteriors;
+    }
+
+    int slot = numSlots++;
+
+    normalizedFG.row(slot).setTo(0);
+    normalizedBG.row(slot).setTo(0);
+    posteriors.row(slot).setTo(0.5f);
+
+    histogramSlots[id] = slot;
+
+    return slot;
+}
+
 void TCLCHistograms::updateCentersAndIds(const cv::Mat& mask,
                                          const cv::Mat& depth,
                                          const cv::Matx33f& K,
@@ -137,6 +182,8 @@ void TCLCHistograms::updateCentersAndIds(const cv::Mat& mask,
         mask, depth, K, zNear, zFar, level);
 
     filterHistogramCenters(100, 10.0f);
+
+    buildCenterGrid();
 }
 
 vector<Point3i> TCLCHistograms::computeLocalHistogramCenters(const Mat& mask)
@@ -182,15 +229,17 @@ TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat& mask,
     Matx44f T_cm = _model->getPose();
     Matx44f T_n = _model->getNormalization();
 
+    int threads = context.getNumPartitions((int)verticies.size(), 64);
+
     vector<vector<Point3i>> centersIdsCollection;
-    centersIdsCollection.resize(8);
+    centersIdsCollection.resize(threads);
 
     Matx44f T_cm_n = T_cm * T_n;
 
     int m_id = _model->getModelID();
 
     parallel_for_(
-        cv::Range(0, 8),
+        cv::Range(0, threads),
         Parallel_For_computeHistogramCenters(mask,
                                              depth,
                                              verticies,
@@ -201,7 +250,7 @@ TCLCHistograms::parallelComputeLocalHistogramCenters(const Mat& mask,
                                              m_id,
                                              level,
                                              centersIdsCollection.data(),
-                                             8));
+                                             threads));
 
     for (int i = 0; i < centersIdsCollection.size(); i++)
     {
@@ -253,6 +302,85 @@ void TCLCHistograms::filterHistogramCenters(int numHistograms, float offset)
     _offset = offset;
 }
 
+void TCLCHistograms::buildCenterGrid()
+{
+    // pad the regions by one pixel since the kernels truncate the distances
+    // to the centers to integers before comparing them to the radius
+    int reach = radius + 1;
+
+    centerGrid.cellSize = std::max(1, radius / 2);
+
+    if (_centersIDs.empty())
+    {
+        centerGrid.x0 = centerGrid.y0 = 0;
+        centerGrid.cols = centerGrid.rows = 0;
+        centerGrid.offsets.assign(1, 0);
+        centerGrid.ids.clear();
+        return;
+    }
+
+    int minX = INT_MAX, minY = INT_MAX;
+    int maxX = INT_MIN, maxY = INT_MIN;
+
+    for (size_t c = 0; c < _centersIDs.size(); c++)
+    {
+        minX = std::min(minX, _centersIDs[c].x);
+        minY = std::min(minY, _centersIDs[c].y);
+        maxX = std::max(maxX, _centersIDs[c].x);
+        maxY = std::max(maxY, _centersIDs[c].y);
+    }
+
+    int cellSize = centerGrid.cellSize;
+
+    centerGrid.x0 = minX - reach;
+    centerGrid.y0 = minY - reach;
+    centerGrid.cols = (maxX - minX + 2 * reach) / cellSize + 1;
+    centerGrid.rows = (maxY - minY + 2 * reach) / cellSize + 1;
+
+    int numCells = centerGrid.cols * centerGrid.rows;
+
+    // first count the centers per cell, then fill the lists in the order of
+    // the centers so that kernels accumulate in the same order as before
+    vector<int>& offsets = centerGrid.offsets;
+    offsets.assign(numCells + 1, 0);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        vector<int> fill;
+        if (pass == 1)
+        {
+            for (int c = 0; c < numCells; c++)
+                offsets[c + 1] += offsets[c];
+
+            centerGrid.ids.resize(offsets[numCells]);
+            fill.assign(offsets.begin(), offsets.end() - 1);
+        }
+
+        for (size_t h = 0; h < _centersIDs.size(); h++)
+        {
+            Point3i center = _centersIDs[h];
+
+            int cx0 = (center.x - reach - centerGrid.x0) / cellSize;
+            int cx1 = (center.x + reach - centerGrid.x0) / cellSize;
+            int cy0 = (center.y - reach - centerGrid.y0) / cellSize;
+            int cy1 = (center.y + reach - centerGrid.y0) / cellSize;
+
+            for (int cy = cy0; cy <= cy1; cy++)
+            {
+                for (int cx = cx0; cx <= cx1; cx++)
+                {
+                    int cell = cy * centerGrid.cols + cx;
+
+                    if (pass == 0)
+                        offsets[cell + 1]++;
+                    else
+                        centerGrid.ids[fill[cell]++] = (int)h;
+                }
+            }
+        }
+    }
+}
+
 Mat TCLCHistograms::getLocalForegroundHistograms()
 {
     return normalizedFG;
@@ -263,14 +391,29 @@ Mat TCLCHistograms::getLocalBackgroundHistograms()
     return normalizedBG;
 }
 
-vector<Point3i> TCLCHistograms::getCentersAndIDs()
+Mat TCLCHistograms::getLocalPosteriors()
+{
+    return posteriors;
+}
+
+const vector<Point3i>& TCLCHistograms::getCentersAndIDs()
 {
     return _centersIDs;
 }
 
-Mat TCLCHistograms::getInitialized()
+const HistogramCenterGrid& TCLCHistograms::getCenterGrid()
 {
-    return initialized;
+    return centerGrid;
+}
+
+const vector<int>& TCLCHistograms::getHistogramSlots()
+{
+    return histogramSlots;
+}
+
+int TCLCHistograms::getNumInitialized()
+{
+    return numSlots;
 }
 
 int TCLCHistograms::getNumBins()
@@ -293,17 +436,18 @@ float TCLCHistograms::getOffset()
     return _offset;
 }
 
+void TCLCHistograms::setExecutionContext(const ExecutionContext& context)
+{
+    this->context = context;
+}
+
 void TCLCHistograms::clear()
 {
-    normalizedFG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32FC1);
-    normalizedBG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32FC1);
+    // keep the slab allocated for re-initialization, rows are cleared as soon
+    // as they are handed out again
+    histogramSlots.assign(this->_numHistograms, -1);
 
-    notNormalizedFG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32SC1);
-    notNormalizedBG =
-        Mat::zeros(this->_numHistograms, numBins * numBins * numBins, CV_32SC1);
+    numSlots = 0;
 
-    initialized = Mat::zeros(1, this->_numHistograms, CV_8UC1);
+    buildCenterGrid();
 }
@@ -36,22 +36,77 @@
 #ifndef TCLC_HISTOGRAMS_H
 #define TCLC_HISTOGRAMS_H
 
+#include <vector>
+
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "execution_context.h"
+#include "trace.h"
+
 class Model;
 
+/**
+ *  A uniform grid over the full resolution image plane that lists for every
+ *  cell the indices of all histogram centers whose local region overlaps the
+ *  cell. The lists are stored in compressed sparse row form, i.e. the centers
+ *  of cell c are ids[offsets[c]] ... ids[offsets[c + 1] - 1] in ascending
+ *  order.
+ */
+struct HistogramCenterGrid
+{
+    // The full resolution pixel location of the grid's top left corner.
+    int x0;
+    int y0;
+
+    // The edge length of a grid cell in full resolution pixels.
+    int cellSize;
+
+    // The number of grid cells in x- and y-direction.
+    int cols;
+    int rows;
+
+    // The start of each cell's list within ids (cols * rows + 1 entries).
+    std::vector<int> offsets;
+
+    // The indices into the list of centers and IDs per cell.
+    std::vector<int> ids;
+
+    /**
+     *  Returns the index of the cell containing a given full resolution pixel
+     * location.
+     *
+     *  @param  x The x-coordinate of the pixel at full resolution.
+     *  @param  y The y-coordinate of the pixel at full resolution.
+     *  @return The index of the cell or -1 if the pixel lies outside the grid.
+     */
+    int getCell(int x, int y) const
+    {
+        int cx = (x - x0) / cellSize;
+        int cy = (y - y0) / cellSize;
+
+        if (x < x0 || y < y0 || cx >= cols || cy >= rows)
+            return -1;
+
+        return cy * cols + cx;
+    }
+};
+
 /**
  *  This class implements an statistical image segmentation model based on
  * temporary consistent, local color histograms (tclc-histograms). Here, each
- * histogram corresponds to a 3D vertex of a given 3D model.
+ * histogram corresponds to a 3D vertex of a given 3D model. Histograms are
+ * only materialized for vertices that have been selected as histogram centers
+ * during an update. They are stored as rows of a pooled slab that grows on
+ * demand and a per vertex slot table maps each vertex ID to its row.
  */
 class TCLCHistograms
 {
   public:
     /**
-     *  Constructor that allocates both normalized and not normalized foreground
-     *  and background histograms for each vertex of the given 3D model.
+     *  Constructor that sets up an empty histogram slot table for all vertices
+     *  of the given 3D model. No histogram memory is allocated until a vertex
+     *  is used as a histogram center for the first time.
      *
      *  @param  model The 3D model for which the histograms are being created.
      *  @param  numBins The number of bins per color channel.
@@ -105,19 +160,32 @@ class TCLCHistograms
                              int level);
 
     /**
-     *  Returns all normalized forground histograms in their current state.
+     *  Returns all materialized normalized forground histograms in their
+     * current state, one row per slot (see getHistogramSlots()).
      *
      *  @return The normalized foreground histograms.
      */
     cv::Mat getLocalForegroundHistograms();
 
     /**
-     *  Returns all normalized background histograms in their current state.
+     *  Returns all materialized normalized background histograms in their
+     * current state, one row per slot (see getHistogramSlots()).
      *
      *  @return The normalized background histograms.
      */
     cv::Mat getLocalBackgroundHistograms();
 
+    /**
+     *  Returns the cached pixel-wise foreground posteriors pF / (pF + pB) of
+     * all materialized histograms for every histogram bin, one row per slot
+     * (see getHistogramSlots()). They are recomputed for all histograms that
+     * are merged during update(), the background posteriors are given by
+     * 1 - pF.
+     *
+     *  @return The foreground posteriors per histogram slot and bin.
+     */
+    cv::Mat getLocalPosteriors();
+
     /**
      *  Returns the locations and IDs of all histogram centers that where used
      * for the last update() or updateCentersAndIds() call.
@@ -126,16 +194,34 @@ class TCLCHistograms
      * contour and their corresponding IDs [(x_0, y_0, id_0), (x_1, y_1, id_1),
      * ...].
      */
-    std::vector<cv::Point3i> getCentersAndIDs();
+    const std::vector<cv::Point3i>& getCentersAndIDs();
+
+    /**
+     *  Returns a spatial index of the histogram centers that where used for
+     * the last update() or updateCentersAndIds() call, that tells for each
+     * pixel which of these centers it might lie close to.
+     *
+     *  @return The grid of histogram center indices.
+     */
+    const HistogramCenterGrid& getCenterGrid();
 
     /**
-     *  Returns a 1D binary mask of all histograms where a '1' means that the
-     * histograms corresponding to the index has been intialized before.
+     *  Returns the slot table of all histograms, i.e. for every vertex ID the
+     * row of its histogram within getLocalForegroundHistograms() and
+     * getLocalBackgroundHistograms(), or -1 if the histogram has not been
+     * initialized yet.
      *
-     *  @return A 1D binary mask telling wheter each histogram has been
-     * initialized or not.
+     *  @return The per vertex histogram slots.
      */
-    cv::Mat getInitialized();
+    const std::vector<int>& getHistogramSlots();
+
+    /**
+     *  Returns the number of histograms that have been initialized so far,
+     * i.e. the number of used rows within the histogram slab.
+     *
+     *  @return The number of initialized histograms.
+     */
+    int getNumInitialized();
 
     /**
      *  Returns the number of histogram bin per image channel as specified in
@@ -171,6 +257,14 @@ class TCLCHistograms
      */
     float getOffset();
 
+    /**
+     *  Sets the execution context used to parallelize the computation of the
+     * histogram centers.
+     *
+     *  @param  context The execution context.
+     */
+    void setExecutionContext(const ExecutionContext& context);
+
     /**
      *  Clears all histograms by resetting them to zero and setting their status
      * to uninitialized
@@ -186,18 +280,28 @@ class TCLCHistograms
 
     float _offset;
 
+    int histogramSize;
+
     cv::Mat notNormalizedFG;
     cv::Mat notNormalizedBG;
 
     cv::Mat normalizedFG;
     cv::Mat normalizedBG;
 
-    cv::Mat initialized;
+    cv::Mat posteriors;
+
+    std::vector<int> histogramSlots;
+
+    int numSlots;
 
     Model* _model;
 
     std::vector<cv::Point3i> _centersIDs;
 
+    HistogramCenterGrid centerGrid;
+
+    ExecutionContext context;
+
     std::vector<cv::Point3i> computeLocalHistogramCenters(const cv::Mat& mask);
 
     std::vector<cv::Point3i>
@@ -209,6 +313,10 @@ class TCLCHistograms
                                          int level);
 
     void filterHistogramCenters(int numHistograms, float offset);
+
+    void buildCenterGrid();
+
+    int acquireSlot(int id, bool& isNew);
 };
 
 /**
@@ -336,6 +444,8 @@ class Parallel_For_buildLocalHistograms : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_buildLocalHistograms");
+
         int range = (int)_centers.size() / _threads;
 
         int cEnd = r.end * range;
@@ -530,9 +640,10 @@ class Parallel_For_mergeLocalHistograms : public cv::ParallelLoopBody
     float* normalizedFGData;
     float* normalizedBGData;
 
-    uchar* initializedData;
+    float* posteriorsData;
 
-    std::vector<cv::Point3i> _centersIds;
+    std::vector<int> _slots;
+    std::vector<uchar> _isNew;
 
     float _alphaF;
     float _alphaB;
@@ -546,8 +657,9 @@ class Parallel_For_mergeLocalHistograms : public cv::ParallelLoopBody
                                       const cv::Mat& notNormalizedBG,
                                       cv::Mat& normalizedFG,
                                       cv::Mat& normalizedBG,
-                                      cv::Mat& initialized,
-                                      const std::vector<cv::Point3i> centersIds,
+                                      cv::Mat& posteriors,
+                                      const std::vector<int>& slots,
+                                      const std::vector<uchar>& isNew,
                                       const cv::Mat& sumsFB,
                                       float alphaF,
                                       float alphaB,
@@ -561,9 +673,10 @@ class Parallel_For_mergeLocalHistograms : public cv::ParallelLoopBody
         normalizedFGData = (float*)normalizedFG.ptr<float>();
         normalizedBGData = (float*)normalizedBG.ptr<float>();
 
-        initializedData = initialized.data;
+        posteriorsData = (float*)posteriors.ptr<float>();
 
-        _centersIds = centersIds;
+        _slots = slots;
+        _isNew = isNew;
 
         _sumsFB = sumsFB;
 
@@ -577,6 +690,8 @@ class Parallel_For_mergeLocalHistograms : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_mergeLocalHistograms");
+
         int range = _sumsFB.rows / _threads;
 
         int hEnd = r.end * range;
@@ -587,75 +702,63 @@ class Parallel_For_mergeLocalHistograms : public cv::ParallelLoopBody
 
         for (int h = r.start * range; h < hEnd; h++)
         {
-            int cID = _centersIds[h].z;
+            int slot = _slots[h];
 
             int* notNormalizedFG = notNormalizedFGData + h * histogramSize;
             int* notNormalizedBG = notNormalizedBGData + h * histogramSize;
 
-            float* normalizedFG = normalizedFGData + cID * histogramSize;
-            float* normalizedBG = normalizedBGData + cID * histogramSize;
+            float* normalizedFG = normalizedFGData + slot * histogramSize;
+            float* normalizedBG = normalizedBGData + slot * histogramSize;
+
+            float* posterior = posteriorsData + slot * histogramSize;
 
             int totalFGPixels = _sumsFBData[h * 2];
             int totalBGPixels = _sumsFBData[h * 2 + 1];
 
-            if (initializedData[cID] == 0)
+            if (_isNew[h])
             {
                 for (int i = 0; i < histogramSize; i++)
                 {
-                    if (false)
+                    if (notNormalizedFG[i])
                     {
                         normalizedFG[i] =
                             (float)notNormalizedFG[i] / totalFGPixels;
-                        normalizedBG[i] =
-                            (float)notNormalizedBG[i] / totalBGPixels;
                     }
-                    else
+                    if (notNormalizedBG[i])
                     {
-                        if (notNormalizedFG[i])
-                        {
-                            normalizedFG[i] =
-                                (float)notNormalizedFG[i] / totalFGPixels;
-                        }
-                        if (notNormalizedBG[i])
-                        {
-                            normalizedBG[i] =
-                                (float)notNormalizedBG[i] / totalBGPixels;
-                        }
+                        normalizedBG[i] =
+                            (float)notNormalizedBG[i] / totalBGPixels;
                     }
                 }
-                initializedData[cID] = 1;
             }
             else
             {
                 for (int i = 0; i < histogramSize; i++)
                 {
-
-                    if (false)
+                    if (notNormalizedFG[i])
                     {
                         normalizedFG[i] =
-                            (float)notNormalizedFG[i] / totalFGPixels;
-                        normalizedBG[i] =
-                            (float)notNormalizedBG[i] / totalBGPixels;
+                            (1.0f - _alphaF) * normalizedFG[i] +
+                            _alphaF * (float)notNormalizedFG[i] / totalFGPixels;
                     }
-                    else
+                    if (notNormalizedBG[i])
                     {
-                        if (notNormalizedFG[i])
-                        {
-                            normalizedFG[i] =
-                                (1.0f - _alphaF) * normalizedFG[i] +
-                                _alphaF * (float)notNormalizedFG[i] /
-                                    totalFGPixels;
-                        }
-                        if (notNormalizedBG[i])
-                        {
-                            normalizedBG[i] =
-                                (1.0f - _alphaB) * normalizedBG[i] +
-                                _alphaB * (float)notNormalizedBG[i] /
-                                    totalBGPixels;
-                        }
+                        normalizedBG[i] =
+                            (1.0f - _alphaB) * normalizedBG[i] +
+                            _alphaB * (float)notNormalizedBG[i] / totalBGPixels;
                     }
                 }
             }
+
+            // cache the pixel-wise posteriors, so that they don't have to be
+            // recomputed for every pixel and center by the consumers
+            for (int i = 0; i < histogramSize; i++)
+            {
+                float pyf = normalizedFG[i] + 0.0000001f;
+                float pyb = normalizedBG[i] + 0.0000001f;
+
+                posterior[i] = pyf / (pyf + pyb);
+            }
         }
     }
 };
@@ -744,6 +847,8 @@ class Parallel_For_computeHistogramCenters : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_computeHistogramCenters");
+
         int range = (int)_verticies.size() / _threads;
 
         int vEnd = r.end * range;
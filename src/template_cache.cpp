@@ -0,0 +1,600 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "template_cache.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "template_view.h"
+
+using namespace std;
+using namespace cv;
+
+static const char CACHE_MAGIC[8] = {'R', 'B', 'O', 'T', 'T', 'P', 'L', '\0'};
+
+static const uint32_t CACHE_VERSION = 4;
+
+// all sections are padded such that the records in the mapping are aligned
+static const size_t CACHE_ALIGNMENT = 8;
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t modelHash;
+    float normalization[16];
+    float K[9];
+    int32_t width;
+    int32_t height;
+    float zNear;
+    float zFar;
+    int32_t numBins;
+    int32_t radius;
+    int32_t numLevels;
+    int32_t numDistances;
+    int32_t backend;
+    int32_t numHistograms;
+    int32_t numBaseTemplates;
+    int32_t numNeighboringTemplates;
+};
+
+struct TemplateRecord
+{
+    float pose[16];
+    float alpha;
+    float beta;
+    float gamma;
+    float distance;
+    int32_t numNeighbors;
+    int32_t reserved;
+};
+
+struct LevelRecord
+{
+    int32_t etaF;
+    int32_t roi[4];
+    int32_t rows;
+    int32_t cols;
+    int32_t numCenters;
+    int32_t numPixels;
+    int32_t numIDs;
+};
+
+static_assert(sizeof(CacheHeader) == 176, "unexpected cache header size");
+static_assert(sizeof(TemplateRecord) == 88, "unexpected template size");
+static_assert(sizeof(LevelRecord) == 40, "unexpected level size");
+
+static CacheHeader createHeader(const TemplateCacheKey& key)
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.modelHash = key.modelHash;
+    memcpy(header.normalization, key.normalization.val, sizeof(float) * 16);
+    memcpy(header.K, key.K.val, sizeof(float) * 9);
+    header.width = key.frameSize.width;
+    header.height = key.frameSize.height;
+    header.zNear = key.zNear;
+    header.zFar = key.zFar;
+    header.numBins = key.numBins;
+    header.radius = key.radius;
+    header.numLevels = key.numLevels;
+    header.numDistances = (int32_t)key.distances.size();
+    header.backend = key.backend;
+    header.numHistograms = key.numHistograms;
+
+    return header;
+}
+
+// 64 bit FNV-1a hash of the key, used to tell cache files apart
+static uint64_t hashKey(const TemplateCacheKey& key)
+{
+    CacheHeader header = createHeader(key);
+
+    uint64_t hash = 14695981039346656037ull;
+
+    const uchar* bytes = (const uchar*)&header;
+    for (size_t i = 0; i < sizeof(header); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    bytes = (const uchar*)key.distances.data();
+    for (size_t i = 0; i < key.distances.size() * sizeof(float); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static void append(vector<uchar>& buffer, const void* src, size_t size)
+{
+    const uchar* bytes = (const uchar*)src;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+
+    size_t padding = (CACHE_ALIGNMENT - size % CACHE_ALIGNMENT) %
+                     CACHE_ALIGNMENT;
+    buffer.insert(buffer.end(), padding, 0);
+}
+
+// returns the next section of the given size and advances the cursor past it,
+// or a null pointer if the file is truncated
+static uchar* consume(size_t& offset, uchar* data, size_t size, size_t bytes)
+{
+    size_t padding = (CACHE_ALIGNMENT - bytes % CACHE_ALIGNMENT) %
+                     CACHE_ALIGNMENT;
+
+    if (offset > size || bytes + padding > size - offset)
+    {
+        return nullptr;
+    }
+
+    uchar* section = data + offset;
+    offset += bytes + padding;
+
+    return section;
+}
+
+static bool appendLevel(vector<uchar>& buffer,
+                        TemplateView* templateView,
+                        int level)
+{
+    Mat mask = templateView->getMask(level);
+    Mat sdt = templateView->getSDT(level);
+    Mat heaviside = templateView->getHeaviside(level);
+
+    if (sdt.size() != mask.size() || heaviside.size() != mask.size() ||
+        (!mask.empty() && (mask.type() != CV_8UC1 || sdt.type() != CV_32FC1 ||
+                           heaviside.type() != CV_32FC1)))
+    {
+        return false;
+    }
+
+    vector<Point3i> centersIDs = templateView->getCentersAndIDs(level);
+    const CompressedPixelData& pixelData =
+        templateView->getCompressedPixelData(level);
+
+    Rect roi = templateView->getROI(level);
+
+    LevelRecord record;
+    record.etaF = templateView->getEtaF(level);
+    record.roi[0] = roi.x;
+    record.roi[1] = roi.y;
+    record.roi[2] = roi.width;
+    record.roi[3] = roi.height;
+    record.rows = mask.rows;
+    record.cols = mask.cols;
+    record.numCenters = (int32_t)centersIDs.size();
+    record.numPixels = pixelData.numPixels;
+    record.numIDs = pixelData.numIDs;
+
+    append(buffer, &record, sizeof(record));
+
+    Mat continuousMask = mask.isContinuous() ? mask : mask.clone();
+    Mat continuousSDT = sdt.isContinuous() ? sdt : sdt.clone();
+    Mat continuousHS = heaviside.isContinuous() ? heaviside : heaviside.clone();
+
+    append(buffer, continuousMask.data, mask.total() * mask.elemSize());
+    append(buffer, continuousSDT.data, sdt.total() * sdt.elemSize());
+    append(buffer, continuousHS.data, heaviside.total() * heaviside.elemSize());
+    append(buffer, centersIDs.data(), centersIDs.size() * sizeof(Point3i));
+
+    // the pixel data already is a single block of memory, whose arrays start
+    // at the x coordinates
+    append(buffer,
+           pixelData.x,
+           CompressedPixelData::getSize(pixelData.numPixels,
+                                        pixelData.numIDs) *
+               sizeof(int32_t));
+
+    return true;
+}
+
+TemplateCache::TemplateCache(const string& directory,
+                             const string& name,
+                             const TemplateCacheKey& key)
+{
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashKey(key));
+
+    this->filename = directory + "/" + name + "-" + hash + ".rbtc";
+    this->key = key;
+
+    data = nullptr;
+    size = 0;
+}
+
+TemplateCache::~TemplateCache()
+{
+    unmap();
+}
+
+string TemplateCache::getFilename()
+{
+    return filename;
+}
+
+bool TemplateCache::load(vector<TemplateView*>& baseTemplates,
+                         vector<TemplateView*>& neighboringTemplates)
+{
+    unmap();
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) == -1 ||
+        (size_t)status.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    // a private writable mapping, such that modifying the referenced images
+    // only ever copies the touched pages
+    size = status.st_size;
+    void* mapping =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        size = 0;
+        return false;
+    }
+    data = (uchar*)mapping;
+
+    CacheHeader expected = createHeader(key);
+
+    size_t offset = 0;
+    CacheHeader* header =
+        (CacheHeader*)consume(offset, data, size, sizeof(CacheHeader));
+
+    float* distances = (float*)consume(
+        offset, data, size, key.distances.size() * sizeof(float));
+
+    // all fields but the template counts have to match the key
+    if (!header || !distances ||
+        memcmp(header, &expected, offsetof(CacheHeader, numBaseTemplates)) !=
+            0 ||
+        memcmp(distances,
+               key.distances.data(),
+               key.distances.size() * sizeof(float)) != 0 ||
+        header->numBaseTemplates < 0 || header->numNeighboringTemplates < 0 ||
+        (size_t)header->numBaseTemplates + header->numNeighboringTemplates >
+            size / sizeof(TemplateRecord))
+    {
+        unmap();
+        return false;
+    }
+
+    int numTemplates =
+        header->numBaseTemplates + header->numNeighboringTemplates;
+
+    vector<TemplateView*> templateViews;
+    vector<vector<int>> neighborIndices(numTemplates);
+
+    bool valid = true;
+
+    for (int t = 0; t < numTemplates && valid; t++)
+    {
+        TemplateRecord* record = (TemplateRecord*)consume(
+            offset, data, size, sizeof(TemplateRecord));
+
+        if (!record || record->numNeighbors < 0)
+        {
+            valid = false;
+            break;
+        }
+
+        int* neighbors = (int*)consume(
+            offset, data, size, record->numNeighbors * sizeof(int32_t));
+
+        if (!neighbors)
+        {
+            valid = false;
+            break;
+        }
+
+        neighborIndices[t].assign(neighbors, neighbors + record->numNeighbors);
+
+        TemplateView* templateView = new TemplateView();
+        templateViews.push_back(templateView);
+
+        templateView->T_cm = Matx44f(record->pose);
+        templateView->_alpha = record->alpha;
+        templateView->_beta = record->beta;
+        templateView->_gamma = record->gamma;
+        templateView->_distance = record->distance;
+        templateView->_numLevels = key.numLevels;
+        templateView->_radius = key.radius;
+
+        templateView->centersIDsPyramid.resize(key.numLevels);
+        templateView->roiPyramid.resize(key.numLevels);
+        templateView->etaFPyramid.resize(key.numLevels);
+        templateView->maskPyramid.resize(key.numLevels);
+        templateView->sdtPyramid.resize(key.numLevels);
+        templateView->heavisidePyramid.resize(key.numLevels);
+        templateView->pixelDataPyramid.resize(key.numLevels);
+
+        for (int level = 0; level < key.numLevels && valid; level++)
+        {
+            valid = readLevel(offset, templateView, level);
+        }
+
+        // the packed masks are cheap to derive, so they are not stored
+        if (valid)
+        {
+            templateView->packMasks();
+        }
+    }
+
+    // restore the references of the base templates to their neighbors
+    for (int t = 0; t < (int)templateViews.size() && valid; t++)
+    {
+        for (size_t n = 0; n < neighborIndices[t].size(); n++)
+        {
+            int index = header->numBaseTemplates + neighborIndices[t][n];
+
+            if (index < header->numBaseTemplates || index >= numTemplates)
+            {
+                valid = false;
+                break;
+            }
+
+            templateViews[t]->addNeighborTemplate(templateViews[index]);
+        }
+    }
+
+    if (!valid)
+    {
+        for (size_t t = 0; t < templateViews.size(); t++)
+        {
+            delete templateViews[t];
+        }
+        unmap();
+        return false;
+    }
+
+    baseTemplates.assign(templateViews.begin(),
+                         templateViews.begin() + header->numBaseTemplates);
+    neighboringTemplates.assign(
+        templateViews.begin() + header->numBaseTemplates, templateViews.end());
+
+    return true;
+}
+
+bool TemplateCache::save(const vector<TemplateView*>& baseTemplates,
+                         const vector<TemplateView*>& neighboringTemplates)
+{
+    map<TemplateView*, int> neighborIndices;
+    for (size_t i = 0; i < neighboringTemplates.size(); i++)
+    {
+        neighborIndices[neighboringTemplates[i]] = (int)i;
+    }
+
+    CacheHeader header = createHeader(key);
+    header.numBaseTemplates = (int32_t)baseTemplates.size();
+    header.numNeighboringTemplates = (int32_t)neighboringTemplates.size();
+
+    vector<uchar> buffer;
+    append(buffer, &header, sizeof(header));
+    append(buffer,
+           key.distances.data(),
+           key.distances.size() * sizeof(float));
+
+    vector<TemplateView*> templateViews = baseTemplates;
+    templateViews.insert(templateViews.end(),
+                         neighboringTemplates.begin(),
+                         neighboringTemplates.end());
+
+    for (size_t t = 0; t < templateViews.size(); t++)
+    {
+        TemplateView* templateView = templateViews[t];
+
+        vector<TemplateView*> neighbors = templateView->getNeighborTemplates();
+        vector<int32_t> indices(neighbors.size());
+
+        for (size_t n = 0; n < neighbors.size(); n++)
+        {
+            map<TemplateView*, int>::iterator it =
+                neighborIndices.find(neighbors[n]);
+            if (it == neighborIndices.end())
+            {
+                return false;
+            }
+            indices[n] = it->second;
+        }
+
+        Matx44f pose = templateView->getPose();
+
+        TemplateRecord record;
+        memcpy(record.pose, pose.val, sizeof(float) * 16);
+        record.alpha = templateView->getAlpha();
+        record.beta = templateView->getBeta();
+        record.gamma = templateView->getGamma();
+        record.distance = templateView->getDistance();
+        record.numNeighbors = (int32_t)indices.size();
+        record.reserved = 0;
+
+        append(buffer, &record, sizeof(record));
+        append(buffer, indices.data(), indices.size() * sizeof(int32_t));
+
+        for (int level = 0; level < key.numLevels; level++)
+        {
+            if (!appendLevel(buffer, templateView, level))
+            {
+                return false;
+            }
+        }
+    }
+
+    // write to a temporary file first, such that an interrupted write never
+    // leaves a truncated cache behind
+    string tmpFilename = filename + ".tmp";
+
+    ofstream file(tmpFilename.c_str(), ios::binary | ios::trunc);
+    file.write((const char*)buffer.data(), buffer.size());
+    file.close();
+
+    if (!file || rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool TemplateCache::readLevel(size_t& offset,
+                              TemplateView* templateView,
+                              int level)
+{
+    LevelRecord* record =
+        (LevelRecord*)consume(offset, data, size, sizeof(LevelRecord));
+
+    if (!record || record->rows < 0 || record->cols < 0 ||
+        record->numCenters < 0 || record->numPixels < 0 || record->numIDs < 0)
+    {
+        return false;
+    }
+
+    size_t area = (size_t)record->rows * record->cols;
+
+    uchar* mask = consume(offset, data, size, area);
+    uchar* sdt = consume(offset, data, size, area * sizeof(float));
+    uchar* heaviside = consume(offset, data, size, area * sizeof(float));
+    uchar* centers =
+        consume(offset, data, size, record->numCenters * sizeof(Point3i));
+    int* pixels = (int*)consume(
+        offset,
+        data,
+        size,
+        CompressedPixelData::getSize(record->numPixels, record->numIDs) *
+            sizeof(int32_t));
+
+    if (!mask || !sdt || !heaviside || !centers || !pixels)
+    {
+        return false;
+    }
+
+    templateView->etaFPyramid[level] = record->etaF;
+    templateView->roiPyramid[level] = Rect(
+        record->roi[0], record->roi[1], record->roi[2], record->roi[3]);
+
+    // the images are not copied but refer to the private mapping
+    if (area > 0)
+    {
+        templateView->maskPyramid[level] =
+            Mat(record->rows, record->cols, CV_8UC1, mask);
+        templateView->sdtPyramid[level] =
+            Mat(record->rows, record->cols, CV_32FC1, sdt);
+        templateView->heavisidePyramid[level] =
+            Mat(record->rows, record->cols, CV_32FC1, heaviside);
+    }
+
+    // the IDs index the histograms, so they must not exceed their number
+    Point3i* centersIDs = (Point3i*)centers;
+    for (int i = 0; i < record->numCenters; i++)
+    {
+        if (centersIDs[i].z < 0 || centersIDs[i].z >= key.numHistograms)
+        {
+            return false;
+        }
+    }
+
+    templateView->centersIDsPyramid[level].assign(
+        centersIDs, centersIDs + record->numCenters);
+
+    // the pixel data is used in place as well
+    CompressedPixelData& pixelData = templateView->pixelDataPyramid[level];
+    pixelData.assign(pixels, record->numPixels, record->numIDs);
+
+    if (pixelData.offsets[0] != 0 ||
+        pixelData.offsets[record->numPixels] != record->numIDs)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < record->numPixels; i++)
+    {
+        if (pixelData.offsets[i] > pixelData.offsets[i + 1])
+        {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < record->numIDs; i++)
+    {
+        if (pixelData.ids[i] < 0 || pixelData.ids[i] >= key.numHistograms)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void TemplateCache::unmap()
+{
+    if (data)
+    {
+        munmap(data, size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
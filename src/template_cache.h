@@ -0,0 +1,157 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TEMPLATE_CACHE_H
+#define TEMPLATE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+class TemplateView;
+
+/**
+ *  Everything the generated template views depend on. A cache file is only
+ *  used if all of these match exactly.
+ */
+struct TemplateCacheKey
+{
+    // The hash of the model file.
+    uint64_t modelHash;
+
+    // The normalization of the model including its scaling.
+    cv::Matx44f normalization;
+
+    // The intrinsic camera matrix and image size at full resolution.
+    cv::Matx33f K;
+    cv::Size frameSize;
+
+    // The distances of the OpenGL near and far planes.
+    float zNear;
+    float zFar;
+
+    // The RenderingEngine::Backend the templates are rendered with.
+    int backend;
+
+    // The parameters of the tclc-histograms.
+    int numBins;
+    int radius;
+
+    // The number of tclc-histograms, i.e. the number of model vertices.
+    int numHistograms;
+
+    // The number of pyramid levels of each template view.
+    int numLevels;
+
+    // The distances to the camera the templates are generated at.
+    std::vector<float> distances;
+};
+
+/**
+ *  This class implements a persistent cache of the template views of an
+ *  object, such that they only need to be generated once instead of at every
+ *  startup. The complete set of base and neighboring templates, including
+ *  their image pyramids, histogram centers, compressed pixel data and the
+ *  neighbor relations, is stored in a versioned binary file whose name is
+ *  derived from the key. On load the file is memory mapped and the template
+ *  views reference the mapped images and pixel data instead of copying
+ *  them, so the mapping is kept until the cache is deleted.
+ */
+class TemplateCache
+{
+  public:
+    /**
+     *  Constructor of a cache within a given directory.
+     *
+     *  @param  directory The directory the cache file is located in.
+     *  @param  name The name of the object, used as the prefix of the file
+     * name.
+     *  @param  key The parameters the template views depend on.
+     */
+    TemplateCache(const std::string& directory,
+                  const std::string& name,
+                  const TemplateCacheKey& key);
+
+    ~TemplateCache();
+
+    /**
+     *  Returns the path of the cache file.
+     *
+     *  @return The path of the cache file.
+     */
+    std::string getFilename();
+
+    /**
+     *  Loads all template views from the cache file, if it exists and matches
+     * the key.
+     *
+     *  @param  baseTemplates The output base templates.
+     *  @param  neighboringTemplates The output neighboring templates, which
+     * the base templates refer to.
+     *  @return True if the templates were loaded and false if they have to be
+     * generated.
+     */
+    bool load(std::vector<TemplateView*>& baseTemplates,
+              std::vector<TemplateView*>& neighboringTemplates);
+
+    /**
+     *  Writes all template views to the cache file, replacing it atomically.
+     *
+     *  @param  baseTemplates The base templates.
+     *  @param  neighboringTemplates The neighboring templates, which must
+     * contain all neighbors of the base templates.
+     *  @return True if the cache file has been written and false otherwise.
+     */
+    bool save(const std::vector<TemplateView*>& baseTemplates,
+              const std::vector<TemplateView*>& neighboringTemplates);
+
+  private:
+    std::string filename;
+
+    TemplateCacheKey key;
+
+    uchar* data;
+
+    size_t size;
+
+    bool readLevel(size_t& offset, TemplateView* templateView, int level);
+
+    void unmap();
+};
+
+#endif // TEMPLATE_CACHE_H
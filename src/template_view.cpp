@@ -38,6 +38,160 @@
 using namespace std;
 using namespace cv;
 
+// the popcount instruction is only used where the CPU supports it, the rest
+// of the binary does not require it
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAS_TARGET_POPCNT
+#define TARGET_POPCNT __attribute__((target("popcnt")))
+#endif
+
+// the helpers of the overlap count are inlined into both of its variants,
+// such that the popcount is compiled to the instruction within the one for
+// its target
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+namespace
+{
+    ALWAYS_INLINE int popCount(uint64_t word)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(word);
+#else
+        int cnt = 0;
+        for (; word; cnt++)
+        {
+            word &= word - 1;
+        }
+        return cnt;
+#endif
+    }
+
+    // returns the 64 bits of a packed map row starting at column px, where
+    // all columns outside of the map are zero
+    ALWAYS_INLINE uint64_t getMapBits(const uint64_t* row, int words, int px)
+    {
+        int w = px >= 0 ? px / 64 : -((63 - px) / 64);
+        int shift = px - w * 64;
+
+        uint64_t lo = (w >= 0 && w < words) ? row[w] : 0;
+        uint64_t hi = (w + 1 >= 0 && w + 1 < words) ? row[w + 1] : 0;
+
+        return shift ? (lo >> shift) | (hi << (64 - shift)) : lo;
+    }
+
+    ALWAYS_INLINE int countOverlapBits(const MaskBits& maskBits,
+                                const uint64_t* mapBits,
+                                int mapWords,
+                                int mapRows,
+                                int offsetX,
+                                int offsetY)
+    {
+        int cnt = 0;
+
+        for (int j = 0; j < maskBits.rows; j++)
+        {
+            int py = j + maskBits.innerOffset + offsetY;
+
+            if (py < 0 || py >= mapRows)
+            {
+                continue;
+            }
+
+            const uint64_t* maskRow =
+                maskBits.words.data() + (size_t)j * maskBits.rowWords;
+            const uint64_t* mapRow = mapBits + (size_t)py * mapWords;
+
+            int px = maskBits.innerOffset + offsetX;
+
+            for (int w = 0; w < maskBits.rowWords; w++, px += 64)
+            {
+                if (maskRow[w])
+                {
+                    cnt += popCount(maskRow[w] &
+                                    getMapBits(mapRow, mapWords, px));
+                }
+            }
+        }
+
+        return cnt;
+    }
+
+    int countOverlapGeneric(const MaskBits& maskBits,
+                            const uint64_t* mapBits,
+                            int mapWords,
+                            int mapRows,
+                            int offsetX,
+                            int offsetY)
+    {
+        return countOverlapBits(
+            maskBits, mapBits, mapWords, mapRows, offsetX, offsetY);
+    }
+
+#ifdef HAS_TARGET_POPCNT
+    TARGET_POPCNT int countOverlapPopcnt(const MaskBits& maskBits,
+                                         const uint64_t* mapBits,
+                                         int mapWords,
+                                         int mapRows,
+                                         int offsetX,
+                                         int offsetY)
+    {
+        return countOverlapBits(
+            maskBits, mapBits, mapWords, mapRows, offsetX, offsetY);
+    }
+#endif
+} // namespace
+
+void MaskBits::pack(const Mat& mask, int innerOffset)
+{
+    this->innerOffset = innerOffset;
+
+    rows = max(mask.rows - 2 * innerOffset, 0);
+    cols = max(mask.cols - 2 * innerOffset, 0);
+    rowWords = (cols + 63) / 64;
+    words.assign((size_t)rows * rowWords, 0);
+    count = 0;
+
+    for (int j = 0; j < rows; j++)
+    {
+        const uchar* maskRow = mask.ptr<uchar>(j + innerOffset);
+        uint64_t* bitsRow = words.data() + (size_t)j * rowWords;
+
+        for (int i = 0; i < cols; i++)
+        {
+            if (maskRow[i + innerOffset])
+            {
+                bitsRow[i / 64] |= (uint64_t)1 << (i % 64);
+                count++;
+            }
+        }
+    }
+}
+
+int MaskBits::countOverlap(const uint64_t* mapBits,
+                           int mapWords,
+                           int mapRows,
+                           int offsetX,
+                           int offsetY) const
+{
+#ifdef HAS_TARGET_POPCNT
+    static const bool hasPopcnt = checkHardwareSupport(CV_CPU_POPCNT);
+
+    if (hasPopcnt)
+    {
+        return countOverlapPopcnt(
+            *this, mapBits, mapWords, mapRows, offsetX, offsetY);
+    }
+#endif
+
+    return countOverlapGeneric(
+        *this, mapBits, mapWords, mapRows, offsetX, offsetY);
+}
+
 TemplateView::TemplateView(Object3D* object,
                            float alpha,
                            float beta,
@@ -79,6 +233,8 @@ TemplateView::TemplateView(Object3D* object,
 
     _numLevels = numLevels;
 
+    _radius = tclcHistograms.getRadius();
+
     centersIDsPyramid.resize(_numLevels);
     roiPyramid.resize(_numLevels);
     etaFPyramid.resize(_numLevels);
@@ -87,7 +243,12 @@ TemplateView::TemplateView(Object3D* object,
     heavisidePyramid.resize(_numLevels);
     pixelDataPyramid.resize(_numLevels);
 
-    SignedDistanceTransform2D SDT2D(8.0f);
+    // the histogram centers only depend on the full resolution silhouette, so
+    // they are the same on every level
+    tclcHistograms.updateCentersAndIds(
+        mask0 / 255 * m_id, depth0, K, zNear, zFar, 0);
+
+    std::vector<cv::Point3i> centersIDs = tclcHistograms.getCentersAndIDs();
 
     Size maxSize = mask0.size();
 
@@ -95,14 +256,9 @@ TemplateView::TemplateView(Object3D* object,
     {
         int scale = pow(2, level);
 
-        tclcHistograms.updateCentersAndIds(
-            mask0 / 255 * m_id, depth0, K, zNear, zFar, 0);
-
-        std::vector<cv::Point3i> centersIDs = tclcHistograms.getCentersAndIDs();
-
         centersIDsPyramid[level] = centersIDs;
 
-        int offset = tclcHistograms.getRadius() / pow(2, level);
+        int offset = _radius / pow(2, level);
 
         Rect roi = computeBoundingBox(
             centersIDs,
@@ -116,40 +272,78 @@ TemplateView::TemplateView(Object3D* object,
         renderingEngine->renderSilhouette(
             object, GL_FILL, false, 1.0f, 1.0f, 1.0f, true);
 
+        // only the cropped silhouette is kept until postProcess() is called
         Mat mask = renderingEngine->downloadFrame(RenderingEngine::MASK);
-        mask = mask(roi).clone();
+        maskPyramid[level] = mask(roi).clone();
+    }
+}
+
+TemplateView::TemplateView()
+{
+    renderingEngine = RenderingEngine::Instance();
+
+    _alpha = 0.0f;
+    _beta = 0.0f;
+    _gamma = 0.0f;
+
+    _distance = 0.0f;
+
+    _numLevels = 0;
+
+    _radius = 0;
+}
+
+TemplateView::~TemplateView()
+{
+}
+
+void TemplateView::postProcess(const ExecutionContext& context)
+{
+    SignedDistanceTransform2D SDT2D(8.0f, true, context);
+
+    for (int level = 2; level < _numLevels; level++)
+    {
+        Mat mask = maskPyramid[level];
 
         etaFPyramid[level] = countNonZero(mask);
 
         maskPyramid[level] = mask * 255;
 
         Mat sdt, xyPos;
-        SDT2D.computeTransform(mask, sdt, xyPos, 8);
+        SDT2D.computeTransform(mask, sdt, xyPos);
 
         sdtPyramid[level] = sdt;
 
+        int threads = context.getNumPartitions(sdt.rows);
+
         Mat heaviside;
-        parallel_for_(cv::Range(0, 8),
-                      Parallel_For_convertToHeaviside(sdt, heaviside, 8));
+        parallel_for_(cv::Range(0, threads),
+                      Parallel_For_convertToHeaviside(sdt, heaviside, threads));
 
         heavisidePyramid[level] = heaviside;
 
-        compressTemplateData(
-            centersIDs, heaviside, roi, tclcHistograms.getRadius(), level);
+        compressTemplateData(centersIDsPyramid[level],
+                             heaviside,
+                             roiPyramid[level],
+                             _radius,
+                             level);
     }
+
+    packMasks();
 }
 
-TemplateView::~TemplateView()
+void TemplateView::packMasks()
 {
-    for (int i = 0; i < pixelDataPyramid.size(); i++)
+    maskBitsPyramid.assign(_numLevels, MaskBits());
+
+    for (int level = 0; level < _numLevels; level++)
     {
-        for (int j = 0; j < pixelDataPyramid[i].size(); j++)
+        if (!maskPyramid[level].empty())
         {
-            delete[] pixelDataPyramid[i][j].ids;
+            maskBitsPyramid[level].pack(maskPyramid[level],
+                                        _radius / pow(2, level));
         }
-        pixelDataPyramid[i].clear();
     }
-    pixelDataPyramid.clear();
 }
 
 Matx44f TemplateView::getPose()
@@ -217,11 +411,16 @@ vector<Point3i> TemplateView::getCentersAndIDs(int level)
     return centersIDsPyramid[level];
 }
 
-std::vector<PixelData>& TemplateView::getCompressedPixelData(int level)
+const CompressedPixelData& TemplateView::getCompressedPixelData(int level)
 {
     return pixelDataPyramid[level];
 }
 
+const MaskBits& TemplateView::getMaskBits(int level)
+{
+    return maskBitsPyramid[level];
+}
+
 void TemplateView::addNeighborTemplate(TemplateView* kv)
 {
     neighbors.push_back(kv);
@@ -245,6 +444,11 @@ void TemplateView::compressTemplateData(
 
     float* hsData = (float*)heaviside.ptr<float>();
 
+    vector<int> xs, ys, offsets, ids;
+    vector<float> hsVals;
+
+    offsets.push_back(0);
+
     for (int j = 0; j < roi.height; j++)
     {
         int idx = j * roi.width;
@@ -255,7 +459,8 @@ void TemplateView::compressTemplateData(
 
             if (hsVal >= 0.0f)
             {
-                vector<int> ids;
+                size_t numIDs = ids.size();
+
                 for (int h = 0; h < numHistograms; h++)
                 {
                     cv::Point3i centerID = centersIDs[h];
@@ -270,25 +475,31 @@ void TemplateView::compressTemplateData(
                     }
                 }
 
-                if (ids.size() > 1)
+                if (ids.size() - numIDs > 1)
                 {
-                    PixelData pixelData;
-                    pixelData.x = i;
-                    pixelData.y = j;
-                    pixelData.hsVal = hsVal;
-                    pixelData.ids_size = (int)ids.size();
-                    pixelData.ids = new int[pixelData.ids_size];
-
-                    for (int k = 0; k < ids.size(); k++)
-                    {
-                        pixelData.ids[k] = ids[k];
-                    }
-
-                    pixelDataPyramid[level].push_back(pixelData);
+                    xs.push_back(i);
+                    ys.push_back(j);
+                    hsVals.push_back(hsVal);
+                    offsets.push_back((int)ids.size());
+                }
+                else
+                {
+                    ids.resize(numIDs);
                 }
             }
         }
     }
+
+    // copy everything into a single block of memory that is streamed through
+    // during template matching
+    CompressedPixelData& pixelData = pixelDataPyramid[level];
+    pixelData.allocate((int)xs.size(), (int)ids.size());
+
+    copy(xs.begin(), xs.end(), pixelData.x);
+    copy(ys.begin(), ys.end(), pixelData.y);
+    copy(hsVals.begin(), hsVals.end(), pixelData.hsVal);
+    copy(offsets.begin(), offsets.end(), pixelData.offsets);
+    copy(ids.begin(), ids.end(), pixelData.ids);
 }
 
 cv::Rect
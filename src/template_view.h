@@ -36,33 +36,155 @@
 #ifndef TEMPLATE_VIEW_H
 #define TEMPLATE_VIEW_H
 
+#include <cstdint>
 #include <vector>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "execution_context.h"
 #include "object3d.h"
 #include "rendering_engine.h"
 #include "signed_distance_transform2d.h"
 #include "tclc_histograms.h"
+#include "trace.h"
 
 /**
- *  The template view data per pixel.
+ *  The compressed template view data of a single pyramid level in a structure
+ *  of arrays layout. The pixels are ordered by rows and the IDs of the
+ *  tclc-histograms pixel p lies within are ids[offsets[p]] ...
+ *  ids[offsets[p + 1] - 1]. All arrays are stored consecutively in a single
+ *  block of memory, that is either owned by the buffer or, if the buffer is
+ *  empty, belongs to someone else, e.g. a memory mapped template cache.
  */
-struct PixelData
+struct CompressedPixelData
 {
-    // The original 2D pixel location.
-    int x;
-    int y;
+    // The number of pixels.
+    int numPixels;
 
-    // The Heaviside value.
-    float hsVal;
+    // The overall number of histogram IDs of all pixels.
+    int numIDs;
 
-    // The number of tclc-histograms the pixel lies within.
-    int ids_size;
+    // The original 2D pixel locations.
+    int* x;
+    int* y;
 
-    // The IDs of all tclc-histograms the pixel lies within.
+    // The Heaviside values.
+    float* hsVal;
+
+    // The start of each pixel's list within ids (numPixels + 1 entries).
+    int* offsets;
+
+    // The IDs of all tclc-histograms the pixels lie within.
     int* ids;
+
+    // The memory of all arrays, if owned.
+    cv::Mat buffer;
+
+    CompressedPixelData()
+    {
+        assign(nullptr, 0, 0);
+    }
+
+    /**
+     *  Returns the number of 32 bit elements of the memory block holding all
+     * arrays.
+     *
+     *  @param  numPixels The number of pixels.
+     *  @param  numIDs The overall number of histogram IDs.
+     *  @return The number of elements.
+     */
+    static size_t getSize(int numPixels, int numIDs)
+    {
+        return 4 * (size_t)numPixels + 1 + numIDs;
+    }
+
+    /**
+     *  Allocates an owned block of memory for the given number of pixels and
+     * histogram IDs.
+     *
+     *  @param  numPixels The number of pixels.
+     *  @param  numIDs The overall number of histogram IDs.
+     */
+    void allocate(int numPixels, int numIDs)
+    {
+        buffer.create(1, (int)getSize(numPixels, numIDs), CV_32SC1);
+
+        assign((int*)buffer.data, numPixels, numIDs);
+    }
+
+    /**
+     *  Sets up the arrays within a given block of memory without taking
+     * ownership of it.
+     *
+     *  @param  data The memory block of getSize(numPixels, numIDs) elements.
+     *  @param  numPixels The number of pixels.
+     *  @param  numIDs The overall number of histogram IDs.
+     */
+    void assign(int* data, int numPixels, int numIDs)
+    {
+        this->numPixels = numPixels;
+        this->numIDs = numIDs;
+
+        x = data;
+        y = data + numPixels;
+        hsVal = (float*)(data + 2 * numPixels);
+        offsets = data + 3 * numPixels;
+        ids = data + 4 * numPixels + 1;
+    }
+};
+
+/**
+ *  The inner region of a template mask, i.e. without a border of innerOffset
+ *  pixels, packed into rows of 64 bit words, where bit k of word w in a row
+ *  corresponds to column 64 * w + k of the inner region.
+ */
+struct MaskBits
+{
+    // The rows of the inner region.
+    std::vector<uint64_t> words;
+
+    // The number of words per row.
+    int rowWords;
+
+    // The size of the inner region and of the excluded border.
+    int rows;
+    int cols;
+    int innerOffset;
+
+    // The number of foreground pixels within the inner region.
+    int count;
+
+    MaskBits() : rowWords(0), rows(0), cols(0), innerOffset(0), count(0)
+    {
+    }
+
+    /**
+     *  Packs the inner region of a template mask.
+     *
+     *  @param  mask The 8 bit template mask.
+     *  @param  innerOffset The size of the excluded border.
+     */
+    void pack(const cv::Mat& mask, int innerOffset);
+
+    /**
+     *  Counts the foreground pixels of the inner region that overlap with the
+     * foreground of a packed map when the mask is placed at the given offset
+     * within the map. The overlap is counted with an AND and a popcount per
+     * 64 pixels, using the popcount instruction if the CPU supports it.
+     *
+     *  @param  mapBits The rows of the map, packed like the mask.
+     *  @param  mapWords The number of words per row of the map.
+     *  @param  mapRows The number of rows of the map.
+     *  @param  offsetX The horizontal offset of the mask within the map.
+     *  @param  offsetY The vertical offset of the mask within the map.
+     *  @return The number of overlapping foreground pixels.
+     */
+    int countOverlap(const uint64_t* mapBits,
+                     int mapWords,
+                     int mapRows,
+                     int offsetX,
+                     int offsetY) const;
 };
 
 /**
@@ -75,7 +197,10 @@ class TemplateView
   public:
     /**
      *  Constructor for the template view at a given object rotation and
-     *  distance to the camera.
+     *  distance to the camera. It renders the object's silhouette and
+     *  determines the tclc-histogram centers, which requires the offscreen
+     *  rendering OpenGL context to be active. The remaining template data is
+     *  computed by postProcess().
      *
      *  @param  object The 3D object for which the template view is to be
      * created.
@@ -101,6 +226,17 @@ class TemplateView
 
     ~TemplateView();
 
+    /**
+     *  Computes the signed distance transforms, the Heaviside representations
+     *  and the compressed pixel data of the rendered silhouettes on the CPU.
+     *  It does not use the rendering engine, so different template views can
+     *  be post-processed concurrently.
+     *
+     *  @param  context The execution context used to parallelize the signed
+     * distance transforms.
+     */
+    void postProcess(const ExecutionContext& context = ExecutionContext());
+
     /**
      *  Returns the 6DOF object pose coresponding to the
      *  template view in form of a 4x4 float matrix
@@ -233,7 +369,17 @@ class TemplateView
      *  @param level The pyramid level to be used.
      *  @return  The linearized representation of the template.
      */
-    std::vector<PixelData>& getCompressedPixelData(int level);
+    const CompressedPixelData& getCompressedPixelData(int level);
+
+    /**
+     *  Returns the inner region of the binary mask of the template at a given
+     *  pyramid level packed into bits, where the excluded border is the
+     *  tclc-histogram radius at that level.
+     *
+     *  @param level The pyramid level to be used.
+     *  @return  The packed inner region of the template mask.
+     */
+    const MaskBits& getMaskBits(int level);
 
     /**
      *  Adds a neighboring template view to this template.
@@ -250,6 +396,11 @@ class TemplateView
     std::vector<TemplateView*> getNeighborTemplates();
 
   private:
+    // template views loaded from a cache are filled in by the cache itself
+    friend class TemplateCache;
+
+    TemplateView();
+
     RenderingEngine* renderingEngine;
 
     cv::Matx44f T_cm;
@@ -263,7 +414,9 @@ class TemplateView
 
     std::vector<std::vector<cv::Point3i>> centersIDsPyramid;
 
-    std::vector<std::vector<PixelData>> pixelDataPyramid;
+    std::vector<CompressedPixelData> pixelDataPyramid;
+
+    std::vector<MaskBits> maskBitsPyramid;
 
     cv::Point3f currentOffset;
 
@@ -275,8 +428,12 @@ class TemplateView
 
     int _numLevels;
 
+    int _radius;
+
     std::vector<TemplateView*> neighbors;
 
+    void packMasks();
+
     void compressTemplateData(const std::vector<cv::Point3i>& centersIDs,
                               const cv::Mat& heaviside,
                               const cv::Rect& roi,
@@ -289,6 +446,37 @@ class TemplateView
                                 const cv::Size& maxSize);
 };
 
+/**
+ *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
+ *  computations. Within the corresponding for loop, a set of rendered template
+ *  views is post-processed, each of them by a single thread.
+ */
+class Parallel_For_postProcessTemplates : public cv::ParallelLoopBody
+{
+  private:
+    TemplateView** _templateViews;
+
+  public:
+    Parallel_For_postProcessTemplates(TemplateView** templateViews)
+    {
+        _templateViews = templateViews;
+    }
+
+    virtual void operator()(const cv::Range& r) const
+    {
+        TRACE_SCOPE("Parallel_For_postProcessTemplates");
+
+        // the views are already processed in parallel, so the loops within
+        // each of them are not split any further
+        ExecutionContext context(1);
+
+        for (int i = r.start; i < r.end; i++)
+        {
+            _templateViews[i]->postProcess(context);
+        }
+    }
+};
+
 /**
  *  This class extends the OpenCV ParallelLoopBody for efficiently parallelized
  *  computations. Within the corresponding for loop, every pixel of a given 2D
@@ -322,6 +510,8 @@ class Parallel_For_convertToHeaviside : public cv::ParallelLoopBody
 
     virtual void operator()(const cv::Range& r) const
     {
+        TRACE_SCOPE("Parallel_For_convertToHeaviside");
+
         int range = _sdt.rows / _threads;
 
         int yEnd = r.end * range;
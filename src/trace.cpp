@@ -0,0 +1,180 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "trace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// times in nanoseconds since the start of the trace
+struct TraceEvent
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+// the events of a single thread, which is the only one appending to it
+struct TraceBuffer
+{
+    static const size_t capacity = 1 << 20;
+
+    explicit TraceBuffer(int threadID)
+        : threadID{threadID}, events{new TraceEvent[capacity]}
+    {
+    }
+
+    int threadID;
+
+    // only the pages that are actually written are committed
+    unique_ptr<TraceEvent[]> events;
+
+    atomic<size_t> numEvents{0};
+    atomic<size_t> numDropped{0};
+};
+
+// the buffers are never freed, since the threads of OpenCV's pool live
+// until the process exits anyway
+static mutex buffersMutex;
+static vector<unique_ptr<TraceBuffer>> buffers;
+
+static const chrono::steady_clock::time_point traceStart =
+    chrono::steady_clock::now();
+
+static TraceBuffer* getThreadBuffer()
+{
+    thread_local TraceBuffer* buffer = nullptr;
+
+    if (buffer == nullptr)
+    {
+        lock_guard<mutex> lock(buffersMutex);
+        buffers.push_back(make_unique<TraceBuffer>((int)buffers.size()));
+        buffer = buffers.back().get();
+    }
+    return buffer;
+}
+
+static int64_t toNanoseconds(chrono::steady_clock::time_point time)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(time - traceStart)
+        .count();
+}
+
+bool Trace::isEnabled()
+{
+#ifdef RBOT_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Trace::record(const char* name,
+                   chrono::steady_clock::time_point start,
+                   chrono::steady_clock::time_point end)
+{
+    TraceBuffer* buffer = getThreadBuffer();
+
+    size_t n = buffer->numEvents.load(memory_order_relaxed);
+    if (n == TraceBuffer::capacity)
+    {
+        buffer->numDropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[n] =
+        TraceEvent{name, toNanoseconds(start), toNanoseconds(end)};
+
+    // publish the event to the exporter
+    buffer->numEvents.store(n + 1, memory_order_release);
+}
+
+bool Trace::writeChromeTrace(const string& filename)
+{
+    ofstream file(filename);
+    if (!file)
+    {
+        return false;
+    }
+
+    lock_guard<mutex> lock(buffersMutex);
+
+    // complete events with timestamps and durations in microseconds
+    file << fixed << setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (size_t b = 0; b < buffers.size(); b++)
+    {
+        const TraceBuffer& buffer = *buffers[b];
+
+        size_t numEvents = buffer.numEvents.load(memory_order_acquire);
+        for (size_t i = 0; i < numEvents; i++)
+        {
+            const TraceEvent& event = buffer.events[i];
+
+            file << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+                 << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer.threadID
+                 << ",\"ts\":" << event.start / 1000.0
+                 << ",\"dur\":" << (event.end - event.start) / 1000.0
+                 << "}";
+            first = false;
+        }
+    }
+
+    file << "\n]}\n";
+
+    return (bool)file;
+}
+
+size_t Trace::getNumDroppedEvents()
+{
+    lock_guard<mutex> lock(buffersMutex);
+
+    size_t numDropped = 0;
+    for (size_t b = 0; b < buffers.size(); b++)
+    {
+        numDropped += buffers[b]->numDropped.load(memory_order_relaxed);
+    }
+    return numDropped;
+}
@@ -0,0 +1,131 @@
+/**
+ *   #, #,         CCCCCC  VV    VV MM      MM RRRRRRR
+ *  %  %(  #%%#   CC    CC VV    VV MMM    MMM RR    RR
+ *  %    %## #    CC        V    V  MM M  M MM RR    RR
+ *   ,%      %    CC        VV  VV  MM  MM  MM RRRRRR
+ *   (%      %,   CC    CC   VVVV   MM      MM RR   RR
+ *     #%    %*    CCCCCC     VV    MM      MM RR    RR
+ *    .%    %/
+ *       (%.      Computer Vision & Mixed Reality Group
+ *                For more information see <http://cvmr.info>
+ *
+ * This file is part of RBOT.
+ *
+ *  @copyright:   RheinMain University of Applied Sciences
+ *                Wiesbaden Rüsselsheim
+ *                Germany
+ *     @author:   Henning Tjaden
+ *                <henning dot tjaden at gmail dot com>
+ *    @version:   1.0
+ *       @date:   30.08.2018
+ *
+ * RBOT is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RBOT is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RBOT. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <string>
+
+/**
+ *  Records a trace event spanning the rest of the enclosing scope, but only
+ *  if the tracker was built with RBOT_TRACE defined (meson option trace).
+ *  Otherwise it expands to nothing and costs nothing.
+ *
+ *  @param  name A string literal naming the traced code.
+ */
+#ifdef RBOT_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_CONCAT_IMPL(a, b) a##b
+
+/**
+ *  This class collects trace events from all threads and exports them in
+ *  the Chrome trace event format, which can be opened e.g. in
+ *  chrome://tracing or Perfetto. Every thread appends its events to its own
+ *  preallocated buffer without any locking, events of a thread whose buffer
+ *  is full are dropped.
+ */
+class Trace
+{
+  public:
+    /**
+     *  Tells whether the tracker was built with tracing enabled.
+     *
+     *  @return True if TRACE_SCOPE records events and false otherwise.
+     */
+    static bool isEnabled();
+
+    /**
+     *  Appends an event to the buffer of the calling thread.
+     *
+     *  @param  name The name of the event, which must outlive the trace.
+     *  @param  start The time at which the event began.
+     *  @param  end The time at which the event ended.
+     */
+    static void record(const char* name,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end);
+
+    /**
+     *  Writes all events recorded so far as Chrome trace event JSON. It must
+     *  not be called while events are being recorded.
+     *
+     *  @param  filename The path of the JSON file to be written.
+     *  @return True if the file was written successfully.
+     */
+    static bool writeChromeTrace(const std::string& filename);
+
+    /**
+     *  Returns the number of events that were dropped because the buffer of
+     *  their thread was full.
+     *
+     *  @return The number of dropped events.
+     */
+    static size_t getNumDroppedEvents();
+};
+
+/**
+ *  A scoped timer that records a trace event from its construction to its
+ *  destruction. Use TRACE_SCOPE instead of instantiating it directly.
+ */
+class TraceScope
+{
+  public:
+    explicit TraceScope(const char* name)
+        : name{name}, start{std::chrono::steady_clock::now()}
+    {
+    }
+
+    ~TraceScope()
+    {
+        Trace::record(name, start, std::chrono::steady_clock::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+  private:
+    const char* name;
+
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // TRACE_H
@@ -1,5 +1,6 @@
 #include "video.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <exception>
 #include <filesystem>
@@ -10,7 +11,6 @@
 
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
-#include <boost/interprocess/sync/scoped_lock.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
@@ -26,9 +26,11 @@ namespace
         ~CVV4l2Video() override;
         auto readFrameInto(cv::Mat& destination) -> void override;
         auto togglePause() -> void override;
+        auto interrupt() -> void override;
 
       private:
         cv::VideoCapture video = cv::VideoCapture{};
+        std::atomic<bool> interrupted = false;
     };
 
     CVV4l2Video::CVV4l2Video(std::filesystem::path const& devicePath,
@@ -61,10 +63,20 @@ namespace
         // TODO implement me
     }
 
+    auto CVV4l2Video::interrupt() -> void
+    {
+        this->interrupted = true;
+    }
+
     auto CVV4l2Video::readFrameInto(cv::Mat& destination) -> void
     {
         do
         {
+            // each grab returns after the driver's timeout at the latest
+            if (this->interrupted)
+            {
+                throw fds::VideoInterrupted{};
+            }
             this->video >> destination;
         } while (destination.empty());
     }
@@ -72,7 +84,10 @@ namespace
     class CVFileVideo final : public fds::Video
     {
       public:
-        CVFileVideo(std::filesystem::path const& devicePath, int width, int height);
+        CVFileVideo(std::filesystem::path const& devicePath,
+                    int width,
+                    int height,
+                    bool loop);
         ~CVFileVideo() override;
         auto readFrameInto(cv::Mat& destination) -> void override;
         auto togglePause() -> void override;
@@ -81,12 +96,14 @@ namespace
         cv::VideoCapture video = cv::VideoCapture{};
         cv::Size size;
         cv::Mat lastFrame;
+        bool loop;
         bool paused = false;
     };
 
     CVFileVideo::CVFileVideo(std::filesystem::path const& devicePath,
                      int const width,
-                     int const height): size(width, height)
+                     int const height,
+                     bool const loop): size(width, height), loop(loop)
     {
         if (!this->video.open(devicePath, cv::CAP_ANY))
         {
@@ -114,6 +131,10 @@ namespace
         {
             this->video.read(this->lastFrame);
             if (this->lastFrame.empty()) {
+                if (!this->loop)
+                {
+                    throw fds::EndOfVideo{};
+                }
                 this->video.set(cv::CAP_PROP_POS_FRAMES, 0);
             } else {
                 cv::resize(this->lastFrame, destination, this->size);
@@ -144,7 +165,8 @@ namespace
             }();
 
             this->region = mapped_region{shm, read_write};
-            this->data = static_cast<fds::SharedData*>(region.get_address());
+            this->reader.emplace(
+                *static_cast<fds::SharedData*>(region.get_address()));
         }
 
         auto togglePause() -> void override
@@ -152,30 +174,29 @@ namespace
             // TODO implement me
         }
 
-        auto readFrameInto(cv::Mat& destination) -> void override
+        auto interrupt() -> void override
         {
-            using namespace boost::interprocess;
-
-            scoped_lock<interprocess_mutex> lock{data->mutex};
+            this->reader->interrupt();
+        }
 
-            // Wait for the producer to write the next frame.
-            if (!data->requestRead)
+        auto readFrameInto(cv::Mat& destination) -> void override
+        {
+            // Wait for the frame following this reader's cursor and lease its
+            // slot, which neither locks nor stalls the producer. Since a Video
+            // hands out frames it does not own, the leased frame is copied
+            // once and the lease is released right away.
+            auto const lease = this->reader->leaseNextFrame();
+            if (lease.getFrame().empty())
             {
-                data->condRead.wait(lock);
+                throw fds::VideoInterrupted{};
             }
-
-            cv::Mat source{cv::Size(data->width, data->height),
-                           CV_8UC3,
-                           data->frame,
-                           cv::Mat::AUTO_STEP};
-            source.copyTo(destination);
-            data->requestRead = false;
+            lease.getFrame().copyTo(destination);
         }
 
       private:
         boost::interprocess::shared_memory_object shm;
         boost::interprocess::mapped_region region;
-        fds::SharedData* data;
+        std::optional<fds::SharedFrameReader> reader;
     };
 } // namespace
 
@@ -190,9 +211,10 @@ namespace fds
 
     auto makeCVFileVideo(std::filesystem::path const& devicePath,
                      int const width,
-                     int const height) -> std::unique_ptr<Video>
+                     int const height,
+                     bool const loop) -> std::unique_ptr<Video>
     {
-        return std::make_unique<CVFileVideo>(devicePath, width, height);
+        return std::make_unique<CVFileVideo>(devicePath, width, height, loop);
     }
 
     auto makeSHMVideo() -> std::unique_ptr<Video>
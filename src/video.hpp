@@ -2,6 +2,7 @@
 #include <filesystem>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 
 #include <opencv2/core.hpp>
 
@@ -13,6 +14,31 @@ namespace fds
         virtual ~Video(){};
         virtual auto readFrameInto(cv::Mat& destination) -> void = 0;
         virtual auto togglePause() -> void = 0;
+
+        // Makes a read that blocks on another thread throw VideoInterrupted,
+        // as well as all later reads. Videos whose reads always return on
+        // their own need not override it.
+        virtual auto interrupt() -> void
+        {
+        }
+    };
+
+    // Thrown by videos that do not loop once all frames have been read.
+    class EndOfVideo final : public std::runtime_error
+    {
+      public:
+        EndOfVideo() : std::runtime_error{"End of video\n"}
+        {
+        }
+    };
+
+    // Thrown by reads of a video that has been interrupted.
+    class VideoInterrupted final : public std::runtime_error
+    {
+      public:
+        VideoInterrupted() : std::runtime_error{"Video interrupted\n"}
+        {
+        }
     };
 
     auto findDevicePath() noexcept -> std::optional<std::filesystem::path>;
@@ -21,9 +47,12 @@ namespace fds
                      int width,
                      int height) -> std::unique_ptr<Video>;
 
+    // Plays back a video file or an image sequence given as a printf-style
+    // pattern, e.g. frame_%04d.png, starting over at the end if loop is set.
     auto makeCVFileVideo(std::filesystem::path const& devicePath,
                      int width,
-                     int height) -> std::unique_ptr<Video>;
+                     int height,
+                     bool loop = true) -> std::unique_ptr<Video>;
 
     auto makeSHMVideo() -> std::unique_ptr<Video>;
 } // namespace fds